@@ -5,6 +5,8 @@
 #include "data-structs/vector.h"
 
 extern void alias_init(HashTable* rawcmds, Vector* aliases);
+extern void alias_reload(HashTable* rawcmds, Vector* aliases);
+extern void alias_share(void);
 extern void alias_free(HashTable* rawcmds, Vector* aliases);
 
 #endif
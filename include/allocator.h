@@ -0,0 +1,24 @@
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+#include <stddef.h>
+
+typedef enum subsystem {
+	MEM_HASH,    	// lib/data-structs/hash.c
+	MEM_VECTOR,  	// lib/data-structs/vector.c
+	MEM_STRUTIL, 	// lib/strutil/strutil.c
+	MEM_ALIAS,   	// Alias file contents
+	MEM_PROMPT,  	// Prompt construction
+	MEM_PARSER,  	// Command lines, argv arrays and expansions
+	MEM_INTERN,  	// Interned strings
+	MEM_EDITOR,  	// The built-in line editor
+	MEM_SHELL,   	// Everything else
+	MEM_SUBSYSTEMS	// Number of subsystems, not a tag
+} Subsystem;
+
+extern void* tsh_calloc(Subsystem owner, size_t amount, size_t size);
+extern void* tsh_realloc(Subsystem owner, void* pointer, size_t size);
+extern void tsh_free(void* pointer);
+extern void mem_report(void);
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef AUDIT_H
+#define AUDIT_H
+
+#include <stdint.h>
+
+#define AUDIT_MAGIC  	0x31415554	// "TUA1"
+#define AUDIT_RECORDS	16384    	// Records kept in '~/.tsh-audit' before the oldest are overwritten.
+#define AUDIT_POOL   	(1 << 21)	// Bytes of command and directory text kept alongside them.
+#define AUDIT_COMMAND_MAX	4096	// Longer commands are cut short.
+
+/*
+ * '~/.tsh-audit' holds the header, a ring of fixed-size records, then a
+ * ring of text (the string pool) that the records point into. Positions
+ * only ever grow; the ring slot is the position modulo the ring's size,
+ * so a reader can tell whether something was overwritten since.
+ * Shared by the shell and 'tools/tsh-audit.c'.
+ */
+typedef struct audit_header {
+	uint32_t magic;   	// AUDIT_MAGIC.
+	uint32_t records; 	// Slots in the record ring.
+	uint64_t poolSize;	// Bytes in the string pool.
+	uint64_t next;    	// Records appended so far, by every session.
+	uint64_t poolNext;	// Bytes appended to the pool so far.
+} audit_header;
+
+typedef struct audit_record {
+	uint64_t sequence;     	// Position of the record plus one, 0 while it is being written.
+	int64_t started;       	// When the command started, in nanoseconds since the Epoch.
+	uint64_t duration;     	// How long it ran, in nanoseconds.
+	uint64_t command;      	// Pool position of the command line.
+	uint64_t cwd;          	// Pool position of the working directory.
+	uint32_t commandLength;
+	uint32_t cwdLength;
+	int32_t status;        	// Exit status.
+	int32_t pid;           	// The shell that ran it.
+} audit_record;
+
+#define AUDIT_SIZE(records, pool)	(sizeof(audit_header) + (size_t) (records) * sizeof(audit_record) + (pool))
+#define AUDIT_RING(header)       	((audit_record*) ((char*) (header) + sizeof(audit_header)))
+#define AUDIT_TEXT(header)       	((char*) (AUDIT_RING(header) + (header)->records))
+
+extern void audit_init(void);
+extern void audit_start(void);
+extern void audit_finish(const char* command, int status);
+extern void audit_moved(void);
+extern void audit_free(void);
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdbool.h>
+
+#include "data-structs/vector.h"
+
+#define BENCH_DEFAULT_RUNS	10	// Timed runs when '-n' is not given.
+
+extern int bench_run(Vector* tokens, const bool* quoted);
+
+#endif
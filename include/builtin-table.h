@@ -0,0 +1,48 @@
+/*
+ * Generated by tools/gen-builtins.c from 'builtins.def'. Do not edit;
+ * run 'make builtins' instead.
+ */
+#ifndef BUILTIN_TABLE_H
+#define BUILTIN_TABLE_H
+
+#include "builtin.h"
+
+#define BUILTIN_SEED 	39U	// Sends every builtin to its own slot.
+#define BUILTIN_SLOTS	32	// Always a power of two.
+
+static const Builtin builtinSlots[BUILTIN_SLOTS] = {
+	BUILTIN_PUSHD,
+	BUILTIN_NONE,
+	BUILTIN_HELP,
+	BUILTIN_DIRS,
+	BUILTIN_NONE,
+	BUILTIN_NONE,
+	BUILTIN_OUT,
+	BUILTIN_COPROC,
+	BUILTIN_CD,
+	BUILTIN_KEYSTATS,
+	BUILTIN_QUIT,
+	BUILTIN_NONE,
+	BUILTIN_NONE,
+	BUILTIN_NONE,
+	BUILTIN_NONE,
+	BUILTIN_MEM,
+	BUILTIN_Z,
+	BUILTIN_NONE,
+	BUILTIN_EXIT,
+	BUILTIN_HISTORY,
+	BUILTIN_NONE,
+	BUILTIN_NONE,
+	BUILTIN_BENCH,
+	BUILTIN_NONE,
+	BUILTIN_NONE,
+	BUILTIN_POPD,
+	BUILTIN_CACHE,
+	BUILTIN_NONE,
+	BUILTIN_NONE,
+	BUILTIN_LOGOUT,
+	BUILTIN_NONE,
+	BUILTIN_NONE
+};
+
+#endif
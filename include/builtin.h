@@ -0,0 +1,28 @@
+#ifndef BUILTIN_H
+#define BUILTIN_H
+
+#include <stdint.h>
+
+typedef enum builtin {
+	#define BUILTIN(id, name) id,
+	#include "builtins.def"
+	#undef BUILTIN
+	BUILTIN_COUNT,	// Number of builtins, not a builtin
+	BUILTIN_NONE  	// Not a builtin
+} Builtin;
+
+/*
+ * FNV-1a, varied by a seed. tools/gen-builtins.c searches for a seed
+ * that sends every builtin name to a different slot.
+ */
+static inline uint32_t builtin_hash(const char* name, uint32_t seed) {
+	uint32_t hash = 2166136261U ^ seed;
+	for (const unsigned char* c = (const unsigned char*) name; *c != 0; c++)
+		hash = (hash ^ *c) * 16777619U;
+	return hash ^ (hash >> 15);
+}
+
+extern void builtin_init(void);
+extern Builtin builtin_find(const char* name);
+
+#endif
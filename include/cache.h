@@ -0,0 +1,12 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdbool.h>
+
+#include "data-structs/vector.h"
+
+#define CACHE_DIRECTORY	".tsh-cache"	// Under $HOME: 'keys' and 'blobs'.
+
+extern int cache_run(Vector* tokens, const bool* quoted);
+
+#endif
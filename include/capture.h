@@ -0,0 +1,18 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "data-structs/vector.h"
+
+#define CAPTURE_COMMANDS	64 	// Commands whose output 'out' can replay.
+#define CAPTURE_DRAIN_MS	100	// How long to wait for output after a command ends.
+
+extern bool capture_init(size_t budget);
+extern bool capture_begin(const char* command);
+extern void capture_end(void);
+extern int capture_replay(Vector* tokens);
+extern void capture_free(void);
+
+#endif
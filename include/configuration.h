@@ -2,10 +2,15 @@
 #define CONFIGURATION_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
 typedef struct config {
 	bool colors;    	// Should the prompt be colored
 	char prompt[32];	// Prompt format
+	bool shared;    	// Share aliases and History with other sessions
+	bool editor;    	// Edit lines with the built-in editor instead of readline
+	bool audit;     	// Record every command in '~/.tsh-audit'
+	size_t capture; 	// Bytes of command output kept for 'out', 0 for none
 } Configuration;
 
 extern Configuration config_read(void);
@@ -0,0 +1,17 @@
+#ifndef COPROC_H
+#define COPROC_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "data-structs/vector.h"
+
+#define COPROC_MAX	16	// Coprocesses that can be known at once.
+
+extern int coproc_run(Vector* tokens);
+extern bool coproc_redirect(Vector* tokens, bool* quoted, int saved[2]);
+extern void coproc_restore(int saved[2]);
+extern void coproc_exited(pid_t pid, int status);
+extern void coproc_free(void);
+
+#endif
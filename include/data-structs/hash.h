@@ -7,8 +7,9 @@ typedef struct {
 } HashTable;
 
 extern HashTable hash_init(int size);
-extern void* hash_lookUp(HashTable* table, char* key);
-extern int hash_map(HashTable* table, char* key, char* value);
-extern void hash_unmap(HashTable* table, char* key);
+extern void* hash_lookUp(HashTable* table, const char* key);
+extern int hash_map(HashTable* table, const char* key, char* value);
+extern void hash_unmap(HashTable* table, const char* key);
+extern void hash_resize(HashTable* table, int size);
 
 #endif
@@ -0,0 +1,17 @@
+#ifndef DIRECTORY_H
+#define DIRECTORY_H
+
+#include "data-structs/vector.h"
+
+#define DIRECTORY_INITIAL_SIZE	65536	// Starting size of '~/.tsh-dirs', doubled as it fills.
+#define DIRECTORY_AGING_LIMIT 	250000	// Total visits at which every count is scaled down.
+
+extern void directory_init(void);
+extern void directory_visit(void);
+extern int directory_jump(Vector* tokens);
+extern int directory_push(Vector* tokens);
+extern int directory_pop(Vector* tokens);
+extern int directory_print(Vector* tokens);
+extern void directory_free(void);
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef EDITOR_H
+#define EDITOR_H
+
+#include "data-structs/vector.h"
+
+#define EDITOR_INPUT_SIZE	256	// Bytes read from the terminal at a time.
+
+typedef void (*EditorHandler)(char* line);
+typedef void (*EditorCompleter)(const char* word, Vector* matches);
+
+extern void editor_start(const char* prompt, EditorHandler handler);
+extern void editor_stop(void);
+extern void editor_read(void);
+extern void editor_set_prompt(const char* prompt);
+extern void editor_set_completer(EditorCompleter completer);
+extern void editor_complete_files(const char* word, Vector* matches);
+extern void editor_redisplay(void);
+extern void editor_cancel(void);
+extern void editor_resize(void);
+extern void editor_report(void);
+
+#endif
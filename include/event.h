@@ -0,0 +1,20 @@
+#ifndef EVENT_H
+#define EVENT_H
+
+#include <stdbool.h>
+
+typedef void (*EventHandler)(int fd, void* data);
+typedef void (*SignalHandler)(int signal);
+
+extern bool event_init(void);
+extern bool event_watch(int fd, EventHandler handler, void* data);
+extern void event_unwatch(int fd);
+extern int event_timer(unsigned int milliseconds, bool repeat, EventHandler handler, void* data);
+extern void event_cancel(int timer);
+extern bool event_signal(int signal, SignalHandler handler);
+extern void event_discard(int signal);
+extern bool event_pending(int signal);
+extern void event_run(void);
+extern void event_stop(void);
+
+#endif
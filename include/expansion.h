@@ -0,0 +1,32 @@
+#ifndef EXPANSION_H
+#define EXPANSION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "data-structs/vector.h"
+
+#define EXPANSION_MAX_WORDS	(1 << 20)	// Brace expansions beyond this are refused.
+
+typedef struct expansion {
+	Vector words;	// The argument vector, pointing into 'text'.
+	bool* quoted;	// For each word, whether it was quoted, escaped or expanded, so it is never an operator.
+	char* text;  	// Every word, each ending in a Null.
+} Expansion;
+
+typedef struct expansion_word ExpansionWord; // A word parsed once, to be expanded many times.
+
+/*
+ * Gives the value of a variable, or the output of a command substitution
+ * (the whole "$(...)" or "`...`"), as a string to be freed with tsh_free().
+ */
+typedef char* (*ExpansionValue)(const char* text, bool command);
+
+extern bool expand_line(const char* input, Expansion* result);
+extern void expansion_free(Expansion* result);
+extern ExpansionWord* expansion_compile(const char* text, size_t length);
+extern bool expansion_expand(ExpansionWord* const* words, unsigned int count, ExpansionValue value, Expansion* result);
+extern const char* expansion_word_text(const ExpansionWord* word);
+extern void expansion_word_free(ExpansionWord* word);
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#define INTERN_INITIAL_SLOTS	64	// Starting size of the intern table, doubled at half full.
+
+extern const char* intern(const char* text);
+extern const char* intern_find(const char* text);
+extern void intern_report(void);
+extern void intern_free(void);
+
+#endif
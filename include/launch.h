@@ -0,0 +1,11 @@
+#ifndef LAUNCH_H
+#define LAUNCH_H
+
+#include <stdbool.h>
+
+#include "data-structs/vector.h"
+
+extern bool launch_parse(Vector* tokens);
+extern void launch_apply(void);
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+typedef enum list_operator {
+	LIST_SEQUENCE,	// ';' or the end of the line, always run the next command
+	LIST_AND,     	// '&&', run the next command if this one succeeded
+	LIST_OR       	// '||', run the next command if this one failed
+} ListOperator;
+
+extern char* parser_next_command(char** line, ListOperator* next);
+
+#endif
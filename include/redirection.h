@@ -1,11 +1,20 @@
 #ifndef REDIRECTION_H
 #define REDIRECTION_H
 
-#define REDIRECT_SUCCESS 1
-#define REDIRECT_FAILURE 0
+#include <stdbool.h>
 
-extern int redirect_in(int argc, char* argv[]);
-extern int redirect_out(int argc, char* argv[]);
-extern int redirect_pipe(int argc, char* argv[]);
+#include "data-structs/vector.h"
+
+#define REDIRECT_NONE -1 // No redirection symbol was found.
+
+extern int redirect_in(int argc, char* argv[], const bool* quoted);
+extern int redirect_heredoc(int argc, char* argv[], const bool* quoted);
+extern int redirect_out(int argc, char* argv[], const bool* quoted);
+extern int redirect_pipe(int argc, char* argv[], const bool* quoted);
+extern int redirect_tee(int argc, char* argv[], const bool* quoted);
+extern bool redirect_output(int argc, char* argv[], const bool* quoted);
+extern bool redirect_builtin(Vector* tokens, bool* quoted, int* saved);
+extern void redirect_restore(int saved);
+extern void redirect_lines(Vector* lines, unsigned int* next);
 
 #endif
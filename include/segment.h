@@ -0,0 +1,18 @@
+#ifndef SEGMENT_H
+#define SEGMENT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define SEGMENT_TIMEOUT_MS	2000	// How long a worker may take before it is killed.
+#define SEGMENT_VALUE_SIZE	64  	// Bytes of a segment's value, with the Null.
+
+typedef void (*SegmentRepaint)(void);
+
+extern void segment_init(SegmentRepaint repaint);
+extern bool segment_exists(char code);
+extern void segment_refresh(const char* format);
+extern const char* segment_value(char code);
+extern void segment_free(void);
+
+#endif
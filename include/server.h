@@ -0,0 +1,32 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdint.h>
+
+#define SERVER_MAGIC      	0x31535354	// "TSS1"
+#define SERVER_MAX_REQUEST	(1 << 20) 	// Bytes of command and environment.
+
+/*
+ * A request is this header, sent with the client's Standard Input,
+ * Output and Error and its working directory as SCM_RIGHTS, followed by
+ * the command line and then the environment as Null-terminated
+ * "NAME=VALUE" strings. The reply is the exit status of the line.
+ */
+enum {SERVER_STDIN, SERVER_STDOUT, SERVER_STDERR, SERVER_CWD, SERVER_FDS};
+
+typedef struct server_request {
+	uint32_t magic;            	// SERVER_MAGIC.
+	uint32_t commandLength;    	// Bytes of the command line.
+	uint32_t environmentLength;	// Bytes of the environment.
+} server_request;
+
+typedef struct server_reply {
+	uint32_t magic;	// SERVER_MAGIC.
+	int32_t status;	// Exit status of the command line.
+} server_reply;
+
+typedef int (*ServerRunner)(char* line);
+
+extern int server_run(const char* path, ServerRunner runner);
+
+#endif
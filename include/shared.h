@@ -0,0 +1,23 @@
+#ifndef SHARED_H
+#define SHARED_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "data-structs/vector.h"
+
+#define SHARED_ALIASES      	256 	// Alias slots in the shared segment.
+#define SHARED_ALIAS_NAME   	32  	// Longest alias name, terminator included.
+#define SHARED_ALIAS_COMMAND	224 	// Longest aliased command, terminator included.
+#define SHARED_HISTORY      	1024	// Entries in the shared History ring.
+#define SHARED_LINE         	496 	// Longest line kept in the ring, terminator included.
+
+extern bool shared_init(void);
+extern bool shared_active(void);
+extern void shared_publish_aliases(Vector* names, Vector* commands);
+extern bool shared_alias(const char* name, char* command, size_t size);
+extern void shared_history_add(const char* line);
+extern void shared_history_sync(void);
+extern void shared_free(void);
+
+#endif
@@ -0,0 +1,7 @@
+#ifndef SUBSTITUTION_H
+#define SUBSTITUTION_H
+
+extern char* substitute(char* input);
+extern char* substitute_output(const char* text);
+
+#endif
@@ -1,10 +1,17 @@
 #ifndef TSH_H
 #define TSH_H
 
+#include <stdbool.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+#include "data-structs/vector.h"
+
 #define ASCII_BACKSPACE 8			// ASCII value for the Backspace character.
 #define ASCII_ESCAPE	27			// ASCII value for the Escape character.
 #define ASCII_SPACE		32 			// ASCII value for the Space character.
 #define ASCII_NEWLINE	10			// ASCII value for the Newline character.
+#define ASCII_RETURN	13			// ASCII value for the Carriage Return character.
 #define ASCII_NULL		0			// ASCII value for Null, marks the end of a string.
 #define COLOR_WHITE		"\x1b[37m"	// Colors the following text White.
 #define COLOR_CYAN		"\x1b[36m"	// Colors trailing text Cyan.
@@ -14,9 +21,18 @@
 #define COLOR_GREEN		"\x1b[32m"	// Colors trailing text Green.
 #define COLOR_RED		"\x1b[31m"	// Colors trailing text Red.
 #define COLOR_RESET		"\x1b[0m"	// Resets all Terminal SGR parameters.
+#define CLEAR_LINE		"\x1b[K"	// Erases from the cursor to the end of the line.
 #define COLOR_LENGTH	5			// The Length of the color macro strings
 #define BUFFER_SIZE		BUFSIZ/32	// New buffer size.
+#define HISTORY_FLUSH_MS	500			// Delay before new History entries are written.
 
 extern char* construct_path(char* filename);
+extern bool tsh_running(void);
+extern bool tsh_interrupted(void);
+extern int run_tokens(Vector* tokens, const bool* quoted);
+extern int run_command(char* input);
+extern int run_list(char* input);
+extern int wait_for(pid_t pid);
+extern void wait_usage(struct timeval* user, struct timeval* system);
 
 #endif
@@ -0,0 +1,55 @@
+#ifndef VM_H
+#define VM_H
+
+#include <stdbool.h>
+
+#include "data-structs/vector.h"
+#include "expansion.h"
+
+#define VM_NOT_FUNCTION	-1	// vm_call() was given something other than a function.
+#define VM_INCOMPLETE  	-2	// The source needs more lines (e.g. a missing 'fi').
+#define VM_SYNTAX_ERROR	-3	// The source could not be compiled.
+
+typedef enum opcode {
+	OP_EXEC,       	// Run command 'operand'.
+	OP_JUMP,       	// Continue at 'target'.
+	OP_JUMP_FAILED,	// Continue at 'target' if the status is non-zero.
+	OP_JUMP_PASSED,	// Continue at 'target' if the status is zero.
+	OP_SUCCEED,    	// Set the status to zero.
+	OP_FOR_INIT,   	// Expand the words of command 'operand' into a new loop.
+	OP_FOR_NEXT,   	// Assign the next word to the variable named by command 'operand', or continue at 'target'.
+	OP_FOR_POP,    	// Discard the innermost loop.
+	OP_CASE,       	// Continue at 'target' unless word 0 of command 'operand' matches one of the others.
+	OP_DEFINE,     	// Define function 'operand'.
+	OP_RETURN      	// Leave the program, with status 'operand'-1 (or the current status if 0).
+} Opcode;
+
+typedef struct instruction {
+	Opcode op;           	// What to do.
+	unsigned int operand;	// Command, function or status, depending on 'op'.
+	unsigned int target; 	// Jump destination.
+} Instruction;
+
+typedef struct command {
+	unsigned int argc;   	// Number of words.
+	ExpansionWord** argv;	// The pre-parsed words.
+} Command;
+
+typedef struct program {
+	Instruction* code;        	// The bytecode.
+	unsigned int length;      	// Number of instructions.
+	Command* commands;        	// Commands referenced by the bytecode.
+	unsigned int commandCount;	// Number of commands.
+	struct program** functions;	// Bodies of the functions defined by the bytecode.
+	char** functionNames;     	// Names of those functions.
+	unsigned int functionCount;	// Number of functions.
+	unsigned int refs;        	// Owners, including running invocations.
+} Program;
+
+extern bool vm_handles(const char* line);
+extern int vm_compile(const char* source, Program** program);
+extern int vm_execute(Program* program);
+extern void vm_free(Program* program);
+extern int vm_call(const char* name, Vector* tokens);
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <stdbool.h>
+
+#include "configuration.h"
+#include "data-structs/hash.h"
+#include "data-structs/vector.h"
+
+extern int watch_init(void);
+extern bool watch_poll(Configuration* config, HashTable* rawcmds, Vector* aliases);
+
+#endif
@@ -1,12 +1,13 @@
 // Standard: gnu99
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "allocator.h"
 #include "data-structs/hash.h"
-#include "strutil/strutil.h"
 
 #ifdef HASH_DEBUG
 	#define COLOR_MAGENTA "\x1b[35m"
@@ -14,7 +15,15 @@
 #endif
 
 #define BUCKET table->table[index] // A single bucket in the table.
-#define SPACE 32 // The ASCII value for the Space character.
+
+/*
+ * Keys are interned (see intern.h), so a bucket keeps the key's address
+ * and is found by comparing addresses rather than characters.
+ */
+typedef struct bucket {
+	const char* key;
+	char value[];
+} Bucket;
 
 /*
  * Constructs a hash table using a struct named, HashTable.
@@ -33,35 +42,43 @@ HashTable hash_init(int size) {
 	HashTable table;
 	if (size < 1) table.size = 1;
 	else table.size = size;
-	table.table = calloc(size, sizeof(void*));
+	table.table = tsh_calloc(MEM_HASH, table.size, sizeof(void*));
 	return table;
 }
 
 /*
  * This function produces the value index for a key.
- * The hash code is produced from the remainder of the sum
- * of the ASCII values of string divided by the table size.
+ * The hash code is produced from the address of the interned key.
  * Argument(s):
- *	  char* key: the look up key.
+ *	  const char* key: the look up key.
  *	  int tableSize: the size of the hash table.
  * Returns: The table index for the value associated with the given key	.
  */
-static int hash(char* key, int tableSize) {
-	unsigned int hash = 0;
-	for (unsigned int i = 0; i < strlen(key); i++)
-		hash += (hash * 19) + key[i];
-	return (hash % tableSize);
+static int hash(const char* key, int tableSize) {
+	uint64_t hash = (uintptr_t) key * 0x9E3779B97F4A7C15ULL; // Mixes the low bits, which are mostly alignment
+	return ((hash >> 32) % tableSize);
+}
+
+/*
+ * Checks whether a bucket holds the given key.
+ * Argument(s):
+ *	  void* bucket: the bucket.
+ *	  const char* key: the interned key being searched for.
+ * Returns: true if the bucket belongs to 'key'.
+ */
+static inline bool bucket_matches(void* bucket, const char* key) {
+	return ((Bucket*) bucket)->key == key;
 }
 
 /*
  * Looks up the value associated with the given key.
  * Argument(s):
  *	  HashTable* table: struct pointer to the table.
- *	  char* key: the key that is used to find a value stored in the table.
+ *	  const char* key: the interned key that is used to find a value stored in the table.
  * Returns: The value associated with the given key.
  * 	  		(GenType is included from the header file, 'HashTable.h')
  */
-void* hash_lookUp(HashTable* table, char* key) {
+void* hash_lookUp(HashTable* table, const char* key) {
 	#ifdef HASH_DEBUG
 		printf(COLOR_MAGENTA "HASH: LOOKUP: Looking up \"%s\"\n" COLOR_RESET, key);
 	#endif
@@ -72,19 +89,13 @@ void* hash_lookUp(HashTable* table, char* key) {
 		                                        in the table are checked. */
 		if (BUCKET != NULL) { // If there is something in this bucket
 			#ifdef HASH_DEBUG
-				printf(COLOR_MAGENTA "HASH: LOOKUP: > %s\n" COLOR_RESET, (char*) BUCKET);
+				printf(COLOR_MAGENTA "HASH: LOOKUP: > %s\n" COLOR_RESET, ((Bucket*) BUCKET)->key);
 			#endif
-			char* buffer = strutil_substring((char*) BUCKET, 0, strutil_indexOf((char*) BUCKET, SPACE));
-			char bucketKey[strlen(buffer)];
-			for (unsigned int i = 0; i < strlen(buffer); i++)
-				bucketKey[i] = buffer[i]; // Collecting the bucket key
-			bucketKey[strlen(buffer)] = 0;
-			free(buffer);
-			if (!strcmp(key, bucketKey)) {// If the given key matches the key in the bucket.
+			if (bucket_matches(BUCKET, key)) {// If the given key matches the key in the bucket.
 				#ifdef HASH_DEBUG
-					printf(COLOR_MAGENTA "HASH: LOOKUP: Found \"%s\"\n" COLOR_RESET, (char*) BUCKET);
+					printf(COLOR_MAGENTA "HASH: LOOKUP: Found \"%s\"\n" COLOR_RESET, key);
 				#endif
-				return BUCKET;
+				return ((Bucket*) BUCKET)->value;
 			}
 		}
 		index++;
@@ -100,43 +111,44 @@ void* hash_lookUp(HashTable* table, char* key) {
  * Associates a string (key) to another (value).
  * Argument(s):
  *	  HashTable* table: struct pointer to the table.
- *	  char* key: the string to be associated with another string.
+ *	  const char* key: the interned string to be associated with another string.
  *	  char* value: the string to be stored in the table.
- * Returns: The index at which the value is stored.
+ * Returns: The index at which the value is stored, or -1 if the table is full.
  */
-int hash_map(HashTable* table, char* key, char* value) {
+int hash_map(HashTable* table, const char* key, char* value) {
 	#ifdef HASH_DEBUG
 		printf(COLOR_MAGENTA "HASH: MAP: Attempting to map \"%s\" to \"%s\"\n" COLOR_RESET, key, value);
 	#endif
 	unsigned int index = hash(key, table->size);
-	char* buffer = calloc(strlen(value)+1, sizeof(char));
-	strcpy(buffer, value);
+	Bucket* buffer = tsh_calloc(MEM_HASH, 1, sizeof(Bucket)+strlen(value)+1);
+	buffer->key = key;
+	strcpy(buffer->value, value);
+	int empty = -1; // First free bucket seen, used if the key is not already mapped
 	unsigned int iterations = 0;
 	while (iterations < table->size) {
 		if (index == table->size) index = 0;
 		if (BUCKET == NULL) { // If there is nothing in this bucket
+			if (empty == -1) empty = index;
+		} else if (bucket_matches(BUCKET, key)) { // If the given key matches the key in the bucket.
 			#ifdef HASH_DEBUG
 				printf(COLOR_MAGENTA "HASH: MAP: \"%s\" mapped to \"%s\" in bucket %d\n" COLOR_RESET, key, value, index);
 			#endif
+			tsh_free(BUCKET);
 			BUCKET = buffer;
 			return index;
-		} else {
-			char* bucketKey = strutil_substring((char*) BUCKET, 0, strlen(key));
-			if (!strcmp(key, bucketKey)) { // If the given key matches the key in the bucket.
-				#ifdef HASH_DEBUG
-					printf(COLOR_MAGENTA "HASH: MAP: \"%s\" mapped to \"%s\" in bucket %d\n" COLOR_RESET, key, value, index);
-				#endif
-				free(bucketKey);
-				free(BUCKET);
-				BUCKET = buffer;
-				return index;
-			}
-			free(bucketKey);
-			index++;
 		}
+		index++;
 		iterations++;
 	}
-	return -1;
+	if (empty == -1) {
+		tsh_free(buffer);
+		return -1;
+	}
+	#ifdef HASH_DEBUG
+		printf(COLOR_MAGENTA "HASH: MAP: \"%s\" mapped to \"%s\" in bucket %d\n" COLOR_RESET, key, value, empty);
+	#endif
+	table->table[empty] = buffer;
+	return empty;
 }
 
 /*
@@ -144,9 +156,9 @@ int hash_map(HashTable* table, char* key, char* value) {
  * in the table, then deletes that same value from the table.
  * Argument(s):
  *	  HashTable* table: struct pointer to the table.
- *	  char* key: the key that is used to find a value stored in the table.
+ *	  const char* key: the interned key that is used to find a value stored in the table.
  */
-void hash_unmap(HashTable* table, char* key) {
+void hash_unmap(HashTable* table, const char* key) {
 	#ifdef HASH_DEBUG
 		printf(COLOR_MAGENTA "HASH: UNMAP: Attempting to unmap \"%s\"\n" COLOR_RESET, key);
 	#endif
@@ -154,30 +166,39 @@ void hash_unmap(HashTable* table, char* key) {
 	unsigned int iterations = 0;
 	while (iterations < table->size) {
 		if (index == table->size) index = 0;
-		if (BUCKET != NULL) { // If there is something in this bucket
-			char* buffer = strutil_substring((char*) BUCKET, 0, strlen(key));
-			char bucketKey[strlen(buffer)];
-			for (unsigned int i = 0; i < strlen(buffer); i++) {
-				bucketKey[i] = buffer[i]; // Collecting the bucket key
-				#ifdef HASH_DEBUG
-					printf(COLOR_MAGENTA "HASH: UNMAP: %d\n" COLOR_RESET, buffer[i]);
-				#endif
-			}
-			bucketKey[strlen(buffer)] = 0;
+		if (BUCKET != NULL && bucket_matches(BUCKET, key)) { // If the given key matches the key in the bucket.
 			#ifdef HASH_DEBUG
-				printf(COLOR_MAGENTA "HASH: UNMAP: bucketKey: %s\n" COLOR_RESET, bucketKey);
+				printf(COLOR_MAGENTA "HASH: UNMAP: Unmapped \"%s\" from bucket %d\n" COLOR_RESET, key, index);
 			#endif
-			free(buffer);
-			if (!strcmp(key, bucketKey)) { // If the given key matches the key in the bucket.
-				#ifdef HASH_DEBUG
-					printf(COLOR_MAGENTA "HASH: UNMAP: Unmapped \"%s\" from bucket %d\n" COLOR_RESET, key, index);
-				#endif
-				free(BUCKET);
-				BUCKET = NULL;
-				break;
-			}
+			tsh_free(BUCKET);
+			BUCKET = NULL;
+			break;
 		}
 		index++;
 		iterations++;
 	}
 }
+
+/*
+ * Changes the number of buckets in the table, moving every
+ * mapping into its new bucket.
+ * Argument(s):
+ *	  HashTable* table: struct pointer to the table.
+ *	  int size: the new number of buckets (at least the number in use).
+ */
+void hash_resize(HashTable* table, int size) {
+	#ifdef HASH_DEBUG
+		printf(COLOR_MAGENTA "HASH: RESIZE: %u to %d buckets\n" COLOR_RESET, table->size, size);
+	#endif
+	HashTable resized = hash_init(size);
+	for (unsigned int i = 0; i < table->size; i++) {
+		Bucket* bucket = (Bucket*) table->table[i];
+		if (bucket == NULL) continue;
+		unsigned int index = hash(bucket->key, resized.size);
+		while (resized.table[index] != NULL)
+			if (++index == resized.size) index = 0;
+		resized.table[index] = bucket;
+	}
+	tsh_free(table->table);
+	*table = resized;
+}
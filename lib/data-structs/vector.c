@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "allocator.h"
 #include "data-structs/vector.h"
 
 #ifdef VECTOR_DEBUG
@@ -25,7 +26,7 @@
  */
 Vector vector_init(int size) {
 	Vector list;
-	list.array = calloc(size, sizeof(void*));
+	list.array = tsh_calloc(MEM_VECTOR, size, sizeof(void*));
 	list.size = size;
 	return list;
 }
@@ -37,7 +38,7 @@ Vector vector_init(int size) {
  */
 void vector_empty(Vector* list) {
 	list->size = 0;
-	free(list->array);
+	tsh_free(list->array);
 	list->array = NULL;
 }
 
@@ -78,7 +79,7 @@ void vector_add(Vector* list, unsigned int index, void* value) {
 		printf(COLOR_CYAN "VECTOR: ADD: Adding value to index %d\n" COLOR_RESET, index);
 	#endif
 	list->size += 1;
-	void** tmp = calloc(list->size, sizeof(void*));
+	void** tmp = tsh_calloc(MEM_VECTOR, list->size, sizeof(void*));
 	unsigned int i = 0;
 	unsigned int o = 0;
 	while (i < list->size) {
@@ -88,7 +89,7 @@ void vector_add(Vector* list, unsigned int index, void* value) {
 		} else tmp[i] = vector_get(list, i-o);
 		i++;
 	}
-	free(list->array);
+	tsh_free(list->array);
 	list->array = NULL;
 	list->array = tmp;
 }
@@ -104,7 +105,7 @@ void vector_delete(Vector* list, unsigned int index) {
 		printf(COLOR_CYAN "VECTOR: DELETE: Deleting value at index %d\n" COLOR_RESET, index);
 	#endif
 	list->size -= 1;
-	void** tmp = calloc(list->size, sizeof(void*));
+	void** tmp = tsh_calloc(MEM_VECTOR, list->size, sizeof(void*));
 	unsigned int i = 0;
 	unsigned int o = 0;
 	while (i < list->size) {
@@ -115,7 +116,7 @@ void vector_delete(Vector* list, unsigned int index) {
 		tmp[i] = vector_get(list, i+o);
 		i++;
 	}
-	free(list->array);
+	tsh_free(list->array);
 	list->array = NULL;
 	list->array = tmp;
 }
@@ -4,6 +4,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "allocator.h"
 #include "strutil/strutil.h"
 
 #ifdef STRUTIL_DEBUG
@@ -85,7 +86,7 @@ int* strutil_indexesOf(char* string, char character, unsigned int *amount) {
 			(*amount)++;
 		}
 	}
-	int* indexes = calloc(*amount, sizeof(int));
+	int* indexes = tsh_calloc(MEM_STRUTIL, *amount, sizeof(int));
 	for (size_t i = 0; i < (*amount); i++)
 		indexes[i] = buff[i];
 	return indexes;
@@ -106,7 +107,7 @@ char* strutil_removeThese(char* string, char* chars) {
 	#ifdef STRUTIL_DEBUG
 		printf(COLOR_YELLOW "STRUTIL: REMOVE_THESE: Attempting to remove characters \"%s\" from \"%s\"\n" COLOR_RESET, chars, string);
 	#endif
-	char* shortened = calloc(strlen(string) - strlen(chars) + 1, sizeof(char));
+	char* shortened = tsh_calloc(MEM_STRUTIL, strlen(string) - strlen(chars) + 1, sizeof(char));
 	size_t index = 0;
 	for (size_t i = 0; i < strlen(string); i++) {
 		for (size_t j = 0; j < strlen(chars); j++) {
@@ -142,7 +143,7 @@ void strutil_replaceAll(char* string, char old, char new) {
 	int* indexes = strutil_indexesOf(string, old, &amount);
 	for (size_t i = 0; i < amount; i++)
 		string[indexes[i]] = new;
-	free(indexes);
+	tsh_free(indexes);
 }
 
 /*
@@ -159,13 +160,13 @@ char** strutil_split(char* string, const char* delimiter, unsigned int *tokenAmo
 	#ifdef STRUTIL_DEBUG
 		printf(COLOR_YELLOW "STRUTIL: SPLIT_STRING: Spliting \"%s\" at every occurence of \"%s\"\n" COLOR_RESET, string, delimiter);
 	#endif
-	char** tokens = calloc(1, sizeof(char*));
+	char** tokens = tsh_calloc(MEM_STRUTIL, 1, sizeof(char*));
 	char* tok = strtok(string, delimiter);
 	for (size_t i = 0; tok != NULL; i++) {
 		tokens[i] = tok;
 		(*tokenAmount)++;
 		tok = strtok(NULL, delimiter);
-		if (tok != NULL) tokens = realloc(tokens, ((*tokenAmount)+1) * sizeof(char*));
+		if (tok != NULL) tokens = tsh_realloc(MEM_STRUTIL, tokens, ((*tokenAmount)+1) * sizeof(char*));
 	}
 	return tokens;
 }
@@ -184,7 +185,7 @@ char* strutil_substring(char* original, int start, int end) {
 	#ifdef STRUTIL_DEBUG
 		printf(COLOR_YELLOW "STRUTIL: SUBSTRING: Retrieving substring of \"%s\" from %d to %d\n" COLOR_RESET, original, start, end);
 	#endif
-	char* substring = calloc((end-start)+1, sizeof(char));
+	char* substring = tsh_calloc(MEM_STRUTIL, (end-start)+1, sizeof(char));
 	strncpy(substring, original+start, end-start);
 	#ifdef STRUTIL_DEBUG
 		printf(COLOR_YELLOW "STRUTIL: SUBSTRING: Substring of \"%s\" from %d to %d is \"%s\"\n" COLOR_RESET, original, start, end, substring);
@@ -209,7 +210,7 @@ char* strutil_trim(char* original) {
 	int start = i;
 	for (i = strlen(original)-1; original[i] == ASCII_SPACE; i--);
 	int end = i;
-	char* new = calloc(end-start+2, sizeof(char));
+	char* new = tsh_calloc(MEM_STRUTIL, end-start+2, sizeof(char));
 	strncpy(new, original+start, end-start+1);
 	return new;
 }
@@ -1,10 +1,14 @@
 // Standard: gnu99
 
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "allocator.h"
 #include "data-structs/hash.h"
+#include "intern.h"
+#include "shared.h"
 #include "strutil/strutil.h"
 #include "tsh.h"
 #include "data-structs/vector.h"
@@ -25,7 +29,7 @@ static Vector alias_read(void) {
 		unsigned int i = 0;
 		while (fgets(line, BUFFER_SIZE, file) != NULL) // While there is something to be read
 			if (strchr(line, '#') == NULL && strlen(line) != 1) { // Ignores comments and empty lines
-				char* modLine = calloc(strlen(line), sizeof(char)); // Line buffer
+				char* modLine = tsh_calloc(MEM_ALIAS, strlen(line), sizeof(char)); // Line buffer
 				memcpy(modLine, line, strlen(line)-1);
 				modLine[strlen(line)-1] = ASCII_NULL;
 				vector_add(&contents, i, modLine); // Add line to list of contents
@@ -33,31 +37,106 @@ static Vector alias_read(void) {
 			}
 		fclose(file);
 	}
-	free(filePath);
+	tsh_free(filePath);
 	return contents;
 }
 
+/*
+ * Splits a line of the alias file into the alias and the real command.
+ * Argument(s):
+ *   char* line: a line of the form "ALIAS = 'COMMAND'".
+ *   const char** alias: where the interned alias is stored.
+ *   char** rawcmd: where the real command is stored.
+ * Memory Management:
+ *   Free the real command when done.
+ */
+static void alias_parse(char* line, const char** alias, char** rawcmd) {
+	char* name = strutil_substring(line, 0, strutil_indexOf(line, ASCII_SPACE)); // The command alias (KEY)
+	*alias = intern(name); // Compared by address from here on
+	tsh_free(name);
+	*rawcmd = strutil_substring(line, strutil_indexOf(line, '\'')+1, strlen(line)-1); // The real command being run (VALUE)
+}
+
 void alias_init(HashTable* rawcmds, Vector* aliases) {
 	Vector lines = alias_read();
 	*aliases = vector_init(lines.size); // Initializes an Array of Aliases
 	*rawcmds = hash_init(lines.size); // Initializes a Hash Table of actual commands
 	for (unsigned int i = 0; i < lines.size; i++) {
 		char* line = (char*) vector_get(&lines, i); // A line in the file
-		char* alias = strutil_substring(line, 0, strutil_indexOf(line, ASCII_SPACE)); // The command alias (KEY)
-		char* rawcmd = strutil_substring(line, strutil_indexOf(line, '\'')+1, strlen(line)-1); // The real command being run (VALUE)
-		vector_set(aliases, i, alias);
+		const char* alias;
+		char* rawcmd;
+		alias_parse(line, &alias, &rawcmd);
+		vector_set(aliases, i, (char*) alias);
 		hash_map(rawcmds, alias, rawcmd);
-		free(rawcmd);
-		free(line);
+		tsh_free(rawcmd);
+		tsh_free(line);
+	}
+	tsh_free(lines.array);
+}
+
+/*
+ * Re-reads the alias file and applies only what changed: removed aliases
+ * are unmapped, changed ones remapped and new ones added.
+ * Argument(s):
+ *   HashTable* rawcmds: the aliases mapped to their real commands.
+ *   Vector* aliases: the aliased command names.
+ */
+void alias_reload(HashTable* rawcmds, Vector* aliases) {
+	Vector lines = alias_read();
+	Vector fresh = vector_init(lines.size); // Aliases still in the file
+	for (unsigned int i = 0; i < lines.size; i++) {
+		char* rawcmd;
+		alias_parse((char*) vector_get(&lines, i), (const char**) &fresh.array[i], &rawcmd);
+		tsh_free(vector_get(&lines, i));
+		vector_set(&lines, i, rawcmd);
+	}
+	for (unsigned int i = aliases->size; i-- > 0; ) { // Removed aliases
+		char* alias = (char*) vector_get(aliases, i);
+		bool kept = false;
+		for (unsigned int j = 0; j < fresh.size && !kept; j++)
+			kept = alias == vector_get(&fresh, j); // Both interned
+		if (!kept) {
+			hash_unmap(rawcmds, alias);
+			vector_delete(aliases, i);
+		}
+	}
+	for (unsigned int i = 0; i < fresh.size; i++) { // New and changed aliases
+		char* alias = (char*) vector_get(&fresh, i);
+		char* rawcmd = (char*) vector_get(&lines, i);
+		char* current = (char*) hash_lookUp(rawcmds, alias);
+		if (current == NULL) {
+			if (aliases->size >= rawcmds->size) hash_resize(rawcmds, rawcmds->size*2);
+			vector_add(aliases, aliases->size, alias);
+			hash_map(rawcmds, alias, rawcmd);
+		} else if (strcmp(current, rawcmd)) hash_map(rawcmds, alias, rawcmd);
+		tsh_free(rawcmd);
 	}
-	free(lines.array);
+	tsh_free(fresh.array);
+	tsh_free(lines.array);
+}
+
+/*
+ * Reads the alias file into the segment shared by every session.
+ */
+void alias_share(void) {
+	Vector lines = alias_read();
+	Vector names = vector_init(lines.size);
+	Vector rawcmds = vector_init(lines.size);
+	for (unsigned int i = 0; i < lines.size; i++) {
+		alias_parse((char*) vector_get(&lines, i), (const char**) &names.array[i], (char**) &rawcmds.array[i]);
+		tsh_free(vector_get(&lines, i));
+	}
+	shared_publish_aliases(&names, &rawcmds);
+	for (unsigned int i = 0; i < rawcmds.size; i++)
+		tsh_free(vector_get(&rawcmds, i));
+	tsh_free(rawcmds.array);
+	tsh_free(names.array);
+	tsh_free(lines.array);
 }
 
 void alias_free(HashTable* rawcmds, Vector* aliases) {
-	for (unsigned int i = 0; i < aliases->size; i++) {
+	for (unsigned int i = 0; i < aliases->size; i++)
 		hash_unmap(rawcmds, (char*) vector_get(aliases, i)); // Deletes a Bucket
-		free(vector_get(aliases, i));
-	}
-	free(aliases->array);
-	free(rawcmds->table);
+	tsh_free(aliases->array);
+	tsh_free(rawcmds->table);
 }
@@ -0,0 +1,124 @@
+// Standard: gnu99
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "allocator.h"
+#include "tsh.h"
+
+typedef union allocation_header {
+	struct {
+		size_t size;     	// Bytes requested by the caller.
+		Subsystem owner; 	// Subsystem that made the allocation.
+	} info;
+	long double alignment;	// Keeps the caller's memory suitably aligned.
+} header;
+
+typedef struct subsystem_usage {
+	size_t live;       	// Bytes currently allocated.
+	size_t peak;       	// Most bytes ever allocated at once.
+	size_t allocations;	// Number of allocations ever made.
+	size_t blocks;     	// Number of allocations still live.
+} usage;
+
+static usage usages[MEM_SUBSYSTEMS + 1]; // The last entry holds the totals.
+
+static const char* names[MEM_SUBSYSTEMS] = {
+	"hash", "vector", "strutil", "alias", "prompt", "parser", "intern", "editor", "shell"
+};
+
+/*
+ * Records 'size' new bytes against a subsystem and the totals.
+ * Argument(s):
+ *   Subsystem owner: the subsystem being charged.
+ *   size_t size: the number of bytes.
+ */
+static void account(Subsystem owner, size_t size) {
+	usage* charged[2] = {&usages[owner], &usages[MEM_SUBSYSTEMS]};
+	for (int i = 0; i < 2; i++) {
+		charged[i]->live += size;
+		charged[i]->blocks++;
+		charged[i]->allocations++;
+		if (charged[i]->live > charged[i]->peak) charged[i]->peak = charged[i]->live;
+	}
+}
+
+/*
+ * Releases 'size' bytes from a subsystem and the totals.
+ * Argument(s):
+ *   Subsystem owner: the subsystem being credited.
+ *   size_t size: the number of bytes.
+ */
+static void release(Subsystem owner, size_t size) {
+	usages[owner].live -= size;
+	usages[owner].blocks--;
+	usages[MEM_SUBSYSTEMS].live -= size;
+	usages[MEM_SUBSYSTEMS].blocks--;
+}
+
+/*
+ * Allocates zeroed memory on behalf of a subsystem.
+ * Argument(s):
+ *   Subsystem owner: the subsystem making the allocation.
+ *   size_t amount: the number of elements.
+ *   size_t size: the size of each element.
+ * Memory Management:
+ *   Free the returned pointer with tsh_free() when done.
+ * Returns: the allocated memory, or NULL if out of memory.
+ */
+void* tsh_calloc(Subsystem owner, size_t amount, size_t size) {
+	size_t bytes = amount * size;
+	header* block = calloc(1, sizeof(header) + bytes);
+	if (block == NULL) return NULL;
+	block->info.size = bytes;
+	block->info.owner = owner;
+	account(owner, bytes);
+	return block+1;
+}
+
+/*
+ * Resizes memory allocated by tsh_calloc() or tsh_realloc(). The memory
+ * stays charged to the subsystem that first allocated it.
+ * Argument(s):
+ *   Subsystem owner: the subsystem making the allocation, if 'pointer' is NULL.
+ *   void* pointer: the memory to resize, or NULL.
+ *   size_t size: the new size in bytes.
+ * Memory Management:
+ *   Free the returned pointer with tsh_free() when done.
+ * Returns: the resized memory, or NULL if out of memory.
+ */
+void* tsh_realloc(Subsystem owner, void* pointer, size_t size) {
+	if (pointer == NULL) return tsh_calloc(owner, 1, size);
+	header* block = (header*) pointer - 1;
+	header* resized = realloc(block, sizeof(header) + size);
+	if (resized == NULL) return NULL;
+	release(resized->info.owner, resized->info.size);
+	account(resized->info.owner, size);
+	usages[resized->info.owner].allocations--; // A resize is not a new allocation
+	usages[MEM_SUBSYSTEMS].allocations--;
+	resized->info.size = size;
+	return resized+1;
+}
+
+/*
+ * Frees memory allocated by tsh_calloc() or tsh_realloc().
+ * Argument(s):
+ *   void* pointer: the memory to free, or NULL.
+ */
+void tsh_free(void* pointer) {
+	if (pointer == NULL) return;
+	header* block = (header*) pointer - 1;
+	release(block->info.owner, block->info.size);
+	free(block);
+}
+
+/*
+ * Prints the memory usage of each subsystem (the 'mem' builtin).
+ */
+void mem_report(void) {
+	printf("%-10s %12s %12s %12s %12s\n", "SUBSYSTEM", "LIVE", "PEAK", "BLOCKS", "ALLOCATIONS");
+	for (int i = 0; i <= MEM_SUBSYSTEMS; i++)
+		printf("%-10s %12zu %12zu %12zu %12zu\n", i < MEM_SUBSYSTEMS ? names[i] : "total",
+		       usages[i].live, usages[i].peak, usages[i].blocks, usages[i].allocations);
+}
@@ -0,0 +1,131 @@
+// Standard: gnu99
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "allocator.h"
+#include "audit.h"
+#include "tsh.h"
+
+#define NO_POSITION	UINT64_MAX
+
+static audit_header* journal = NULL;  	// The mapped log, NULL unless auditing.
+static pid_t pid = 0;                 	// This shell, looked up once.
+static char* cwd = NULL;              	// The working directory, looked up after each change.
+static uint64_t cwdPosition = NO_POSITION;	// Where 'cwd' was last put in the pool.
+static struct timespec started;       	// When the current command started, wall clock.
+static struct timespec startedMonotonic;	// and monotonic.
+
+/*
+ * Maps '~/.tsh-audit', creating or resetting it if it is not a log of
+ * the current layout. Called once, when AUDIT=ON.
+ */
+void audit_init(void) {
+	size_t size = AUDIT_SIZE(AUDIT_RECORDS, AUDIT_POOL);
+	char* path = construct_path(".tsh-audit");
+	int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	tsh_free(path);
+	if (fd == -1) return;
+	flock(fd, LOCK_EX); // Other sessions may be starting too
+	struct stat info;
+	bool sized = !fstat(fd, &info) && (size_t) info.st_size == size;
+	if (!sized && (ftruncate(fd, 0) || ftruncate(fd, size))) {
+		flock(fd, LOCK_UN);
+		close(fd);
+		return;
+	}
+	void* mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (mapping != MAP_FAILED) {
+		journal = mapping;
+		if (journal->magic != AUDIT_MAGIC || journal->records != AUDIT_RECORDS || journal->poolSize != AUDIT_POOL) {
+			memset(journal, 0, size); // New, or not something we wrote
+			journal->magic = AUDIT_MAGIC;
+			journal->records = AUDIT_RECORDS;
+			journal->poolSize = AUDIT_POOL;
+		}
+	}
+	flock(fd, LOCK_UN);
+	close(fd); // The mapping stays
+	pid = getpid();
+	audit_moved();
+}
+
+/*
+ * Notes that the working directory changed, so the next record looks it up.
+ */
+void audit_moved(void) {
+	if (journal == NULL) return;
+	free(cwd); // From getcwd(), not the tsh allocator
+	cwd = getcwd(NULL, 0);
+	cwdPosition = NO_POSITION;
+}
+
+/*
+ * Marks the start of a command. Reads only the vDSO clocks.
+ */
+void audit_start(void) {
+	if (journal == NULL) return;
+	clock_gettime(CLOCK_REALTIME, &started);
+	clock_gettime(CLOCK_MONOTONIC, &startedMonotonic);
+}
+
+/*
+ * Appends text to the string pool. Sessions reserve their space with
+ * one atomic add, so they never need a lock.
+ * Returns:
+ *   The position of the text.
+ */
+static uint64_t store(const char* text, uint32_t length) {
+	uint64_t position = __atomic_fetch_add(&journal->poolNext, length, __ATOMIC_RELAXED);
+	size_t start = position % journal->poolSize;
+	size_t first = length < journal->poolSize - start ? length : journal->poolSize - start;
+	memcpy(AUDIT_TEXT(journal) + start, text, first);
+	memcpy(AUDIT_TEXT(journal), text + first, length - first); // Wraps around
+	return position;
+}
+
+/*
+ * Records a finished command. Only writes to the mapping: no system
+ * calls unless the directory changed since the last command.
+ * Argument(s):
+ *   const char* command: the command line, as typed.
+ *   int status: its exit status.
+ */
+void audit_finish(const char* command, int status) {
+	if (journal == NULL) return;
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	size_t commandLength = strnlen(command, AUDIT_COMMAND_MAX);
+	uint32_t cwdLength = cwd == NULL ? 0 : strlen(cwd);
+	uint64_t poolNext = __atomic_load_n(&journal->poolNext, __ATOMIC_RELAXED);
+	if (cwdPosition == NO_POSITION || poolNext - cwdPosition > journal->poolSize / 2) // Reused while it is recent
+		cwdPosition = store(cwd == NULL ? "" : cwd, cwdLength);
+	uint64_t index = __atomic_fetch_add(&journal->next, 1, __ATOMIC_RELAXED);
+	audit_record* record = &AUDIT_RING(journal)[index % journal->records];
+	__atomic_store_n(&record->sequence, 0, __ATOMIC_RELAXED); // Readers skip it until it is whole
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	record->started = started.tv_sec * 1000000000LL + started.tv_nsec;
+	record->duration = (now.tv_sec - startedMonotonic.tv_sec) * 1000000000LL + now.tv_nsec - startedMonotonic.tv_nsec;
+	record->command = store(command, commandLength);
+	record->commandLength = commandLength;
+	record->cwd = cwdPosition;
+	record->cwdLength = cwdLength;
+	record->status = status;
+	record->pid = pid;
+	__atomic_store_n(&record->sequence, index + 1, __ATOMIC_RELEASE);
+}
+
+void audit_free(void) {
+	if (journal != NULL) munmap(journal, AUDIT_SIZE(journal->records, journal->poolSize));
+	journal = NULL;
+	free(cwd);
+	cwd = NULL;
+}
@@ -0,0 +1,257 @@
+// Standard: gnu99
+
+#include <fcntl.h>
+#include <math.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "allocator.h"
+#include "bench.h"
+#include "tsh.h"
+#include "data-structs/vector.h"
+
+typedef enum metric {
+	METRIC_WALL,
+	METRIC_USER,
+	METRIC_SYSTEM,
+	METRIC_COUNT
+} Metric;
+
+static const char* metricNames[METRIC_COUNT] = {"wall", "user", "sys"};
+
+typedef struct summary {
+	double mean, stddev, min, p50, p90, p99, max;	// Nanoseconds.
+} summary;
+
+typedef struct options {
+	long runs;
+	long warmup;
+	bool verbose;     	// Leave the command's output on the terminal.
+	const char* csv;  	// Per-run samples go here, if set.
+	const char* json; 	// and the summary with them here.
+	unsigned int first;	// Index of the command in the tokens.
+} options;
+
+static uint64_t nanoseconds(struct timeval time) {
+	return time.tv_sec * 1000000000ULL + time.tv_usec * 1000ULL;
+}
+
+static int by_value(const void* a, const void* b) {
+	uint64_t x = *(const uint64_t*) a, y = *(const uint64_t*) b;
+	return (x > y) - (x < y);
+}
+
+/*
+ * Computes the statistics of one metric over every run.
+ */
+static summary summarize(uint64_t* samples, long count) {
+	uint64_t* sorted = tsh_calloc(MEM_SHELL, count, sizeof(uint64_t)); // -n can be too many for the stack
+	memcpy(sorted, samples, count * sizeof(uint64_t));
+	qsort(sorted, count, sizeof(uint64_t), by_value);
+	summary s = {0};
+	for (long i = 0; i < count; i++) s.mean += sorted[i];
+	s.mean /= count;
+	for (long i = 0; i < count; i++) s.stddev += (sorted[i] - s.mean) * (sorted[i] - s.mean);
+	s.stddev = count > 1 ? sqrt(s.stddev / (count-1)) : 0;
+	s.min = sorted[0];
+	s.max = sorted[count-1];
+	s.p50 = sorted[(50 * count + 99) / 100 - 1]; // Nearest rank
+	s.p90 = sorted[(90 * count + 99) / 100 - 1];
+	s.p99 = sorted[(99 * count + 99) / 100 - 1];
+	tsh_free(sorted);
+	return s;
+}
+
+/*
+ * Writes a duration in the unit that suits it, e.g. "12.3ms".
+ */
+static const char* format(double ns, char* out, size_t size) {
+	if (ns >= 1e9) snprintf(out, size, "%.3fs", ns / 1e9);
+	else if (ns >= 1e6) snprintf(out, size, "%.2fms", ns / 1e6);
+	else snprintf(out, size, "%.1fus", ns / 1e3);
+	return out;
+}
+
+static bool parse_count(const char* text, long* count, long minimum) {
+	char* end;
+	*count = strtol(text, &end, 10);
+	return *end == ASCII_NULL && end != text && *count >= minimum;
+}
+
+/*
+ * Reads the options before the command.
+ * Returns:
+ *   false, after printing why, if they make no sense.
+ */
+static bool parse_options(Vector* tokens, options* o) {
+	*o = (options) {BENCH_DEFAULT_RUNS, 0, false, NULL, NULL, 1};
+	for (; o->first < tokens->size; o->first++) {
+		const char* option = vector_get(tokens, o->first);
+		if (option[0] != '-') break;
+		bool takesValue = !strcmp(option, "-n") || !strcmp(option, "-w") || !strcmp(option, "-c") || !strcmp(option, "-j");
+		if (!strcmp(option, "-v")) o->verbose = true;
+		else if (!takesValue || o->first+1 >= tokens->size) {
+			fprintf(stderr, COLOR_RED "T-Shell: bench: Usage: bench [-n N] [-w WARMUP] [-v] [-c FILE.csv] [-j FILE.json] command\n" COLOR_RESET);
+			return false;
+		} else {
+			const char* value = vector_get(tokens, ++o->first);
+			if ((!strcmp(option, "-n") && !parse_count(value, &o->runs, 1)) ||
+			    (!strcmp(option, "-w") && !parse_count(value, &o->warmup, 0))) {
+				fprintf(stderr, COLOR_RED "T-Shell: bench: %s: Not a valid count.\n" COLOR_RESET, value);
+				return false;
+			}
+			if (!strcmp(option, "-c")) o->csv = value;
+			else if (!strcmp(option, "-j")) o->json = value;
+		}
+	}
+	if (o->first >= tokens->size) {
+		fprintf(stderr, COLOR_RED "T-Shell: bench: Missing command.\n" COLOR_RESET);
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Runs the command once through the usual spawn path.
+ * Argument(s):
+ *   uint64_t* sample: receives the wall, user and system time.
+ * Returns:
+ *   The exit status of the command.
+ */
+static int run_once(Vector* tokens, const bool* quoted, unsigned int first, uint64_t sample[METRIC_COUNT]) {
+	Vector command = vector_init(0); // run_tokens() may rearrange it, so each run gets its own
+	for (unsigned int i = first; i < tokens->size; i++)
+		vector_add(&command, command.size, vector_get(tokens, i));
+	struct timeval userBefore, systemBefore, userAfter, systemAfter;
+	struct timespec start, end;
+	wait_usage(&userBefore, &systemBefore);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	int status = run_tokens(&command, quoted == NULL ? NULL : quoted+first);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	wait_usage(&userAfter, &systemAfter);
+	tsh_free(command.array);
+	sample[METRIC_WALL] = (end.tv_sec - start.tv_sec) * 1000000000ULL + end.tv_nsec - start.tv_nsec;
+	sample[METRIC_USER] = nanoseconds(userAfter) - nanoseconds(userBefore);
+	sample[METRIC_SYSTEM] = nanoseconds(systemAfter) - nanoseconds(systemBefore);
+	return status;
+}
+
+static void write_csv(const char* path, uint64_t* samples[METRIC_COUNT], int* statuses, long runs) {
+	FILE* file = fopen(path, "w");
+	if (file == NULL) {
+		fprintf(stderr, COLOR_RED "T-Shell: bench: %s: Cannot write.\n" COLOR_RESET, path);
+		return;
+	}
+	fputs("run,wall_ns,user_ns,sys_ns,status\n", file);
+	for (long i = 0; i < runs; i++)
+		fprintf(file, "%ld,%llu,%llu,%llu,%d\n", i+1, (unsigned long long) samples[METRIC_WALL][i],
+		        (unsigned long long) samples[METRIC_USER][i], (unsigned long long) samples[METRIC_SYSTEM][i], statuses[i]);
+	fclose(file);
+}
+
+static void write_json(const char* path, const char* command, options* o, summary* summaries,
+                       uint64_t* samples[METRIC_COUNT], int* statuses, long runs) {
+	FILE* file = fopen(path, "w");
+	if (file == NULL) {
+		fprintf(stderr, COLOR_RED "T-Shell: bench: %s: Cannot write.\n" COLOR_RESET, path);
+		return;
+	}
+	fputs("{\n  \"command\": \"", file);
+	for (const char* c = command; *c != ASCII_NULL; c++) {
+		if (*c == '"' || *c == '\\') fputc('\\', file);
+		if ((unsigned char) *c < 0x20) fprintf(file, "\\u%04x", *c);
+		else fputc(*c, file);
+	}
+	fprintf(file, "\",\n  \"runs\": %ld,\n  \"warmup\": %ld,\n  \"unit\": \"ns\",\n", runs, o->warmup);
+	for (int m = 0; m < METRIC_COUNT; m++) {
+		summary* s = &summaries[m];
+		fprintf(file, "  \"%s\": {\"mean\": %.0f, \"stddev\": %.0f, \"min\": %.0f, \"p50\": %.0f, \"p90\": %.0f, "
+		        "\"p99\": %.0f, \"max\": %.0f},\n", metricNames[m], s->mean, s->stddev, s->min, s->p50, s->p90, s->p99, s->max);
+	}
+	fputs("  \"samples\": [\n", file);
+	for (long i = 0; i < runs; i++)
+		fprintf(file, "    {\"wall\": %llu, \"user\": %llu, \"sys\": %llu, \"status\": %d}%s\n",
+		        (unsigned long long) samples[METRIC_WALL][i], (unsigned long long) samples[METRIC_USER][i],
+		        (unsigned long long) samples[METRIC_SYSTEM][i], statuses[i], i+1 < runs ? "," : "");
+	fputs("  ]\n}\n", file);
+	fclose(file);
+}
+
+/*
+ * Runs a command (or pipeline) repeatedly and reports how long it took
+ * (the 'bench' builtin). Its output is discarded unless '-v' is given.
+ * Argument(s):
+ *   Vector* tokens: bench [-n N] [-w WARMUP] [-v] [-c FILE.csv] [-j FILE.json] command...
+ *   const bool* quoted: whether each word was quoted, or NULL if none were.
+ * Returns:
+ *   The exit status of the last run, or 130 if interrupted.
+ */
+int bench_run(Vector* tokens, const bool* quoted) {
+	options o;
+	if (!parse_options(tokens, &o)) return EXIT_FAILURE;
+	size_t commandLength = 1;
+	for (unsigned int i = o.first; i < tokens->size; i++)
+		commandLength += strlen(vector_get(tokens, i)) + 1;
+	char* command = tsh_calloc(MEM_SHELL, commandLength, sizeof(char));
+	for (unsigned int i = o.first; i < tokens->size; i++) {
+		if (i > o.first) strcat(command, " ");
+		strcat(command, vector_get(tokens, i));
+	}
+
+	uint64_t* samples[METRIC_COUNT];
+	for (int m = 0; m < METRIC_COUNT; m++) samples[m] = tsh_calloc(MEM_SHELL, o.runs, sizeof(uint64_t));
+	int* statuses = tsh_calloc(MEM_SHELL, o.runs, sizeof(int));
+	int savedOutput = -1;
+	if (!o.verbose) { // Terminal output would be measured too
+		fflush(stdout);
+		int null = open("/dev/null", O_WRONLY | O_CLOEXEC);
+		savedOutput = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+		if (null != -1 && savedOutput != -1) dup2(null, STDOUT_FILENO);
+		if (null != -1) close(null);
+	}
+	int status = EXIT_SUCCESS;
+	long failed = 0, done = 0;
+	for (long i = -o.warmup; i < o.runs && status != 128 + SIGINT; i++) {
+		uint64_t sample[METRIC_COUNT];
+		status = run_once(tokens, quoted, o.first, sample);
+		if (i < 0 || status == 128 + SIGINT) continue; // Warming up, or cut short
+		for (int m = 0; m < METRIC_COUNT; m++) samples[m][i] = sample[m];
+		statuses[i] = status;
+		failed += status != EXIT_SUCCESS;
+		done++;
+	}
+	if (savedOutput != -1) {
+		fflush(stdout);
+		dup2(savedOutput, STDOUT_FILENO);
+		close(savedOutput);
+	}
+
+	if (done > 0) {
+		summary summaries[METRIC_COUNT];
+		char cells[7][16];
+		printf("bench: %ld run%s of '%s'", done, done == 1 ? "" : "s", command);
+		if (o.warmup > 0) printf(" after %ld warmup", o.warmup);
+		if (failed > 0) printf(COLOR_RED ", %ld failed" COLOR_RESET, failed);
+		printf("\n%-5s %10s %10s %10s %10s %10s %10s %10s\n", "", "mean", "stddev", "min", "p50", "p90", "p99", "max");
+		for (int m = 0; m < METRIC_COUNT; m++) {
+			summary* s = &summaries[m];
+			*s = summarize(samples[m], done);
+			printf("%-5s %10s %10s %10s %10s %10s %10s %10s\n", metricNames[m],
+			       format(s->mean, cells[0], 16), format(s->stddev, cells[1], 16), format(s->min, cells[2], 16),
+			       format(s->p50, cells[3], 16), format(s->p90, cells[4], 16), format(s->p99, cells[5], 16),
+			       format(s->max, cells[6], 16));
+		}
+		if (o.csv != NULL) write_csv(o.csv, samples, statuses, done);
+		if (o.json != NULL) write_json(o.json, command, &o, summaries, samples, statuses, done);
+	}
+	for (int m = 0; m < METRIC_COUNT; m++) tsh_free(samples[m]);
+	tsh_free(statuses);
+	tsh_free(command);
+	return status;
+}
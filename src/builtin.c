@@ -0,0 +1,38 @@
+// Standard: gnu99
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "builtin.h"
+#include "builtin-table.h"
+#include "intern.h"
+
+static const char* names[BUILTIN_COUNT] = {
+	#define BUILTIN(id, name) name,
+	#include "builtins.def"
+	#undef BUILTIN
+};
+
+static const char* slotNames[BUILTIN_SLOTS];	// The interned name in each slot, NULL if empty.
+
+/*
+ * Interns the builtin names into their slots of the perfect hash.
+ */
+void builtin_init(void) {
+	for (int i = 0; i < BUILTIN_COUNT; i++)
+		slotNames[builtin_hash(names[i], BUILTIN_SEED) & (BUILTIN_SLOTS-1)] = intern(names[i]);
+}
+
+/*
+ * Identifies a builtin with one hash and one comparison, however many
+ * builtins there are.
+ * Argument(s):
+ *   const char* name: the interned command name, or NULL.
+ * Returns:
+ *   The builtin, or BUILTIN_NONE.
+ */
+Builtin builtin_find(const char* name) {
+	if (name == NULL) return BUILTIN_NONE; // Never interned, so not a builtin
+	uint32_t slot = builtin_hash(name, BUILTIN_SEED) & (BUILTIN_SLOTS-1);
+	return slotNames[slot] == name ? builtinSlots[slot] : BUILTIN_NONE;
+}
@@ -0,0 +1,312 @@
+// Standard: gnu99
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "allocator.h"
+#include "cache.h"
+#include "tsh.h"
+#include "data-structs/vector.h"
+
+#define CACHE_MAGIC	0x31434354	// "TCC1"
+#define HASH_TEXT  	33       	// 128 bits in hex, and a Null.
+
+/*
+ * '~/.tsh-cache/keys/KEY' says what a command printed: its exit status,
+ * when it ran, and the hash of its output, which is stored once in
+ * '~/.tsh-cache/blobs/HASH' however many commands printed it. The key
+ * is a hash of the command's words, the working directory and the size
+ * and modification time of every declared dependency.
+ */
+typedef struct cache_record {
+	uint32_t magic;      	// CACHE_MAGIC.
+	int32_t status;      	// Exit status of the command.
+	int64_t created;     	// When it ran, in seconds since the Epoch.
+	uint64_t length;     	// Bytes of output.
+	char blob[HASH_TEXT];	// Hash of the output, naming its blob.
+} cache_record;
+
+typedef struct hash {
+	uint64_t lanes[2];
+} hash;
+
+typedef struct options {
+	long ttl;          	// Oldest usable entry, in seconds; -1 for any age.
+	Vector deps;       	// Files the output depends on.
+	bool clear;        	// Empty the cache instead.
+	unsigned int first;	// Index of the command in the tokens.
+} options;
+
+/*
+ * Two FNV-1a lanes from different starting points, for 128 bits of key.
+ */
+static void hash_update(hash* h, const void* data, size_t length) {
+	const unsigned char* bytes = data;
+	for (size_t i = 0; i < length; i++) {
+		h->lanes[0] = (h->lanes[0] ^ bytes[i]) * 0x100000001b3ULL;
+		h->lanes[1] = (h->lanes[1] ^ bytes[i] ^ 0xa5) * 0x100000001b3ULL;
+	}
+}
+
+static hash hash_start(void) {
+	return (hash) {{0xcbf29ce484222325ULL, 0xcbf29ce484222325ULL ^ 0x9e3779b97f4a7c15ULL}};
+}
+
+/*
+ * Finishes the hash (mixing every bit into every other) as hex text.
+ */
+static void hash_text(hash* h, char text[HASH_TEXT]) {
+	for (int i = 0; i < 2; i++) {
+		uint64_t x = h->lanes[i];
+		x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+		snprintf(text + 16*i, HASH_TEXT - 16*i, "%016llx", (unsigned long long) (x ^ (x >> 31)));
+	}
+}
+
+/*
+ * Builds the path of a file in the cache, creating its directories.
+ * Memory Management:
+ *   Free the returned path when done.
+ */
+static char* cache_path(const char* kind, const char* name) {
+	char* path = construct_path(CACHE_DIRECTORY);
+	mkdir(path, 0700);
+	strcat(path, "/");
+	strcat(path, kind);
+	mkdir(path, 0700);
+	if (name != NULL) {
+		strcat(path, "/");
+		strcat(path, name);
+	}
+	return path;
+}
+
+/*
+ * Reads the options before the command.
+ * Returns:
+ *   false, after printing why, if they make no sense.
+ */
+static bool parse_options(Vector* tokens, options* o) {
+	*o = (options) {-1, vector_init(0), false, 1};
+	for (; o->first < tokens->size; o->first++) {
+		const char* option = vector_get(tokens, o->first);
+		if (!strcmp(option, "--")) {
+			o->first++;
+			break;
+		} else if (!strcmp(option, "--clear")) o->clear = true;
+		else if ((!strcmp(option, "--ttl") || !strcmp(option, "--dep")) && o->first+1 < tokens->size) {
+			char* value = vector_get(tokens, ++o->first);
+			char* end;
+			if (!strcmp(option, "--dep")) vector_add(&o->deps, o->deps.size, value);
+			else if ((o->ttl = strtol(value, &end, 10)) < 0 || *end != ASCII_NULL || end == value) {
+				fprintf(stderr, COLOR_RED "T-Shell: cache: %s: Not a number of seconds.\n" COLOR_RESET, value);
+				return false;
+			}
+		} else if (!strncmp(option, "--", 2)) {
+			fprintf(stderr, COLOR_RED "T-Shell: cache: Usage: cache [--ttl S] [--dep FILE]... command | cache --clear\n" COLOR_RESET);
+			return false;
+		} else break;
+	}
+	if (!o->clear && o->first >= tokens->size) {
+		fprintf(stderr, COLOR_RED "T-Shell: cache: Missing command.\n" COLOR_RESET);
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Hashes everything the output may depend on into the entry's key.
+ */
+static void make_key(Vector* tokens, options* o, char key[HASH_TEXT]) {
+	hash h = hash_start();
+	for (unsigned int i = o->first; i < tokens->size; i++) {
+		const char* word = vector_get(tokens, i);
+		hash_update(&h, word, strlen(word)+1); // The Null keeps "a b" apart from "ab"
+	}
+	char* cwd = getcwd(NULL, 0);
+	if (cwd != NULL) hash_update(&h, cwd, strlen(cwd)+1);
+	free(cwd); // From getcwd(), not the tsh allocator
+	for (unsigned int i = 0; i < o->deps.size; i++) {
+		const char* dep = vector_get(&o->deps, i);
+		struct stat info;
+		int64_t stamp[3] = {-1, -1, -1}; // Missing files count as a state too
+		if (!stat(dep, &info)) {
+			stamp[0] = info.st_mtim.tv_sec;
+			stamp[1] = info.st_mtim.tv_nsec;
+			stamp[2] = info.st_size;
+		}
+		hash_update(&h, dep, strlen(dep)+1);
+		hash_update(&h, stamp, sizeof(stamp));
+	}
+	hash_text(&h, key);
+}
+
+/*
+ * Copies a file to the Standard Output, in the kernel where possible.
+ */
+static bool send_file(int fd, uint64_t length) {
+	fflush(stdout);
+	uint64_t sent = 0;
+	while (sent < length) {
+		ssize_t count = sendfile(STDOUT_FILENO, fd, NULL, length - sent);
+		if (count == -1 && errno == EINTR) continue;
+		if (count == -1 && (errno == EINVAL || errno == ENOSYS)) { // e.g. appending files
+			char chunk[BUFSIZ];
+			count = read(fd, chunk, sizeof(chunk));
+			if (count > 0 && write(STDOUT_FILENO, chunk, count) != count) return false;
+		}
+		if (count <= 0) return false;
+		sent += count;
+	}
+	return true;
+}
+
+/*
+ * Serves the entry for a key, if there is a fresh one.
+ * Argument(s):
+ *   int* status: receives the exit status the command had.
+ * Returns:
+ *   true on a hit.
+ */
+static bool serve(const char* key, long ttl, int* status) {
+	char* path = cache_path("keys", key);
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	tsh_free(path);
+	if (fd == -1) return false;
+	cache_record record;
+	bool valid = read(fd, &record, sizeof(record)) == sizeof(record) && record.magic == CACHE_MAGIC &&
+	             record.blob[HASH_TEXT-1] == ASCII_NULL && (ttl < 0 || time(NULL) - record.created <= ttl);
+	close(fd);
+	if (!valid) return false;
+	path = cache_path("blobs", record.blob);
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	tsh_free(path);
+	struct stat info;
+	if (fd == -1 || fstat(fd, &info) || (uint64_t) info.st_size != record.length) { // Cleared underneath us
+		if (fd != -1) close(fd);
+		return false;
+	}
+	send_file(fd, record.length);
+	close(fd);
+	*status = record.status;
+	return true;
+}
+
+/*
+ * Runs the command with its output going to a new blob, then files the
+ * blob under the hash of its content and points the key at it.
+ * Returns:
+ *   The exit status of the command.
+ */
+static int fill(Vector* tokens, const bool* quoted, options* o, const char* key) {
+	char* temporary = cache_path("blobs", ".new-XXXXXX");
+	int fd = mkstemp(temporary);
+	Vector command = vector_init(0); // run_tokens() may rearrange it
+	for (unsigned int i = o->first; i < tokens->size; i++)
+		vector_add(&command, command.size, vector_get(tokens, i));
+	if (fd == -1) { // Runs uncached
+		int status = run_tokens(&command, quoted == NULL ? NULL : quoted+o->first);
+		tsh_free(command.array);
+		tsh_free(temporary);
+		return status;
+	}
+	fflush(stdout);
+	int savedOutput = dup(STDOUT_FILENO);
+	dup2(fd, STDOUT_FILENO);
+	int status = run_tokens(&command, quoted == NULL ? NULL : quoted+o->first);
+	fflush(stdout);
+	dup2(savedOutput, STDOUT_FILENO);
+	close(savedOutput);
+	tsh_free(command.array);
+
+	hash h = hash_start();
+	char chunk[BUFSIZ];
+	ssize_t count;
+	uint64_t length = 0;
+	lseek(fd, 0, SEEK_SET);
+	while ((count = read(fd, chunk, sizeof(chunk))) > 0) {
+		hash_update(&h, chunk, count);
+		length += count;
+	}
+	lseek(fd, 0, SEEK_SET);
+	send_file(fd, length); // What the user would have seen
+	close(fd);
+	cache_record record = {CACHE_MAGIC, status, time(NULL), length, ""};
+	hash_text(&h, record.blob);
+	char* blob = cache_path("blobs", record.blob);
+	bool stored = status != 128 + SIGINT && !rename(temporary, blob); // An interrupted run is not the answer
+	if (!stored) unlink(temporary);
+	tsh_free(blob);
+	tsh_free(temporary);
+	if (!stored) return status;
+
+	char* entry = cache_path("keys", key);
+	char* newEntry = tsh_calloc(MEM_SHELL, strlen(entry)+5, sizeof(char));
+	strcpy(newEntry, entry);
+	strcat(newEntry, ".new");
+	int entryfd = open(newEntry, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (entryfd != -1) {
+		bool written = write(entryfd, &record, sizeof(record)) == sizeof(record);
+		close(entryfd);
+		if (!written || rename(newEntry, entry)) unlink(newEntry); // Readers see the old entry or the new one
+	}
+	tsh_free(newEntry);
+	tsh_free(entry);
+	return status;
+}
+
+/*
+ * Removes every file in one of the cache's directories.
+ */
+static void clear(const char* kind) {
+	char* path = cache_path(kind, NULL);
+	DIR* dir = opendir(path);
+	if (dir != NULL) {
+		struct dirent* entry;
+		while ((entry = readdir(dir)) != NULL)
+			if (entry->d_name[0] != '.' || entry->d_name[1] == 'n') // Leaves '.' and '..'
+				unlinkat(dirfd(dir), entry->d_name, 0);
+		closedir(dir);
+	}
+	tsh_free(path);
+}
+
+/*
+ * Runs a command through the on-disk cache (the 'cache' builtin): its
+ * output and exit status are replayed, without running it, while the
+ * words, directory and dependencies are unchanged.
+ * Argument(s):
+ *   Vector* tokens: cache [--ttl S] [--dep FILE]... command, or cache --clear.
+ *   const bool* quoted: whether each word was quoted, or NULL if none were.
+ * Returns:
+ *   The exit status of the command.
+ */
+int cache_run(Vector* tokens, const bool* quoted) {
+	options o;
+	int status = EXIT_FAILURE;
+	if (parse_options(tokens, &o)) {
+		if (o.clear) {
+			clear("keys");
+			clear("blobs");
+			status = EXIT_SUCCESS;
+		} else {
+			char key[HASH_TEXT];
+			make_key(tokens, &o, key);
+			if (!serve(key, o.ttl, &status)) status = fill(tokens, quoted, &o, key);
+		}
+	}
+	tsh_free(o.deps.array);
+	return status;
+}
@@ -0,0 +1,229 @@
+// Standard: gnu99
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "allocator.h"
+#include "capture.h"
+#include "tsh.h"
+#include "data-structs/vector.h"
+
+/*
+ * While a command runs, its Standard Output is the slave side of a
+ * pseudo-terminal, so programs still see a terminal (line buffering,
+ * colors, columns). A relay process copies what arrives on the master
+ * side to the real terminal and into a ring of 'budget' bytes shared
+ * with the shell. The shell remembers where each command's output
+ * starts and how long it is; 'out' replays it from the ring.
+ */
+typedef struct capture_ring {
+	uint64_t written;	// Bytes relayed so far, by every command.
+	char data[];     	// The last 'budget' of them.
+} capture_ring;
+
+typedef struct capture_entry {
+	char* command;  	// The command line.
+	uint64_t start; 	// Position of its output in the ring.
+	uint64_t length;	// Bytes of output.
+} capture_entry;
+
+static capture_ring* ring = NULL;	// Shared with the relay, NULL unless capturing.
+static size_t budget = 0;        	// Bytes the ring holds.
+static capture_entry entries[CAPTURE_COMMANDS];
+static unsigned int entryCount = 0;	// Entries in use; the newest is at 'newest'.
+static unsigned int newest = 0;
+static int master = -1;          	// The pseudo-terminal, reused for every command.
+static int slave = -1;
+static int savedOutput = -1;     	// The real Standard Output, while a command runs.
+static pid_t relay = -1;         	// The relay process of the running command.
+static char* command = NULL;     	// The running command's line.
+static uint64_t started = 0;     	// Where its output starts.
+
+/*
+ * Sets up capturing with a ring of the given size (CAPTURE= in '~/.tsh-rc').
+ * Returns:
+ *   false if the pseudo-terminal or the ring is not available.
+ */
+bool capture_init(size_t size) {
+	if (size == 0 || !isatty(STDOUT_FILENO)) return false;
+	master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+	if (master == -1 || grantpt(master) || unlockpt(master) ||
+	    (slave = open(ptsname(master), O_RDWR | O_NOCTTY | O_CLOEXEC)) == -1) {
+		capture_free();
+		return false;
+	}
+	void* mapping = mmap(NULL, sizeof(capture_ring) + size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (mapping == MAP_FAILED) {
+		capture_free();
+		return false;
+	}
+	ring = mapping;
+	budget = size;
+	return true;
+}
+
+/*
+ * Copies the master side to the real terminal and into the ring until
+ * every writer has closed the slave side. Runs in its own process.
+ */
+static void run_relay(void) {
+	signal(SIGINT, SIG_IGN); // Ctrl-C is for the command
+	signal(SIGQUIT, SIG_IGN);
+	signal(SIGTSTP, SIG_IGN);
+	close(slave);
+	char chunk[BUFSIZ];
+	while (true) {
+		ssize_t length = read(master, chunk, sizeof(chunk));
+		if (length == -1 && errno == EINTR) continue;
+		if (length <= 0) break; // EIO once the last writer is gone
+		for (ssize_t sent = 0, count; sent < length; sent += count)
+			if ((count = write(savedOutput, chunk+sent, length-sent)) <= 0) break;
+		for (ssize_t copied = 0; copied < length; ) { // Wraps around the end of the ring
+			size_t offset = (ring->written + copied) % budget;
+			size_t piece = length - copied < (ssize_t) (budget - offset) ? (size_t) (length - copied) : budget - offset;
+			memcpy(ring->data + offset, chunk + copied, piece);
+			copied += piece;
+		}
+		__atomic_store_n(&ring->written, ring->written + length, __ATOMIC_RELEASE);
+	}
+	_exit(EXIT_SUCCESS);
+}
+
+/*
+ * Starts capturing the output of a command line.
+ * Returns:
+ *   false if it runs uncaptured.
+ */
+bool capture_begin(const char* line) {
+	if (ring == NULL) return false;
+	struct termios settings;
+	struct winsize size;
+	if (!tcgetattr(STDOUT_FILENO, &settings)) {
+		settings.c_oflag &= ~OPOST; // Newlines reach the real terminal untouched
+		tcsetattr(slave, TCSANOW, &settings);
+	}
+	if (!ioctl(STDOUT_FILENO, TIOCGWINSZ, &size)) ioctl(master, TIOCSWINSZ, &size);
+	fflush(stdout);
+	savedOutput = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+	if (savedOutput == -1) return false;
+	started = __atomic_load_n(&ring->written, __ATOMIC_ACQUIRE);
+	if ((relay = fork()) == 0) run_relay();
+	if (relay == -1) {
+		close(savedOutput);
+		return false;
+	}
+	dup2(slave, STDOUT_FILENO);
+	command = tsh_calloc(MEM_SHELL, strlen(line)+1, sizeof(char));
+	strcpy(command, line);
+	return true;
+}
+
+/*
+ * Waits for the relay to pass on the last of the output, then records it.
+ */
+void capture_end(void) {
+	if (relay <= 0) return;
+	fflush(stdout);
+	dup2(savedOutput, STDOUT_FILENO);
+	close(savedOutput);
+	// The relay reads until the slave side is closed everywhere, so it
+	// needs a fresh slave for the next command; this one goes with it.
+	close(slave);
+	slave = open(ptsname(master), O_RDWR | O_NOCTTY | O_CLOEXEC);
+	int status;
+	struct timespec pause = {0, 1000000};
+	unsigned int waited = 0;
+	while (waitpid(relay, &status, WNOHANG) == 0) {
+		if (waited++ == CAPTURE_DRAIN_MS) { // Something in the background still holds the output
+			kill(relay, SIGKILL);
+			waitpid(relay, &status, 0);
+			break;
+		}
+		nanosleep(&pause, NULL);
+	}
+	relay = -1;
+	newest = (newest + 1) % CAPTURE_COMMANDS;
+	if (entryCount < CAPTURE_COMMANDS) entryCount++;
+	else tsh_free(entries[newest].command); // The oldest makes room
+	entries[newest] = (capture_entry) {command, started, __atomic_load_n(&ring->written, __ATOMIC_ACQUIRE) - started};
+	command = NULL;
+}
+
+/*
+ * Replays captured output (the 'out' builtin).
+ * Argument(s):
+ *   Vector* tokens: 'out' for the last command's output, 'out N' for the
+ *                   Nth last, or 'out -l' to list what is kept.
+ * Returns:
+ *   The exit status of the builtin.
+ */
+int capture_replay(Vector* tokens) {
+	if (ring == NULL) {
+		fprintf(stderr, COLOR_RED "T-Shell: out: Output is not captured (set CAPTURE=<bytes> in ~/.tsh-rc).\n" COLOR_RESET);
+		return EXIT_FAILURE;
+	}
+	uint64_t written = __atomic_load_n(&ring->written, __ATOMIC_ACQUIRE);
+	if (tokens->size == 2 && !strcmp(vector_get(tokens, 1), "-l")) {
+		for (unsigned int i = 1; i <= entryCount; i++) {
+			capture_entry* entry = &entries[(newest + CAPTURE_COMMANDS - i + 1) % CAPTURE_COMMANDS];
+			bool whole = written - entry->start <= budget;
+			printf("%3u  %10llu%s  %s\n", i, (unsigned long long) entry->length, whole ? " " : "*", entry->command);
+		}
+		return EXIT_SUCCESS;
+	}
+	long back = 1;
+	char* end = NULL;
+	if (tokens->size > 2 || (tokens->size == 2 && ((back = strtol(vector_get(tokens, 1), &end, 10)) < 1 || *end != ASCII_NULL))) {
+		fprintf(stderr, COLOR_RED "T-Shell: out: Usage: out [N | -l]\n" COLOR_RESET);
+		return EXIT_FAILURE;
+	}
+	if ((unsigned long) back > entryCount) {
+		fprintf(stderr, COLOR_RED "T-Shell: out: Only %u command%s captured.\n" COLOR_RESET, entryCount, entryCount == 1 ? "" : "s");
+		return EXIT_FAILURE;
+	}
+	capture_entry* entry = &entries[(newest + CAPTURE_COMMANDS - back + 1) % CAPTURE_COMMANDS];
+	uint64_t start = entry->start, stop = entry->start + entry->length;
+	if (written - start > budget) { // Partly overwritten by newer output
+		start = written > budget ? written - budget : 0;
+		if (start >= stop) {
+			fprintf(stderr, COLOR_RED "T-Shell: out: That output no longer fits in the budget.\n" COLOR_RESET);
+			return EXIT_FAILURE;
+		}
+		fprintf(stderr, COLOR_YELLOW "T-Shell: out: Only the last %llu bytes are kept.\n" COLOR_RESET, (unsigned long long) (stop - start));
+	}
+	fflush(stdout);
+	for (uint64_t position = start; position < stop; ) {
+		size_t offset = position % budget;
+		size_t piece = stop - position < budget - offset ? stop - position : budget - offset;
+		ssize_t count = write(STDOUT_FILENO, ring->data + offset, piece);
+		if (count == -1 && errno == EINTR) continue;
+		if (count <= 0) return EXIT_FAILURE; // e.g. the reader of a pipe went away
+		position += count;
+	}
+	return EXIT_SUCCESS;
+}
+
+void capture_free(void) {
+	for (unsigned int i = 0; i < entryCount; i++)
+		tsh_free(entries[(newest + CAPTURE_COMMANDS - i) % CAPTURE_COMMANDS].command);
+	entryCount = 0;
+	if (ring != NULL) munmap(ring, sizeof(capture_ring) + budget);
+	ring = NULL;
+	if (slave != -1) close(slave);
+	if (master != -1) close(master);
+	slave = master = -1;
+}
@@ -0,0 +1,515 @@
+// Standard: gnu99
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "allocator.h"
+#include "tsh.h"
+#include "vm.h"
+
+#define NO_JUMP	UINT_MAX	// Ends a chain of jumps waiting for their target.
+
+typedef enum token_type {
+	TOKEN_WORD,   	// Anything else
+	TOKEN_SEMI,   	// ;
+	TOKEN_NEWLINE,	// \n
+	TOKEN_AND,    	// &&
+	TOKEN_OR,     	// ||
+	TOKEN_DSEMI,  	// ;;
+	TOKEN_LPAREN, 	// (
+	TOKEN_RPAREN, 	// )
+	TOKEN_PIPE,   	// |
+	TOKEN_END     	// End of the source
+} TokenType;
+
+typedef struct token {
+	TokenType type;  	// What kind of token this is.
+	const char* text;	// Where it starts in the source.
+	size_t length;   	// How long it is.
+} Token;
+
+typedef struct loop_context {
+	unsigned int top;   	// Where 'continue' jumps to.
+	unsigned int breaks;	// Chain of 'break' jumps, patched at the end of the loop.
+	struct loop_context* outer;
+} loop_context;
+
+typedef struct parser {
+	Token* tokens;        	// The lexed source.
+	unsigned int position;	// The next token.
+	Program* program;     	// Where code is emitted.
+	loop_context* loop;   	// The innermost enclosing loop, if any.
+	int error;            	// VM_INCOMPLETE or VM_SYNTAX_ERROR once something goes wrong.
+} parser;
+
+static const char* reserved[] = {"then", "elif", "else", "fi", "do", "done", "esac", "}", NULL};
+static const char* keywords[] = {"if", "while", "until", "for", "case", "function", "{", NULL};
+
+static bool parse_list(parser* p, bool required);
+static bool parse_command(parser* p);
+
+/*
+ * Finds the end of a quoted string, "$(...)" or "`...`".
+ * Argument(s):
+ *   const char* c: points at the opening quote, backtick or '$'.
+ * Returns:
+ *   A pointer to the closing character, or NULL if it is unterminated.
+ */
+static const char* skip_quoted(const char* c) {
+	if (*c == '\'' || *c == '`') return strchr(c+1, *c);
+	if (*c == '"') {
+		for (c++; *c != ASCII_NULL; c++) {
+			if (*c == '\\' && c[1] != ASCII_NULL) c++;
+			else if (*c == '"') return c;
+			else if ((*c == '`' || (c[0] == '$' && c[1] == '(')) && (c = skip_quoted(c)) == NULL) return NULL;
+		}
+		return NULL;
+	}
+	int depth = 1; // $( ... )
+	for (c += 2; *c != ASCII_NULL; c++) {
+		if (*c == '\'' || *c == '"' || *c == '`') {
+			if ((c = skip_quoted(c)) == NULL) return NULL;
+		} else if (*c == '(') depth++;
+		else if (*c == ')' && --depth == 0) return c;
+	}
+	return NULL;
+}
+
+/*
+ * Splits the source into tokens.
+ * Argument(s):
+ *   const char* source: the source text.
+ *   Token** tokens: where the tokens are stored, ending with TOKEN_END.
+ * Memory Management:
+ *   Free the token array when done.
+ * Returns:
+ *   0 on success, VM_INCOMPLETE if a quote or substitution is unterminated.
+ */
+static int lex(const char* source, Token** tokens) {
+	unsigned int count = 0;
+	unsigned int capacity = 16;
+	*tokens = tsh_calloc(MEM_PARSER, capacity, sizeof(Token));
+	const char* c = source;
+	while (true) {
+		while (*c == ASCII_SPACE || *c == '\t') c++;
+		if (*c == '#') while (*c != ASCII_NULL && *c != ASCII_NEWLINE) c++; // Comment
+		if (count+1 >= capacity) *tokens = tsh_realloc(MEM_PARSER, *tokens, (capacity *= 2) * sizeof(Token));
+		Token* t = &(*tokens)[count++];
+		t->text = c;
+		t->length = 1;
+		if (*c == ASCII_NULL) { t->type = TOKEN_END; t->length = 0; break; }
+		else if (*c == ASCII_NEWLINE) t->type = TOKEN_NEWLINE;
+		else if (c[0] == ';' && c[1] == ';') { t->type = TOKEN_DSEMI; t->length = 2; }
+		else if (*c == ';') t->type = TOKEN_SEMI;
+		else if (c[0] == '&' && c[1] == '&') { t->type = TOKEN_AND; t->length = 2; }
+		else if (c[0] == '|' && c[1] == '|') { t->type = TOKEN_OR; t->length = 2; }
+		else if (*c == '|') t->type = TOKEN_PIPE;
+		else if (*c == '(') t->type = TOKEN_LPAREN;
+		else if (*c == ')') t->type = TOKEN_RPAREN;
+		else {
+			t->type = TOKEN_WORD;
+			const char* start = c;
+			while (*c != ASCII_NULL && !strchr(" \t\n;|()", *c) && !(c[0] == '&' && c[1] == '&')) {
+				if (*c == '\'' || *c == '"' || *c == '`' || (c[0] == '$' && c[1] == '(')) {
+					if ((c = skip_quoted(c)) == NULL) return VM_INCOMPLETE;
+					c++;
+				} else if (*c == '\\' && c[1] != ASCII_NULL) c += 2;
+				else c++;
+			}
+			t->length = c - start;
+			continue;
+		}
+		c += t->length;
+	}
+	return 0;
+}
+
+/*
+ * Appends an instruction to the program being compiled.
+ * Argument(s):
+ *   parser* p: the parser.
+ *   Opcode op: the operation.
+ *   unsigned int operand: its operand.
+ *   unsigned int target: its jump target.
+ * Returns:
+ *   The index of the new instruction.
+ */
+static unsigned int emit(parser* p, Opcode op, unsigned int operand, unsigned int target) {
+	Program* program = p->program;
+	program->code = tsh_realloc(MEM_PARSER, program->code, (program->length+1) * sizeof(Instruction));
+	program->code[program->length] = (Instruction) {op, operand, target};
+	return program->length++;
+}
+
+/*
+ * Points every jump in a chain at the given target.
+ * Argument(s):
+ *   parser* p: the parser.
+ *   unsigned int chain: the last jump in the chain, or NO_JUMP.
+ *   unsigned int target: the destination.
+ */
+static void patch(parser* p, unsigned int chain, unsigned int target) {
+	while (chain != NO_JUMP) {
+		unsigned int previous = p->program->code[chain].target;
+		p->program->code[chain].target = target;
+		chain = previous;
+	}
+}
+
+/*
+ * Adds a command made of the given tokens to the program.
+ * Argument(s):
+ *   parser* p: the parser.
+ *   Token* words: the tokens making up the command.
+ *   unsigned int count: the number of tokens.
+ * Returns:
+ *   The index of the command.
+ */
+static unsigned int add_command(parser* p, Token* words, unsigned int count) {
+	Program* program = p->program;
+	program->commands = tsh_realloc(MEM_PARSER, program->commands, (program->commandCount+1) * sizeof(Command));
+	Command* command = &program->commands[program->commandCount];
+	command->argc = count;
+	command->argv = tsh_calloc(MEM_PARSER, count, sizeof(ExpansionWord*));
+	for (unsigned int i = 0; i < count; i++) command->argv[i] = expansion_compile(words[i].text, words[i].length);
+	return program->commandCount++;
+}
+
+static Token* peek(parser* p) {
+	return &p->tokens[p->position];
+}
+
+static bool is_keyword(Token* t, const char* keyword) {
+	return t->type == TOKEN_WORD && t->length == strlen(keyword) && !strncmp(t->text, keyword, t->length);
+}
+
+/*
+ * Records that the source could not be compiled at the current token.
+ * Returns:
+ *   false, for convenience.
+ */
+static bool fail(parser* p) {
+	if (p->error == 0) p->error = peek(p)->type == TOKEN_END ? VM_INCOMPLETE : VM_SYNTAX_ERROR;
+	return false;
+}
+
+static bool expect(parser* p, const char* keyword) {
+	if (!is_keyword(peek(p), keyword)) return fail(p);
+	p->position++;
+	return true;
+}
+
+static void skip_newlines(parser* p) {
+	while (peek(p)->type == TOKEN_NEWLINE) p->position++;
+}
+
+/*
+ * Checks whether the current token ends a list.
+ */
+static bool at_list_end(parser* p) {
+	Token* t = peek(p);
+	if (t->type == TOKEN_END || t->type == TOKEN_DSEMI || t->type == TOKEN_RPAREN) return true;
+	for (int i = 0; reserved[i] != NULL; i++)
+		if (is_keyword(t, reserved[i])) return true;
+	return false;
+}
+
+/*
+ * if LIST then LIST [elif LIST then LIST]... [else LIST] fi
+ */
+static bool parse_if(parser* p) {
+	unsigned int ends = NO_JUMP;
+	do {
+		p->position++; // 'if' or 'elif'
+		if (!parse_list(p, true) || !expect(p, "then")) return false;
+		unsigned int skip = emit(p, OP_JUMP_FAILED, 0, 0);
+		if (!parse_list(p, true)) return false;
+		ends = emit(p, OP_JUMP, 0, ends);
+		p->program->code[skip].target = p->program->length;
+	} while (is_keyword(peek(p), "elif"));
+	if (is_keyword(peek(p), "else")) {
+		p->position++;
+		if (!parse_list(p, true)) return false;
+	} else emit(p, OP_SUCCEED, 0, 0); // No branch ran
+	patch(p, ends, p->program->length);
+	return expect(p, "fi");
+}
+
+/*
+ * Compiles the body of a loop, between 'do' and 'done'.
+ * Argument(s):
+ *   parser* p: the parser.
+ *   unsigned int top: where 'continue' jumps to.
+ *   unsigned int* breaks: where the chain of 'break' jumps is stored.
+ * Returns:
+ *   true if the body compiled.
+ */
+static bool parse_loop_body(parser* p, unsigned int top, unsigned int* breaks) {
+	loop_context loop = {top, NO_JUMP, p->loop};
+	p->loop = &loop;
+	bool parsed = expect(p, "do") && parse_list(p, true) && expect(p, "done");
+	p->loop = loop.outer;
+	*breaks = loop.breaks;
+	if (parsed) emit(p, OP_JUMP, 0, top);
+	return parsed;
+}
+
+/*
+ * while LIST do LIST done, or until LIST do LIST done
+ */
+static bool parse_while(parser* p) {
+	bool until = is_keyword(peek(p), "until");
+	p->position++;
+	unsigned int top = p->program->length;
+	if (!parse_list(p, true)) return false;
+	unsigned int exit = emit(p, until ? OP_JUMP_PASSED : OP_JUMP_FAILED, 0, 0);
+	unsigned int breaks;
+	if (!parse_loop_body(p, top, &breaks)) return false;
+	p->program->code[exit].target = p->program->length;
+	patch(p, breaks, p->program->length);
+	emit(p, OP_SUCCEED, 0, 0);
+	return true;
+}
+
+/*
+ * for NAME [in WORD...] ; do LIST done
+ */
+static bool parse_for(parser* p) {
+	p->position++;
+	Token* name = peek(p);
+	if (name->type != TOKEN_WORD) return fail(p);
+	p->position++;
+	unsigned int variable = add_command(p, name, 1);
+	unsigned int list;
+	if (is_keyword(peek(p), "in")) {
+		unsigned int first = ++p->position;
+		while (peek(p)->type == TOKEN_WORD) p->position++;
+		list = add_command(p, &p->tokens[first], p->position - first);
+	} else list = add_command(p, NULL, 0); // The function's arguments
+	if (peek(p)->type == TOKEN_SEMI) p->position++;
+	skip_newlines(p);
+	emit(p, OP_FOR_INIT, list, 0);
+	unsigned int top = emit(p, OP_FOR_NEXT, variable, 0);
+	unsigned int breaks;
+	if (!parse_loop_body(p, top, &breaks)) return false;
+	unsigned int end = emit(p, OP_FOR_POP, 0, 0);
+	p->program->code[top].target = end;
+	patch(p, breaks, end);
+	return true;
+}
+
+/*
+ * case WORD in [(] PATTERN [| PATTERN]... ) LIST ;; ... esac
+ */
+static bool parse_case(parser* p) {
+	p->position++;
+	Token* subject = peek(p);
+	if (subject->type != TOKEN_WORD) return fail(p);
+	p->position++;
+	skip_newlines(p);
+	if (!expect(p, "in")) return false;
+	skip_newlines(p);
+	unsigned int ends = NO_JUMP;
+	Token* words = tsh_calloc(MEM_PARSER, 1, sizeof(Token));
+	words[0] = *subject;
+	bool parsed = true;
+	while (parsed && !is_keyword(peek(p), "esac")) {
+		unsigned int count = 1;
+		if (peek(p)->type == TOKEN_LPAREN) p->position++;
+		do {
+			if (peek(p)->type != TOKEN_WORD) { parsed = fail(p); break; }
+			words = tsh_realloc(MEM_PARSER, words, (count+1) * sizeof(Token));
+			words[count++] = *peek(p);
+			p->position++;
+		} while (peek(p)->type == TOKEN_PIPE && ++p->position);
+		if (!parsed || peek(p)->type != TOKEN_RPAREN) { parsed = fail(p); break; }
+		p->position++;
+		unsigned int skip = emit(p, OP_CASE, add_command(p, words, count), 0);
+		if (!(parsed = parse_list(p, false))) break;
+		ends = emit(p, OP_JUMP, 0, ends);
+		p->program->code[skip].target = p->program->length;
+		if (peek(p)->type == TOKEN_DSEMI) p->position++;
+		else if (!is_keyword(peek(p), "esac")) parsed = fail(p);
+		skip_newlines(p);
+	}
+	tsh_free(words);
+	if (!parsed) return false;
+	p->position++; // 'esac'
+	emit(p, OP_SUCCEED, 0, 0); // Nothing matched
+	patch(p, ends, p->program->length);
+	return true;
+}
+
+/*
+ * NAME () COMMAND, or function NAME [()] COMMAND. The body is compiled
+ * into its own program, installed when the definition runs.
+ */
+static bool parse_function(parser* p, Token* name) {
+	Program* outer = p->program;
+	loop_context* outerLoop = p->loop;
+	Program* body = tsh_calloc(MEM_PARSER, 1, sizeof(Program));
+	body->refs = 1;
+	p->program = body;
+	p->loop = NULL;
+	skip_newlines(p);
+	bool parsed = parse_command(p);
+	p->program = outer;
+	p->loop = outerLoop;
+	if (!parsed) {
+		vm_free(body);
+		return false;
+	}
+	unsigned int index = outer->functionCount++;
+	outer->functions = tsh_realloc(MEM_PARSER, outer->functions, outer->functionCount * sizeof(Program*));
+	outer->functionNames = tsh_realloc(MEM_PARSER, outer->functionNames, outer->functionCount * sizeof(char*));
+	outer->functions[index] = body;
+	outer->functionNames[index] = tsh_calloc(MEM_PARSER, name->length+1, sizeof(char));
+	memcpy(outer->functionNames[index], name->text, name->length);
+	emit(p, OP_DEFINE, index, 0);
+	return true;
+}
+
+/*
+ * A simple command, a compound command or a function definition.
+ */
+static bool parse_command(parser* p) {
+	Token* t = peek(p);
+	if (t->type != TOKEN_WORD) return fail(p);
+	if (is_keyword(t, "if")) return parse_if(p);
+	if (is_keyword(t, "while") || is_keyword(t, "until")) return parse_while(p);
+	if (is_keyword(t, "for")) return parse_for(p);
+	if (is_keyword(t, "case")) return parse_case(p);
+	if (is_keyword(t, "{")) {
+		p->position++;
+		return parse_list(p, true) && expect(p, "}");
+	}
+	if (is_keyword(t, "function")) {
+		p->position++;
+		Token* name = peek(p);
+		if (name->type != TOKEN_WORD) return fail(p);
+		p->position++;
+		if (peek(p)->type == TOKEN_LPAREN) {
+			p->position++;
+			if (peek(p)->type != TOKEN_RPAREN) return fail(p);
+			p->position++;
+		}
+		return parse_function(p, name);
+	}
+	if (t[1].type == TOKEN_LPAREN) {
+		if (t[2].type != TOKEN_RPAREN) {
+			p->position += 2;
+			return fail(p);
+		}
+		p->position += 3;
+		return parse_function(p, t);
+	}
+	if ((is_keyword(t, "break") || is_keyword(t, "continue")) && p->loop != NULL) {
+		p->position++;
+		if (is_keyword(t, "break")) p->loop->breaks = emit(p, OP_JUMP, 0, p->loop->breaks);
+		else emit(p, OP_JUMP, 0, p->loop->top);
+		return true;
+	}
+	if (is_keyword(t, "return")) {
+		p->position++;
+		unsigned int status = 0;
+		if (peek(p)->type == TOKEN_WORD) {
+			status = atoi(peek(p)->text) + 1;
+			p->position++;
+		}
+		emit(p, OP_RETURN, status, 0);
+		return true;
+	}
+	unsigned int first = p->position;
+	while (peek(p)->type == TOKEN_WORD || peek(p)->type == TOKEN_PIPE) p->position++;
+	emit(p, OP_EXEC, add_command(p, &p->tokens[first], p->position - first), 0);
+	return true;
+}
+
+/*
+ * COMMAND [&& COMMAND | || COMMAND]...
+ */
+static bool parse_and_or(parser* p) {
+	if (!parse_command(p)) return false;
+	while (peek(p)->type == TOKEN_AND || peek(p)->type == TOKEN_OR) {
+		Opcode skip = peek(p)->type == TOKEN_AND ? OP_JUMP_FAILED : OP_JUMP_PASSED;
+		p->position++;
+		skip_newlines(p);
+		unsigned int jump = emit(p, skip, 0, 0);
+		if (!parse_command(p)) return false;
+		p->program->code[jump].target = p->program->length;
+	}
+	return true;
+}
+
+/*
+ * Commands separated by ';' or newlines, up to a reserved word or the end.
+ * Conditions and bodies are 'required' to hold at least one command.
+ */
+static bool parse_list(parser* p, bool required) {
+	for (bool parsed = false; ; parsed = true) {
+		while (peek(p)->type == TOKEN_SEMI || peek(p)->type == TOKEN_NEWLINE) p->position++;
+		if (at_list_end(p)) return parsed || !required || fail(p);
+		if (!parse_and_or(p)) return false;
+		TokenType next = peek(p)->type;
+		if (next != TOKEN_SEMI && next != TOKEN_NEWLINE && !at_list_end(p)) return fail(p);
+	}
+}
+
+/*
+ * Checks whether a line uses control flow or defines a function, and so
+ * has to be compiled rather than run directly.
+ * Argument(s):
+ *   const char* line: the user input.
+ * Returns:
+ *   true if the line should be compiled.
+ */
+bool vm_handles(const char* line) {
+	if (strstr(line, "()") != NULL || strstr(line, "$?") != NULL) return true;
+	for (const char* c = line; *c != ASCII_NULL; ) {
+		while (*c != ASCII_NULL && strchr(" \t\n;|&(", *c)) c++;
+		const char* start = c;
+		while (*c != ASCII_NULL && !strchr(" \t\n;|&(", *c)) c++;
+		for (int i = 0; keywords[i] != NULL; i++)
+			if ((size_t) (c-start) == strlen(keywords[i]) && !strncmp(start, keywords[i], c-start))
+				return true;
+	}
+	return false;
+}
+
+/*
+ * Compiles source text into bytecode.
+ * Argument(s):
+ *   const char* source: the source text, possibly several lines.
+ *   Program** program: where the compiled program is stored.
+ * Memory Management:
+ *   Release the program with vm_free() when done.
+ * Returns:
+ *   0 on success, VM_INCOMPLETE if more lines are needed,
+ *   or VM_SYNTAX_ERROR (after printing a message).
+ */
+int vm_compile(const char* source, Program** program) {
+	parser p = {NULL, 0, NULL, NULL, 0};
+	*program = NULL;
+	if (lex(source, &p.tokens) == VM_INCOMPLETE) {
+		tsh_free(p.tokens);
+		return VM_INCOMPLETE;
+	}
+	p.program = tsh_calloc(MEM_PARSER, 1, sizeof(Program));
+	p.program->refs = 1;
+	if (parse_list(&p, false) && peek(&p)->type != TOKEN_END) fail(&p);
+	if (p.error == VM_SYNTAX_ERROR) {
+		Token* t = peek(&p);
+		fprintf(stderr, COLOR_RED "T-Shell: Syntax error near \'%.*s\'.\n" COLOR_RESET,
+		        t->type == TOKEN_NEWLINE ? 7 : (int) t->length, t->type == TOKEN_NEWLINE ? "newline" : t->text);
+	}
+	tsh_free(p.tokens);
+	if (p.error != 0) {
+		vm_free(p.program);
+		return p.error;
+	}
+	*program = p.program;
+	return 0;
+}
@@ -3,18 +3,38 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "allocator.h"
 #include "configuration.h"
+#include "segment.h"
 #include "strutil/strutil.h"
 #include "tsh.h"
 #include "data-structs/vector.h"
 
+/*
+ * Reads a size in bytes, optionally followed by K, M or G.
+ * Returns:
+ *   The size, or 0 if it is not one.
+ */
+static size_t parse_size(const char* text) {
+	char* end;
+	long long size = strtoll(text, &end, 10);
+	if (end == text || size < 0) return 0;
+	switch (*end) {
+		case 'G': size *= 1024; /* Falls through */
+		case 'M': size *= 1024; /* Falls through */
+		case 'K': size *= 1024; end++; break;
+		default: break;
+	}
+	return *end == ASCII_NULL ? (size_t) size : 0;
+}
+
 /*
  * Reads the T-Shell configuration file for any specified options.
  * Returns:
  *   A struct containing all the options set for T-Shell.
  */
 Configuration config_read(void) {
-	Configuration config = {false, ""};
+	Configuration config = {false, "", false, false, false, 0};
 	char* path = construct_path(".tsh-rc");
 	FILE* rc = fopen(path, "a+");
 	if (rc != NULL) {
@@ -24,19 +44,35 @@ Configuration config_read(void) {
 				if (strutil_contains(line, "COLORS=")) {
 					char* colors = strutil_substring(line, strutil_indexOf(line, '=')+1, strlen(line)-1);
 					if (!strcmp(colors, "ON")) config.colors = true;
-					free(colors);
+					tsh_free(colors);
+				} else if (strutil_contains(line, "SHARED=")) {
+					char* shared = strutil_substring(line, strutil_indexOf(line, '=')+1, strlen(line)-1);
+					if (!strcmp(shared, "ON")) config.shared = true;
+					tsh_free(shared);
+				} else if (strutil_contains(line, "EDITOR=")) {
+					char* editor = strutil_substring(line, strutil_indexOf(line, '=')+1, strlen(line)-1);
+					if (!strcmp(editor, "BUILTIN")) config.editor = true;
+					tsh_free(editor);
+				} else if (strutil_contains(line, "AUDIT=")) {
+					char* audit = strutil_substring(line, strutil_indexOf(line, '=')+1, strlen(line)-1);
+					if (!strcmp(audit, "ON")) config.audit = true;
+					tsh_free(audit);
+				} else if (strutil_contains(line, "CAPTURE=")) {
+					char* capture = strutil_substring(line, strutil_indexOf(line, '=')+1, strlen(line)-1);
+					config.capture = parse_size(capture);
+					tsh_free(capture);
 				} else if (strutil_contains(line, "PROMPT=")) {
 					char* prompt = strutil_substring(line, strutil_indexOf(line, '=')+1, strlen(line)-1);
 					strcpy(config.prompt, prompt);
 					strcat(config.prompt, "\0");
-					free(prompt);
+					tsh_free(prompt);
 				}
 			}
 		}
 		fclose(rc);
 	} else
 		fprintf(stderr, COLOR_RED "RC file not found.\nFile must be named \".tsh-rc\" and be in your home directory.\n" COLOR_RESET);
-	free(path);
+	tsh_free(path);
 	return config;
 }
 
@@ -53,7 +89,7 @@ char* config_build_prompt(Configuration* config) {
 	char promptb[strlen(config->prompt)];
 	strcpy(promptb, config->prompt);
 	int length = 0;
-	char* prompt = calloc(0, sizeof(char));
+	char* prompt = tsh_calloc(MEM_PROMPT, 1, sizeof(char));
 	unsigned int amount = 0;
 	char** pieces = strutil_split(promptb, "%", &amount);
 	for (size_t i = 0; i < amount; i++) { // For each token
@@ -66,73 +102,95 @@ char* config_build_prompt(Configuration* config) {
 			char* dir = getcwd(NULL, 0);
 			if (config->colors) {
 				length += COLOR_LENGTH+1;
-				prompt = realloc(prompt, length * sizeof(char));
+				prompt = tsh_realloc(MEM_PROMPT, prompt, length * sizeof(char));
 				strncat(prompt, COLOR_YELLOW, COLOR_LENGTH);
 				strncat(prompt, "\0", 1);
 			}
 			length += strlen(dir);
-			prompt = realloc(prompt, length * sizeof(char));
+			prompt = tsh_realloc(MEM_PROMPT, prompt, length * sizeof(char));
 			strncat(prompt, dir, strlen(dir));
 			if (config->colors) {
 				length += COLOR_LENGTH;
-				prompt = realloc(prompt, length * sizeof(char));
+				prompt = tsh_realloc(MEM_PROMPT, prompt, length * sizeof(char));
 				strncat(prompt, COLOR_RESET, strlen(COLOR_RESET));
 				strncat(prompt, "\0", 1);
 			}
 			length += strlen(pieces[i]+1)+1;
-			prompt = realloc(prompt, length * sizeof(char));
+			prompt = tsh_realloc(MEM_PROMPT, prompt, length * sizeof(char));
 			strncat(prompt, pieces[i]+1, strlen(pieces[i]+1));
 			strncat(prompt, "\0", 1);
-			free(dir);
+			free(dir); // From getcwd(), not the tsh allocator
 		} else if (first == 'U') { // Username
 			if (config->colors) {
 				length += COLOR_LENGTH+1;
-				prompt = realloc(prompt, length * sizeof(char));
+				prompt = tsh_realloc(MEM_PROMPT, prompt, length * sizeof(char));
 				strncat(prompt, COLOR_CYAN, strlen(COLOR_CYAN));
 				strncat(prompt, "\0", 1);
 			}
 			length += strlen(getenv("USER"))+1;
-			prompt = realloc(prompt, length * sizeof(char));
+			prompt = tsh_realloc(MEM_PROMPT, prompt, length * sizeof(char));
 			strncat(prompt, getenv("USER"), strlen(getenv("USER")));
 			strncat(prompt, "\0", 1);
 			if (config->colors) {
 				length += COLOR_LENGTH;
-				prompt = realloc(prompt, length * sizeof(char));
+				prompt = tsh_realloc(MEM_PROMPT, prompt, length * sizeof(char));
 				strncat(prompt, COLOR_RESET, strlen(COLOR_RESET));
 				strncat(prompt, "\0", 1);
 			}
 			length += strlen(pieces[i]+1)+1;
-			prompt = realloc(prompt, length * sizeof(char));
+			prompt = tsh_realloc(MEM_PROMPT, prompt, length * sizeof(char));
 			strncat(prompt, pieces[i]+1, strlen(pieces[i]+1));
 			strncat(prompt, "\0", 1);
 		} else if (first == 'H') { // Hostname
 			if (config->colors) {
 				length += COLOR_LENGTH+1;
-				prompt = realloc(prompt, length * sizeof(char));
+				prompt = tsh_realloc(MEM_PROMPT, prompt, length * sizeof(char));
 				strncat(prompt, COLOR_MAGENTA, strlen(COLOR_MAGENTA));
 				strncat(prompt, "\0", 1);
 			}
 			length += strlen(getenv("HOSTNAME"))+1;
-			prompt = realloc(prompt, length * sizeof(char));
+			prompt = tsh_realloc(MEM_PROMPT, prompt, length * sizeof(char));
 			strncat(prompt, getenv("HOSTNAME"), strlen(getenv("HOSTNAME")));
 			strncat(prompt, "\0", 1);
 			if (config->colors) {
 				length += COLOR_LENGTH;
-				prompt = realloc(prompt, length * sizeof(char));
+				prompt = tsh_realloc(MEM_PROMPT, prompt, length * sizeof(char));
+				strncat(prompt, COLOR_RESET, strlen(COLOR_RESET));
+				strncat(prompt, "\0", 1);
+			}
+			length += strlen(pieces[i]+1)+1;
+			prompt = tsh_realloc(MEM_PROMPT, prompt, length * sizeof(char));
+			strncat(prompt, pieces[i]+1, strlen(pieces[i]+1));
+			strncat(prompt, "\0", 1);
+		} else if (first != ASCII_NULL && segment_exists(first)) { // Computed in the background
+			const char* value = segment_value(first);
+			if (config->colors && value[0] != ASCII_NULL) {
+				length += COLOR_LENGTH+1;
+				prompt = tsh_realloc(MEM_PROMPT, prompt, length * sizeof(char));
+				strncat(prompt, COLOR_GREEN, strlen(COLOR_GREEN));
+				strncat(prompt, "\0", 1);
+			}
+			length += strlen(value)+1;
+			prompt = tsh_realloc(MEM_PROMPT, prompt, length * sizeof(char));
+			strncat(prompt, value, strlen(value));
+			strncat(prompt, "\0", 1);
+			if (config->colors && value[0] != ASCII_NULL) {
+				length += COLOR_LENGTH;
+				prompt = tsh_realloc(MEM_PROMPT, prompt, length * sizeof(char));
 				strncat(prompt, COLOR_RESET, strlen(COLOR_RESET));
 				strncat(prompt, "\0", 1);
 			}
 			length += strlen(pieces[i]+1)+1;
-			prompt = realloc(prompt, length * sizeof(char));
+			prompt = tsh_realloc(MEM_PROMPT, prompt, length * sizeof(char));
 			strncat(prompt, pieces[i]+1, strlen(pieces[i]+1));
 			strncat(prompt, "\0", 1);
 		} else {
 			length += strlen(pieces[i])+1;
-			prompt = realloc(prompt, length * sizeof(char));
+			prompt = tsh_realloc(MEM_PROMPT, prompt, length * sizeof(char));
 			strncat(prompt, pieces[i], strlen(pieces[i]));
 			strncat(prompt, "\0", 1);
 		}
 	}
-	free(pieces);
+	tsh_free(pieces);
 	return prompt;
 }
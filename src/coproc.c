@@ -0,0 +1,266 @@
+// Standard: gnu99
+
+#define _GNU_SOURCE
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "allocator.h"
+#include "coproc.h"
+#include "intern.h"
+#include "launch.h"
+#include "tsh.h"
+#include "data-structs/vector.h"
+
+#define COPROC_GRACE_MS	100	// How long 'coproc -k' waits after EOF before SIGTERM.
+
+/*
+ * A coprocess is a program started once with a pipe on each end and left
+ * running. '>&NAME' makes a command's Standard Output the coprocess's
+ * input and '<&NAME' makes its Standard Input the coprocess's output, so
+ * each query reuses the one process. The shell keeps its ends of the
+ * pipes close-on-exec, so only commands redirected to a coprocess hold
+ * them, and closing the input (coproc -k, or exit) lets it see EOF.
+ */
+typedef struct coproc_entry {
+	const char* name;	// Interned, compared by address; NULL if the slot is free.
+	char* command;   	// The command line, for listing.
+	pid_t pid;
+	int input;       	// Writes to the coprocess's Standard Input, -1 once closed.
+	int output;      	// Reads its Standard Output.
+	bool running;
+	int status;      	// Exit status, once it is not running.
+} coproc_entry;
+
+static coproc_entry table[COPROC_MAX];
+
+static coproc_entry* find(const char* name) {
+	const char* interned = intern_find(name);
+	if (interned == NULL) return NULL; // Never named, and NULL marks a free slot
+	for (int i = 0; i < COPROC_MAX; i++)
+		if (table[i].name == interned) return &table[i];
+	return NULL;
+}
+
+/*
+ * Forgets a coprocess, closing the shell's ends of its pipes.
+ */
+static void release(coproc_entry* entry) {
+	if (entry->input != -1) close(entry->input);
+	if (entry->output != -1) close(entry->output);
+	tsh_free(entry->command);
+	*entry = (coproc_entry) {NULL, NULL, -1, -1, -1, false, 0};
+}
+
+/*
+ * Records how a process ended, if it is a coprocess. Call for every
+ * child reaped outside wait_for().
+ */
+void coproc_exited(pid_t pid, int status) {
+	for (int i = 0; i < COPROC_MAX; i++)
+		if (table[i].name != NULL && table[i].running && table[i].pid == pid) {
+			table[i].running = false;
+			table[i].status = WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+		}
+}
+
+/*
+ * Catches coprocesses that ended while nothing was reaping children
+ * (e.g. input from a file, or while a command ran).
+ */
+static void poll_exits(void) {
+	for (int i = 0; i < COPROC_MAX; i++) {
+		int status;
+		if (table[i].name != NULL && table[i].running && waitpid(table[i].pid, &status, WNOHANG) == table[i].pid)
+			coproc_exited(table[i].pid, status);
+	}
+}
+
+static int list(void) {
+	poll_exits();
+	for (int i = 0; i < COPROC_MAX; i++) {
+		if (table[i].name == NULL) continue;
+		if (table[i].running) printf("%-12s %7d  running    %s\n", table[i].name, table[i].pid, table[i].command);
+		else printf("%-12s %7d  exited %-3d %s\n", table[i].name, table[i].pid, table[i].status, table[i].command);
+	}
+	return EXIT_SUCCESS;
+}
+
+/*
+ * Ends a coprocess: closes its input so it can finish on its own, then
+ * sends SIGTERM if it has not within COPROC_GRACE_MS.
+ */
+static int end(const char* name) {
+	coproc_entry* entry = find(name);
+	if (entry == NULL) {
+		fprintf(stderr, COLOR_RED "T-Shell: coproc: %s: No such coprocess.\n" COLOR_RESET, name);
+		return EXIT_FAILURE;
+	}
+	close(entry->input);
+	entry->input = -1;
+	struct timespec pause = {0, 1000000};
+	for (int waited = 0; entry->running && waited < COPROC_GRACE_MS; waited++) {
+		poll_exits();
+		if (entry->running) nanosleep(&pause, NULL);
+	}
+	if (entry->running) {
+		kill(entry->pid, SIGTERM);
+		int status;
+		if (waitpid(entry->pid, &status, 0) == entry->pid) coproc_exited(entry->pid, status);
+	}
+	int status = entry->status;
+	release(entry);
+	return status;
+}
+
+/*
+ * Starts a coprocess.
+ */
+static int start(const char* name, Vector* tokens) {
+	poll_exits();
+	coproc_entry* entry = find(name);
+	if (entry != NULL && entry->running) {
+		fprintf(stderr, COLOR_RED "T-Shell: coproc: %s: Already running (coproc -k %s ends it).\n" COLOR_RESET, name, name);
+		return EXIT_FAILURE;
+	}
+	if (entry != NULL) release(entry); // Finished; its name is free again
+	for (int i = 0; i < COPROC_MAX && entry == NULL; i++)
+		if (table[i].name == NULL) entry = &table[i];
+	if (entry == NULL) {
+		fprintf(stderr, COLOR_RED "T-Shell: coproc: Too many coprocesses (at most %d).\n" COLOR_RESET, COPROC_MAX);
+		return EXIT_FAILURE;
+	}
+	int toChild[2], fromChild[2];
+	if (pipe2(toChild, O_CLOEXEC)) {
+		perror("T-Shell: coproc");
+		return EXIT_FAILURE;
+	}
+	if (pipe2(fromChild, O_CLOEXEC)) {
+		perror("T-Shell: coproc");
+		close(toChild[0]);
+		close(toChild[1]);
+		return EXIT_FAILURE;
+	}
+	char* argv[tokens->size-1];
+	for (unsigned int i = 2; i < tokens->size; i++)
+		argv[i-2] = vector_get(tokens, i);
+	argv[tokens->size-2] = NULL;
+	fflush(stdout);
+	pid_t pid = fork();
+	if (pid == 0) {
+		setpgid(0, 0); // Ctrl-C at the prompt is not meant for it
+		dup2(toChild[0], STDIN_FILENO);
+		dup2(fromChild[1], STDOUT_FILENO);
+		launch_apply();
+		execvp(argv[0], argv);
+		fprintf(stderr, COLOR_RED "T-Shell: coproc: \'%s\' is not a recognized command...\n" COLOR_RESET, argv[0]);
+		_exit(127);
+	}
+	close(toChild[0]);
+	close(fromChild[1]);
+	if (pid == -1) {
+		perror("T-Shell: coproc");
+		close(toChild[1]);
+		close(fromChild[0]);
+		return EXIT_FAILURE;
+	}
+	setpgid(pid, pid); // Whichever of the two runs first
+	size_t length = 0;
+	for (unsigned int i = 2; i < tokens->size; i++) length += strlen(vector_get(tokens, i)) + 1;
+	char* command = tsh_calloc(MEM_SHELL, length, sizeof(char));
+	for (unsigned int i = 2; i < tokens->size; i++) {
+		if (i > 2) strcat(command, " ");
+		strcat(command, vector_get(tokens, i));
+	}
+	*entry = (coproc_entry) {intern(name), command, pid, toChild[1], fromChild[0], true, 0};
+	return EXIT_SUCCESS;
+}
+
+/*
+ * The 'coproc' builtin.
+ * Argument(s):
+ *   Vector* tokens: 'coproc NAME cmd [args]' starts one, 'coproc -k NAME'
+ *                   ends one, and 'coproc' alone lists them.
+ * Returns:
+ *   The exit status of the builtin, or of the coprocess ended.
+ */
+int coproc_run(Vector* tokens) {
+	if (tokens->size == 1) return list();
+	const char* first = vector_get(tokens, 1);
+	if (!strcmp(first, "-k") && tokens->size == 3) return end(vector_get(tokens, 2));
+	if (tokens->size < 3 || first[0] == '-' || isdigit((unsigned char) first[0])) {
+		fprintf(stderr, COLOR_RED "T-Shell: coproc: Usage: coproc NAME cmd [args] | coproc -k NAME | coproc\n" COLOR_RESET);
+		return EXIT_FAILURE;
+	}
+	return start(first, tokens);
+}
+
+/*
+ * Connects a command to coprocesses named by '>&NAME' (its Standard
+ * Output goes to the coprocess) and '<&NAME' (its Standard Input comes
+ * from the coprocess), taking those words out of the command. The
+ * shell's own descriptors are switched, so builtins and children alike
+ * see the coprocess; coproc_restore() switches them back.
+ * Argument(s):
+ *   Vector* tokens: the command's words.
+ *   bool* quoted: whether each word was quoted, kept in step, or NULL.
+ *   int saved[2]: receives copies of the Standard Input and Output, or -1.
+ * Returns:
+ *   false, after printing why, if a name is not a coprocess.
+ */
+bool coproc_redirect(Vector* tokens, bool* quoted, int saved[2]) {
+	saved[STDIN_FILENO] = saved[STDOUT_FILENO] = -1;
+	for (unsigned int i = 1; i < tokens->size; ) {
+		const char* word = vector_get(tokens, i);
+		if ((word[0] != '>' && word[0] != '<') || word[1] != '&' || word[2] == ASCII_NULL || isdigit((unsigned char) word[2]) ||
+		    (quoted != NULL && quoted[i])) {
+			i++;
+			continue;
+		}
+		coproc_entry* entry = find(word+2);
+		int target = word[0] == '>' ? STDOUT_FILENO : STDIN_FILENO;
+		int fd = entry == NULL ? -1 : target == STDOUT_FILENO ? entry->input : entry->output;
+		if (fd == -1) {
+			fprintf(stderr, COLOR_RED "T-Shell: %s: No such coprocess%s.\n" COLOR_RESET, word+2, entry != NULL ? " input" : "");
+			coproc_restore(saved);
+			return false;
+		}
+		if (saved[target] == -1) {
+			if (target == STDOUT_FILENO) fflush(stdout);
+			saved[target] = fcntl(target, F_DUPFD_CLOEXEC, 10);
+		}
+		dup2(fd, target); // Not close-on-exec, so the command inherits it
+		vector_delete(tokens, i);
+		if (quoted != NULL) memmove(quoted+i, quoted+i+1, (tokens->size-i) * sizeof(bool));
+	}
+	return true;
+}
+
+/*
+ * Puts back the Standard Input and Output after coproc_redirect().
+ */
+void coproc_restore(int saved[2]) {
+	for (int target = STDIN_FILENO; target <= STDOUT_FILENO; target++) {
+		if (saved[target] == -1) continue;
+		if (target == STDOUT_FILENO) fflush(stdout);
+		dup2(saved[target], target);
+		close(saved[target]);
+		saved[target] = -1;
+	}
+}
+
+/*
+ * Closes every coprocess's pipes so they see EOF, at exit.
+ */
+void coproc_free(void) {
+	for (int i = 0; i < COPROC_MAX; i++)
+		if (table[i].name != NULL) release(&table[i]);
+}
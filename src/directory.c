@@ -0,0 +1,402 @@
+// Standard: gnu99
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "allocator.h"
+#include "audit.h"
+#include "directory.h"
+#include "tsh.h"
+#include "data-structs/vector.h"
+
+#define DIRECTORY_MAGIC	0x32524454	// "TDR2"
+
+/*
+ * '~/.tsh-dirs' holds the header, then a fixed array of index slots,
+ * then the paths. Searches only walk the small index, and read a path
+ * once its character masks show it could match.
+ */
+typedef struct directory_header {
+	uint32_t magic;    	// DIRECTORY_MAGIC.
+	uint32_t slots;    	// Capacity of the index.
+	uint32_t count;    	// Slots in use.
+	uint32_t heapUsed; 	// Bytes of paths in use.
+	uint64_t capacity; 	// Size of the file.
+	uint64_t total;    	// Sum of all visit counts.
+} directory_header;
+
+typedef struct directory_entry {
+	uint64_t chars; 	// Characters in the path, ignoring case.
+	uint64_t pairs; 	// Adjacent pairs of characters in the path, ignoring case.
+	uint32_t last;  	// When the directory was last visited.
+	uint32_t visits;	// How often it was visited, 0 once it is known to be gone.
+	uint32_t offset;	// Where the path starts in the heap, followed by a lower case copy.
+	uint32_t length;	// Length of the path.
+} directory_entry;
+
+#define INDEX()	((directory_entry*) ((char*) db + sizeof(directory_header)))
+#define HEAP() 	((char*) (INDEX() + db->slots))
+#define HEAP_CAPACITY()	(db->capacity - (HEAP() - (char*) db))
+
+typedef struct candidate {
+	double score;
+	directory_entry* entry;
+} candidate;
+
+static int dbfd = -1;              	// '~/.tsh-dirs', -1 if unavailable.
+static directory_header* db = NULL;	// The mapped database.
+static size_t mapped = 0;          	// How much of it is mapped.
+static Vector stack;               	// Directories saved by 'pushd', the top first.
+
+/*
+ * Maps the database at the given size, replacing the current mapping.
+ */
+static bool remap(size_t size) {
+	if (size == mapped) return true;
+	void* area = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, dbfd, 0);
+	if (area == MAP_FAILED) return false;
+	if (db != NULL) munmap(db, mapped);
+	db = area;
+	mapped = size;
+	return true;
+}
+
+/*
+ * Locks the database, picking up growth by other shells.
+ * Argument(s):
+ *   int operation: LOCK_SH to read, LOCK_EX to write.
+ * Returns:
+ *   true if the database can be used.
+ */
+static bool lock(int operation) {
+	if (dbfd == -1) return false;
+	flock(dbfd, operation);
+	if (remap(db->capacity)) return true;
+	flock(dbfd, LOCK_UN);
+	return false;
+}
+
+static void unlock(void) {
+	flock(dbfd, LOCK_UN);
+}
+
+static unsigned char fold(unsigned char c) {
+	return c >= 'A' && c <= 'Z' ? c + 'a' - 'A' : c;
+}
+
+/*
+ * Summarizes which characters, and which adjacent pairs of characters,
+ * occur in a string. A word can only be in a path whose masks cover its own.
+ */
+static void mask_of(const char* text, size_t length, uint64_t* chars, uint64_t* pairs) {
+	for (size_t i = 0; i < length; i++) {
+		unsigned char c = fold(text[i]);
+		*chars |= 1ULL << (c % 64);
+		if (i > 0) *pairs |= 1ULL << ((fold(text[i-1]) * 31 + c) % 64);
+	}
+}
+
+/*
+ * Weighs visit counts by how recently the directory was visited.
+ */
+static double score(directory_entry* entry, time_t now) {
+	time_t age = now - entry->last;
+	if (age < 3600) return entry->visits * 4.0;
+	if (age < 86400) return entry->visits * 2.0;
+	if (age < 604800) return entry->visits * 0.5;
+	return entry->visits * 0.25;
+}
+
+/*
+ * Scales every count down once the total gets too large, dropping
+ * directories that were rarely visited or are gone. Called locked.
+ */
+static void age(void) {
+	uint32_t kept = 0;
+	uint32_t heapUsed = 0;
+	db->total = 0;
+	for (uint32_t i = 0; i < db->count; i++) { // Paths are in index order, so both compact in one pass
+		directory_entry entry = INDEX()[i];
+		entry.visits = entry.visits * 9 / 10;
+		if (entry.visits == 0) continue;
+		memmove(HEAP() + heapUsed, HEAP() + entry.offset, 2*(entry.length+1));
+		entry.offset = heapUsed;
+		heapUsed += 2*(entry.length+1);
+		INDEX()[kept++] = entry;
+		db->total += entry.visits;
+	}
+	db->count = kept;
+	db->heapUsed = heapUsed;
+}
+
+/*
+ * Makes room for one more entry, growing the file if needed. Called locked.
+ * Returns:
+ *   true if there is room.
+ */
+static bool reserve(size_t length) {
+	uint32_t slots = db->slots;
+	size_t heapCapacity = HEAP_CAPACITY();
+	while (db->count >= slots) slots *= 2;
+	while (db->heapUsed + 2*(length+1) > heapCapacity) heapCapacity *= 2;
+	if (slots == db->slots && heapCapacity == HEAP_CAPACITY()) return true;
+	size_t capacity = sizeof(directory_header) + slots * sizeof(directory_entry) + heapCapacity;
+	if (capacity > UINT32_MAX || ftruncate(dbfd, capacity) || !remap(capacity)) return false;
+	memmove((char*) (INDEX() + slots), HEAP(), db->heapUsed); // The index grows into the old heap
+	db->slots = slots;
+	db->capacity = capacity;
+	return true;
+}
+
+/*
+ * Opens '~/.tsh-dirs', creating it if needed. Directory jumping is
+ * quietly disabled if the file cannot be used.
+ */
+void directory_init(void) {
+	stack = vector_init(0);
+	char* path = construct_path(".tsh-dirs");
+	dbfd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	tsh_free(path);
+	if (dbfd == -1) return;
+	flock(dbfd, LOCK_EX);
+	struct stat info;
+	bool valid = !fstat(dbfd, &info) && (size_t) info.st_size >= sizeof(directory_header) && remap(info.st_size) &&
+	             db->magic == DIRECTORY_MAGIC && db->capacity == (uint64_t) info.st_size &&
+	             db->count <= db->slots && (char*) (INDEX() + db->slots) <= (char*) db + db->capacity &&
+	             db->heapUsed <= HEAP_CAPACITY();
+	if (!valid && (ftruncate(dbfd, 0) || ftruncate(dbfd, DIRECTORY_INITIAL_SIZE) || !remap(DIRECTORY_INITIAL_SIZE))) {
+		flock(dbfd, LOCK_UN);
+		close(dbfd);
+		dbfd = -1;
+		return;
+	} else if (!valid) { // New, or not something we wrote
+		db->magic = DIRECTORY_MAGIC;
+		db->slots = DIRECTORY_INITIAL_SIZE / 2 / sizeof(directory_entry); // Half index, half paths
+		db->capacity = DIRECTORY_INITIAL_SIZE;
+	}
+	flock(dbfd, LOCK_UN);
+}
+
+/*
+ * Records a visit to the current working directory.
+ */
+void directory_visit(void) {
+	audit_moved(); // Its copy of the directory is stale
+	char* cwd = getcwd(NULL, 0);
+	if (cwd == NULL || !lock(LOCK_EX)) {
+		free(cwd);
+		return;
+	}
+	size_t length = strlen(cwd);
+	uint64_t chars = 0, pairs = 0;
+	mask_of(cwd, length, &chars, &pairs);
+	db->total++;
+	uint32_t i;
+	for (i = 0; i < db->count; i++) {
+		directory_entry* entry = &INDEX()[i];
+		if (entry->pairs == pairs && entry->length == length && !memcmp(HEAP() + entry->offset, cwd, length)) {
+			entry->visits++;
+			entry->last = time(NULL);
+			break;
+		}
+	}
+	if (i == db->count && reserve(length)) { // First visit
+		INDEX()[db->count++] = (directory_entry) {chars, pairs, time(NULL), 1, db->heapUsed, length};
+		char* path = HEAP() + db->heapUsed;
+		memcpy(path, cwd, length+1);
+		for (size_t j = 0; j <= length; j++) path[length+1+j] = fold(cwd[j]); // Searched by strstr()
+		db->heapUsed += 2*(length+1);
+	}
+	if (db->total > DIRECTORY_AGING_LIMIT) age();
+	unlock();
+	free(cwd);
+}
+
+/*
+ * Checks that every word occurs in the path, in order.
+ * Argument(s):
+ *   const char* path: the path, or its lower case copy.
+ *   Vector* tokens: the command; the words start at 'first'.
+ *   unsigned int first: index of the first word.
+ */
+static bool matches(const char* path, Vector* tokens, unsigned int first) {
+	for (unsigned int i = first; i < tokens->size; i++) {
+		const char* found = strstr(path, vector_get(tokens, i));
+		if (found == NULL) return false;
+		path = found + strlen(vector_get(tokens, i));
+	}
+	return true;
+}
+
+/*
+ * Finds the directories matching the words. Called locked.
+ * Argument(s):
+ *   Vector* tokens: the command; the words start at 'first'.
+ *   unsigned int first: index of the first word.
+ *   candidate* best: receives the highest ranked match.
+ *   candidate** found: receives every match, unless NULL.
+ * Memory Management:
+ *   Free '*found' when done; the entries point into the database.
+ * Returns:
+ *   The number of matches, or without 'found', of those that took the lead.
+ */
+static unsigned int search(Vector* tokens, unsigned int first, candidate* best, candidate** found) {
+	uint64_t chars = 0, pairs = 0;
+	bool exact = false; // Any capitals make the search case-sensitive
+	for (unsigned int i = first; i < tokens->size; i++) {
+		const char* word = vector_get(tokens, i);
+		mask_of(word, strlen(word), &chars, &pairs);
+		for (const char* c = word; *c != ASCII_NULL; c++) exact |= *c >= 'A' && *c <= 'Z';
+	}
+	time_t now = time(NULL);
+	unsigned int count = 0;
+	*best = (candidate) {-1, NULL};
+	for (uint32_t i = 0; i < db->count; i++) {
+		directory_entry* entry = &INDEX()[i];
+		if (entry->visits == 0 || (entry->chars & chars) != chars || (entry->pairs & pairs) != pairs) continue;
+		candidate match = {score(entry, now), entry};
+		if (found == NULL && match.score <= best->score) continue; // Could not win, so why search it
+		if (!matches(HEAP() + entry->offset + (exact ? 0 : entry->length+1), tokens, first)) continue;
+		if (match.score > best->score) *best = match;
+		if (found != NULL) {
+			*found = tsh_realloc(MEM_SHELL, *found, (count+1) * sizeof(candidate));
+			(*found)[count] = match;
+		}
+		count++;
+	}
+	return count;
+}
+
+static int by_score(const void* a, const void* b) {
+	double difference = ((const candidate*) a)->score - ((const candidate*) b)->score;
+	return (difference > 0) - (difference < 0);
+}
+
+/*
+ * The 'z' builtin: changes to the highest ranked directory matching
+ * every word, or lists the matches (lowest first) given '-l' or no words.
+ * Argument(s):
+ *   Vector* tokens: the command and its arguments.
+ * Returns:
+ *   0 on success, 1 if nothing matched.
+ */
+int directory_jump(Vector* tokens) {
+	bool list = tokens->size == 1 || !strcmp(vector_get(tokens, 1), "-l");
+	unsigned int first = tokens->size > 1 && list ? 2 : 1;
+	if (!lock(list ? LOCK_SH : LOCK_EX)) {
+		printf(COLOR_RED "T-Shell: z: No directory database.\n" COLOR_RESET);
+		return EXIT_FAILURE;
+	}
+	candidate best;
+	if (list) {
+		candidate* found = NULL;
+		unsigned int count = search(tokens, first, &best, &found);
+		qsort(found, count, sizeof(candidate), by_score);
+		for (unsigned int i = 0; i < count; i++)
+			printf("%-10.1f %s\n", found[i].score, HEAP() + found[i].entry->offset);
+		tsh_free(found);
+		unlock();
+		return count > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	bool jumped = false;
+	while (!jumped && search(tokens, first, &best, NULL) > 0)
+		if (!(jumped = !chdir(HEAP() + best.entry->offset))) best.entry->visits = 0; // Gone, try the next
+	unlock();
+	if (!jumped) {
+		printf(COLOR_RED "T-Shell: z: No matching directory.\n" COLOR_RESET);
+		return EXIT_FAILURE;
+	}
+	directory_visit();
+	return EXIT_SUCCESS;
+}
+
+/*
+ * The 'dirs' builtin: prints the current directory, then the stack.
+ */
+int directory_print(Vector* tokens) {
+	(void) tokens;
+	char* cwd = getcwd(NULL, 0);
+	printf("%s", cwd != NULL ? cwd : "?");
+	free(cwd);
+	for (unsigned int i = 0; i < stack.size; i++)
+		printf(" %s", (char*) vector_get(&stack, i));
+	puts("");
+	return EXIT_SUCCESS;
+}
+
+/*
+ * The 'pushd' builtin: saves the current directory and changes to the
+ * given one, or swaps with the top of the stack when given none.
+ */
+int directory_push(Vector* tokens) {
+	if (tokens->size > 2) {
+		printf(COLOR_RED "T-Shell: pushd: Too many arguments.\n" COLOR_RESET);
+		return EXIT_FAILURE;
+	} else if (tokens->size == 1 && stack.size == 0) {
+		printf(COLOR_RED "T-Shell: pushd: No other directory.\n" COLOR_RESET);
+		return EXIT_FAILURE;
+	}
+	char* cwd = getcwd(NULL, 0);
+	if (cwd == NULL) {
+		perror(COLOR_RED "T-Shell: pushd");
+		printf(COLOR_RESET);
+		return EXIT_FAILURE;
+	}
+	char* target = tokens->size == 2 ? vector_get(tokens, 1) : vector_get(&stack, 0);
+	if (chdir(target)) {
+		perror(COLOR_RED "T-Shell: pushd");
+		printf(COLOR_RESET);
+		free(cwd);
+		return EXIT_FAILURE;
+	}
+	char* saved = tsh_calloc(MEM_SHELL, strlen(cwd)+1, sizeof(char));
+	strcpy(saved, cwd);
+	free(cwd);
+	if (tokens->size == 1) { // Swap
+		tsh_free(vector_get(&stack, 0));
+		vector_set(&stack, 0, saved);
+	} else vector_add(&stack, 0, saved);
+	directory_visit();
+	return directory_print(tokens);
+}
+
+/*
+ * The 'popd' builtin: changes to the directory on top of the stack and
+ * removes it.
+ */
+int directory_pop(Vector* tokens) {
+	if (stack.size == 0) {
+		printf(COLOR_RED "T-Shell: popd: Directory stack empty.\n" COLOR_RESET);
+		return EXIT_FAILURE;
+	}
+	char* top = vector_get(&stack, 0);
+	if (chdir(top)) {
+		perror(COLOR_RED "T-Shell: popd");
+		printf(COLOR_RESET);
+		return EXIT_FAILURE;
+	}
+	vector_delete(&stack, 0);
+	tsh_free(top);
+	directory_visit();
+	return directory_print(tokens);
+}
+
+/*
+ * Releases the directory stack and the database mapping.
+ */
+void directory_free(void) {
+	for (unsigned int i = 0; i < stack.size; i++)
+		tsh_free(vector_get(&stack, i));
+	tsh_free(stack.array);
+	if (db != NULL) munmap(db, mapped);
+	if (dbfd != -1) close(dbfd);
+}
@@ -0,0 +1,702 @@
+// Standard: gnu99
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <readline/history.h>
+
+#include "allocator.h"
+#include "editor.h"
+#include "tsh.h"
+#include "data-structs/vector.h"
+
+#define LATENCY_BUCKETS	32	// Powers of two of microseconds.
+#define PASTE_END      	"\x1b[201~"	// Ends a bracketed paste, which starts with ESC [200~.
+#define PASTE_END_SIZE 	6
+
+#define CONTROL(c)	((c) & 0x1f)
+
+typedef enum key {
+	KEY_TEXT = 256,	// A run of printable characters
+	KEY_UP,
+	KEY_DOWN,
+	KEY_LEFT,
+	KEY_RIGHT,
+	KEY_HOME,
+	KEY_END,
+	KEY_DELETE,
+	KEY_WORD_LEFT, 	// Alt-b, Ctrl-Left
+	KEY_WORD_RIGHT,	// Alt-f, Ctrl-Right
+	KEY_KILL_WORD, 	// Alt-d
+	KEY_RUBOUT_WORD,	// Alt-Backspace
+	KEY_PASTE,     	// Start of a bracketed paste
+	KEY_IGNORED
+} Key;
+
+typedef struct buffer {
+	char* data;
+	size_t length;
+	size_t capacity;
+} buffer;
+
+static struct termios original;    	// Terminal settings to restore.
+static bool raw = false;           	// The terminal is in raw mode.
+static EditorHandler handler = NULL;	// Receives finished lines.
+static EditorCompleter completer = editor_complete_files;
+static char* prompt = NULL;        	// The prompt, as given.
+static size_t promptWidth = 0;     	// Columns taken by the prompt's last line.
+static size_t promptRows = 0;      	// Lines of the prompt above its last.
+static size_t columns = 80;        	// Width of the terminal.
+static buffer line;                	// The line being edited.
+static size_t cursor = 0;          	// Byte offset of the cursor in 'line'.
+static buffer shown;               	// What the terminal shows after the prompt.
+static size_t terminalColumn = 0;  	// Where the terminal's cursor is, in columns after the prompt.
+static buffer killed;              	// Text removed by the kill commands, for Ctrl-Y.
+static buffer saved;               	// The new line, while browsing History.
+static int historyIndex = 0;       	// Position in History, history_length for the new line.
+static int lastKey = 0;            	// The previous key, so a second Tab lists matches.
+static char pending[EDITOR_INPUT_SIZE];	// Input not yet decoded (e.g. half an escape sequence).
+static size_t pendingLength = 0;
+static buffer output;              	// Terminal output, written once per read.
+static bool pasting = false;       	// Inside a bracketed paste.
+static buffer pasted;              	// What has been pasted so far.
+
+static size_t keystrokes = 0;      	// Reads handled.
+static uint64_t latencyTotal = 0;  	// Nanoseconds from read to rendered, summed.
+static uint64_t latencyMax = 0;
+static size_t latencies[LATENCY_BUCKETS];	// Histogram of the latencies.
+static size_t bytesDrawn = 0;      	// Bytes written to the terminal.
+
+static void reserve(buffer* b, size_t length) {
+	if (length+1 <= b->capacity) return;
+	b->capacity = (length+1) * 2;
+	b->data = tsh_realloc(MEM_EDITOR, b->data, b->capacity);
+}
+
+static void set(buffer* b, const char* text, size_t length) {
+	reserve(b, length);
+	memcpy(b->data, text, length);
+	b->data[b->length = length] = ASCII_NULL;
+}
+
+static void emit(const char* text, size_t length) {
+	reserve(&output, output.length+length);
+	memcpy(output.data+output.length, text, length);
+	output.length += length;
+}
+
+static void emitf(const char* format, size_t number) {
+	char sequence[32];
+	emit(sequence, snprintf(sequence, sizeof(sequence), format, number));
+}
+
+static void flush(void) {
+	size_t written = 0;
+	while (written < output.length) {
+		ssize_t count = write(STDOUT_FILENO, output.data+written, output.length-written);
+		if (count == -1 && errno == EINTR) continue;
+		if (count <= 0) break;
+		written += count;
+	}
+	bytesDrawn += written;
+	output.length = 0;
+}
+
+/*
+ * Counts the columns taken by text, skipping UTF-8 continuation bytes.
+ */
+static size_t width_of(const char* text, size_t length) {
+	size_t width = 0;
+	for (size_t i = 0; i < length; i++)
+		width += ((unsigned char) text[i] & 0xC0) != 0x80;
+	return width;
+}
+
+/*
+ * Measures the prompt's last line, skipping escape sequences and
+ * control characters, and counts the lines above it.
+ */
+static void measure_prompt(void) {
+	promptWidth = promptRows = 0;
+	for (const char* c = prompt; *c != ASCII_NULL; c++) {
+		if (*c == ASCII_ESCAPE && c[1] == '[') { // SGR and friends
+			for (c += 2; *c != ASCII_NULL && !(*c >= 0x40 && *c <= 0x7e); c++);
+			if (*c == ASCII_NULL) break;
+		} else if (*c == ASCII_NEWLINE) {
+			promptRows++;
+			promptWidth = 0;
+		} else if ((unsigned char) *c >= 0x20 && ((unsigned char) *c & 0xC0) != 0x80) promptWidth++;
+	}
+}
+
+static void query_columns(void) {
+	struct winsize size;
+	columns = !ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) && size.ws_col > 0 ? size.ws_col : 80;
+}
+
+/*
+ * Moves the terminal's cursor between two columns of the line, which
+ * may be on different rows once the line wraps.
+ */
+static void move_to(size_t from, size_t to) {
+	size_t fromRow = (promptWidth+from) / columns, fromColumn = (promptWidth+from) % columns;
+	size_t toRow = (promptWidth+to) / columns, toColumn = (promptWidth+to) % columns;
+	if (toRow < fromRow) emitf("\x1b[%zuA", fromRow-toRow);
+	else if (toRow > fromRow) emitf("\x1b[%zuB", toRow-fromRow);
+	if (toColumn == 0 && fromColumn != 0) emit("\r", 1);
+	else if (toColumn > fromColumn) emitf("\x1b[%zuC", toColumn-fromColumn);
+	else if (toColumn < fromColumn) emitf("\x1b[%zuD", fromColumn-toColumn);
+}
+
+/*
+ * Brings the terminal up to date with the line, rewriting only what
+ * changed since the last refresh: from the first differing character
+ * to the end of the line, then clearing any leftover text.
+ */
+static void refresh(void) {
+	size_t same = 0;
+	while (same < line.length && same < shown.length && line.data[same] == shown.data[same]) same++;
+	while (same > 0 && ((unsigned char) line.data[same] & 0xC0) == 0x80) same--; // Whole characters only
+	if (same < line.length || same < shown.length) {
+		size_t lineWidth = width_of(line.data, line.length);
+		move_to(terminalColumn, width_of(line.data, same));
+		emit(line.data+same, line.length-same);
+		terminalColumn = lineWidth;
+		if (lineWidth > 0 && (promptWidth+lineWidth) % columns == 0) emit(" \r", 2); // Wrap now, not on the next character
+		if (same < shown.length && width_of(shown.data, shown.length) > lineWidth) emit("\x1b[J", 3);
+		set(&shown, line.data, line.length);
+	}
+	size_t cursorWidth = width_of(line.data, cursor);
+	move_to(terminalColumn, cursorWidth);
+	terminalColumn = cursorWidth;
+}
+
+/*
+ * Draws the prompt and line from scratch, from the start of the prompt.
+ */
+static void redraw(void) {
+	move_to(terminalColumn, 0);
+	emit("\r", 1);
+	if (promptRows > 0) emitf("\x1b[%zuA", promptRows);
+	emit("\x1b[J", 3);
+	emit(prompt, strlen(prompt));
+	terminalColumn = 0;
+	shown.length = 0;
+	refresh();
+}
+
+static bool consume(void);
+
+static void enable_raw(void) {
+	if (raw || tcgetattr(STDIN_FILENO, &original) == -1) return;
+	struct termios settings = original;
+	settings.c_iflag &= ~(ICRNL | IXON | BRKINT | INPCK | ISTRIP);
+	settings.c_lflag &= ~(ICANON | ECHO | IEXTEN); // Keeps ISIG, so Ctrl-C still reaches the event loop
+	settings.c_cc[VMIN] = 1;
+	settings.c_cc[VTIME] = 0;
+	raw = tcsetattr(STDIN_FILENO, TCSADRAIN, &settings) == 0;
+}
+
+/*
+ * Shows the prompt and starts editing a new line.
+ * Argument(s):
+ *   const char* text: the prompt.
+ *   EditorHandler finished: called with each finished line (malloc()ed,
+ *                           for the handler to free), or NULL at the end of input.
+ */
+void editor_start(const char* text, EditorHandler finished) {
+	handler = finished;
+	enable_raw();
+	query_columns();
+	editor_set_prompt(text);
+	line.length = shown.length = cursor = terminalColumn = 0;
+	reserve(&line, 0);
+	line.data[0] = ASCII_NULL;
+	historyIndex = history_length;
+	emit("\x1b[?2004h", 8); // Pastes arrive bracketed, not as typed keys
+	emit(prompt, strlen(prompt));
+	flush();
+	if (pendingLength > 0) consume(); // Typed ahead of the prompt
+}
+
+/*
+ * Gives the terminal back, e.g. while a command runs.
+ */
+void editor_stop(void) {
+	if (raw) {
+		emit("\x1b[?2004l", 8);
+		flush();
+		tcsetattr(STDIN_FILENO, TCSADRAIN, &original);
+	}
+	raw = false;
+}
+
+/*
+ * Changes the prompt. Call editor_redisplay() to show it.
+ */
+void editor_set_prompt(const char* text) {
+	prompt = tsh_realloc(MEM_EDITOR, prompt, strlen(text)+1);
+	strcpy(prompt, text);
+	measure_prompt();
+}
+
+/*
+ * Replaces the completion hook, called with the word before the cursor.
+ */
+void editor_set_completer(EditorCompleter hook) {
+	completer = hook;
+}
+
+void editor_redisplay(void) {
+	redraw();
+	flush();
+}
+
+/*
+ * Abandons the line (Ctrl-C) and starts a new one.
+ */
+void editor_cancel(void) {
+	move_to(terminalColumn, width_of(line.data, line.length));
+	emit("\r\n", 2);
+	emit(prompt, strlen(prompt));
+	line.length = shown.length = cursor = terminalColumn = 0;
+	line.data[0] = ASCII_NULL;
+	historyIndex = history_length;
+	flush();
+}
+
+/*
+ * Picks up a new terminal width.
+ */
+void editor_resize(void) {
+	query_columns();
+	redraw();
+	flush();
+}
+
+static void insert(const char* text, size_t length) {
+	reserve(&line, line.length+length);
+	memmove(line.data+cursor+length, line.data+cursor, line.length-cursor+1);
+	memcpy(line.data+cursor, text, length);
+	line.length += length;
+	cursor += length;
+}
+
+/*
+ * Removes [start, end) from the line, saving it for Ctrl-Y if 'kill'.
+ */
+static void erase(size_t start, size_t end, bool kill) {
+	if (start >= end) return;
+	if (kill) set(&killed, line.data+start, end-start);
+	memmove(line.data+start, line.data+end, line.length-end+1);
+	line.length -= end-start;
+	cursor = start;
+}
+
+static size_t previous_char(size_t position) {
+	if (position > 0) position--;
+	while (position > 0 && ((unsigned char) line.data[position] & 0xC0) == 0x80) position--;
+	return position;
+}
+
+static size_t next_char(size_t position) {
+	if (position < line.length) position++;
+	while (position < line.length && ((unsigned char) line.data[position] & 0xC0) == 0x80) position++;
+	return position;
+}
+
+static bool is_word(char c) {
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || ((unsigned char) c & 0x80);
+}
+
+static size_t previous_word(size_t position) {
+	while (position > 0 && !is_word(line.data[position-1])) position--;
+	while (position > 0 && is_word(line.data[position-1])) position--;
+	return position;
+}
+
+static size_t next_word(size_t position) {
+	while (position < line.length && !is_word(line.data[position])) position++;
+	while (position < line.length && is_word(line.data[position])) position++;
+	return position;
+}
+
+/*
+ * Replaces the line with an entry from History.
+ */
+static void browse(int index) {
+	if (index < 0 || index > history_length) return;
+	if (historyIndex == history_length) set(&saved, line.data, line.length); // Keeps the new line
+	historyIndex = index;
+	HIST_ENTRY* entry = index < history_length ? history_get(history_base + index) : NULL;
+	if (entry != NULL) set(&line, entry->line, strlen(entry->line));
+	else set(&line, saved.data != NULL ? saved.data : "", saved.length);
+	cursor = line.length;
+}
+
+/*
+ * The default completer: files and directories starting with the word.
+ */
+void editor_complete_files(const char* word, Vector* matches) {
+	const char* slash = strrchr(word, '/');
+	size_t directoryLength = slash == NULL ? 0 : (size_t) (slash-word)+1;
+	char directory[directoryLength+2];
+	if (slash == NULL) strcpy(directory, ".");
+	else {
+		memcpy(directory, word, directoryLength);
+		directory[directoryLength] = ASCII_NULL;
+	}
+	const char* base = word+directoryLength;
+	size_t baseLength = strlen(base);
+	DIR* dir = opendir(directory);
+	if (dir == NULL) return;
+	struct dirent* entry;
+	while ((entry = readdir(dir)) != NULL) {
+		if (strncmp(entry->d_name, base, baseLength) || (entry->d_name[0] == '.' && base[0] != '.') ||
+		    !strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) continue;
+		size_t length = directoryLength + strlen(entry->d_name);
+		char* match = tsh_calloc(MEM_EDITOR, length+2, sizeof(char));
+		memcpy(match, word, directoryLength);
+		strcpy(match+directoryLength, entry->d_name);
+		struct stat info;
+		if (entry->d_type == DT_DIR || ((entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK) &&
+		    !stat(match, &info) && S_ISDIR(info.st_mode)))
+			match[length] = '/';
+		vector_add(matches, matches->size, match);
+	}
+	closedir(dir);
+}
+
+/*
+ * Completes the word before the cursor through the completion hook.
+ * One match is inserted whole, several by their common prefix, and a
+ * second Tab lists them.
+ */
+static void complete(void) {
+	size_t start = cursor;
+	while (start > 0 && line.data[start-1] != ASCII_SPACE) start--;
+	char word[cursor-start+1];
+	memcpy(word, line.data+start, cursor-start);
+	word[cursor-start] = ASCII_NULL;
+	Vector matches = vector_init(0);
+	completer(word, &matches);
+	if (matches.size == 0) emit("\a", 1);
+	else {
+		const char* first = vector_get(&matches, 0);
+		size_t common = strlen(first);
+		for (unsigned int i = 1; i < matches.size; i++) {
+			size_t j = 0;
+			while (j < common && ((char*) vector_get(&matches, i))[j] == first[j]) j++;
+			common = j;
+		}
+		if (common > cursor-start || matches.size == 1) {
+			erase(start, cursor, false);
+			insert(first, common);
+			if (matches.size == 1 && first[common-1] != '/') insert(" ", 1);
+		} else if (lastKey == '\t') { // Lists the matches below the line
+			refresh();
+			move_to(terminalColumn, width_of(line.data, line.length));
+			emit("\r\n", 2);
+			for (unsigned int i = 0; i < matches.size; i++) {
+				emit(vector_get(&matches, i), strlen(vector_get(&matches, i)));
+				emit("  ", 2);
+			}
+			emit("\r\n", 2);
+			emit(prompt, strlen(prompt));
+			terminalColumn = shown.length = 0;
+		} else emit("\a", 1);
+	}
+	for (unsigned int i = 0; i < matches.size; i++)
+		tsh_free(vector_get(&matches, i));
+	tsh_free(matches.array);
+}
+
+/*
+ * Hands the finished line to the handler.
+ */
+static void accept(void) {
+	refresh(); // Keys earlier in the same read are not drawn yet
+	move_to(terminalColumn, width_of(line.data, line.length));
+	emit("\r\n", 2);
+	flush();
+	char* finished = malloc(line.length+1); // Freed by the handler, like readline's lines
+	memcpy(finished, line.data, line.length+1);
+	line.length = shown.length = cursor = terminalColumn = 0;
+	line.data[0] = ASCII_NULL;
+	handler(finished);
+}
+
+/*
+ * Decodes the next key from the pending input.
+ * Argument(s):
+ *   size_t* used: receives the bytes the key took, 0 if it is incomplete.
+ * Returns:
+ *   The key: a byte, or a Key for text runs and escape sequences.
+ */
+static int decode(size_t* used) {
+	unsigned char c = pending[0];
+	*used = 1;
+	if (c >= 0x20 && c != 0x7f) { // Printable, including UTF-8
+		while (*used < pendingLength && (unsigned char) pending[*used] >= 0x20 && pending[*used] != 0x7f) (*used)++;
+		return KEY_TEXT;
+	}
+	if (c != ASCII_ESCAPE) return c;
+	if (pendingLength < 2) return *used = 0;
+	*used = 2;
+	switch (pending[1]) { // Alt-key
+		case 'b': return KEY_WORD_LEFT;
+		case 'f': return KEY_WORD_RIGHT;
+		case 'd': return KEY_KILL_WORD;
+		case 0x7f:
+		case ASCII_BACKSPACE: return KEY_RUBOUT_WORD;
+		case '[':
+		case 'O': break;
+		default: return KEY_IGNORED;
+	}
+	size_t end = 2;
+	while (end < pendingLength && !(pending[end] >= 0x40 && pending[end] <= 0x7e)) end++;
+	if (end == pendingLength) { // Incomplete, unless it is too long to be a key
+		*used = end >= 16 ? end : 0;
+		return KEY_IGNORED;
+	}
+	*used = end+1;
+	char sequence[16] = "";
+	if (end-2 < sizeof(sequence)) memcpy(sequence, pending+2, end-2+1);
+	if (!strcmp(sequence, "A")) return KEY_UP;
+	if (!strcmp(sequence, "B")) return KEY_DOWN;
+	if (!strcmp(sequence, "C")) return KEY_RIGHT;
+	if (!strcmp(sequence, "D")) return KEY_LEFT;
+	if (!strcmp(sequence, "H") || !strcmp(sequence, "1~") || !strcmp(sequence, "7~")) return KEY_HOME;
+	if (!strcmp(sequence, "F") || !strcmp(sequence, "4~") || !strcmp(sequence, "8~")) return KEY_END;
+	if (!strcmp(sequence, "3~")) return KEY_DELETE;
+	if (!strcmp(sequence, "200~")) return KEY_PASTE;
+	if (!strcmp(sequence, "1;5C") || !strcmp(sequence, "1;3C")) return KEY_WORD_RIGHT;
+	if (!strcmp(sequence, "1;5D") || !strcmp(sequence, "1;3D")) return KEY_WORD_LEFT;
+	return KEY_IGNORED;
+}
+
+/*
+ * Applies one key to the line.
+ * Returns:
+ *   false once the line is finished and handed over.
+ */
+static bool press(int key, const char* text, size_t length) {
+	switch (key) {
+		case KEY_TEXT: insert(text, length); break;
+		case '\r':
+		case '\n': accept(); return false;
+		case CONTROL('d'):
+			if (line.length == 0) {
+				flush();
+				handler(NULL);
+				return false;
+			}
+			/* Falls through */
+		case KEY_DELETE: erase(cursor, next_char(cursor), false); break;
+		case 0x7f:
+		case CONTROL('h'): erase(previous_char(cursor), cursor, false); break;
+		case CONTROL('a'):
+		case KEY_HOME: cursor = 0; break;
+		case CONTROL('e'):
+		case KEY_END: cursor = line.length; break;
+		case CONTROL('b'):
+		case KEY_LEFT: cursor = previous_char(cursor); break;
+		case CONTROL('f'):
+		case KEY_RIGHT: cursor = next_char(cursor); break;
+		case KEY_WORD_LEFT: cursor = previous_word(cursor); break;
+		case KEY_WORD_RIGHT: cursor = next_word(cursor); break;
+		case CONTROL('k'): erase(cursor, line.length, true); break;
+		case CONTROL('u'): erase(0, cursor, true); break;
+		case CONTROL('w'): {
+			size_t start = cursor;
+			while (start > 0 && line.data[start-1] == ASCII_SPACE) start--;
+			while (start > 0 && line.data[start-1] != ASCII_SPACE) start--;
+			erase(start, cursor, true);
+			break;
+		}
+		case KEY_KILL_WORD: erase(cursor, next_word(cursor), true); break;
+		case KEY_RUBOUT_WORD: erase(previous_word(cursor), cursor, true); break;
+		case CONTROL('y'): if (killed.length > 0) insert(killed.data, killed.length); break;
+		case CONTROL('t'): { // Swaps whole characters, which may be several bytes each
+			size_t middle = cursor == line.length ? previous_char(cursor) : cursor;
+			size_t start = previous_char(middle);
+			size_t end = next_char(middle);
+			if (start < middle && middle < end) {
+				char first[middle-start];
+				memcpy(first, line.data+start, middle-start);
+				memmove(line.data+start, line.data+middle, end-middle);
+				memcpy(line.data+start+(end-middle), first, middle-start);
+				cursor = end;
+			}
+			break;
+		}
+		case CONTROL('l'):
+			emit("\x1b[H\x1b[2J", 7);
+			emit(prompt, strlen(prompt));
+			terminalColumn = shown.length = 0;
+			break;
+		case CONTROL('p'):
+		case KEY_UP: browse(historyIndex-1); break;
+		case CONTROL('n'):
+		case KEY_DOWN: browse(historyIndex+1); break;
+		case '\t': complete(); break;
+		case KEY_PASTE:
+			pasting = true;
+			pasted.length = 0;
+			break;
+		default: break;
+	}
+	lastKey = key;
+	return true;
+}
+
+/*
+ * Ends a bracketed paste. Text without line breaks is inserted at the
+ * cursor like typed text; several lines are accepted at once, along
+ * with the rest of the line, for the handler to run as one block.
+ * Returns:
+ *   false if the lines were accepted.
+ */
+static bool end_paste(void) {
+	reserve(&pasted, pasted.length);
+	pasted.data[pasted.length] = ASCII_NULL;
+	size_t kept = 0;
+	for (size_t i = 0; i < pasted.length; i++) // CR LF and CR end lines too
+		if (pasted.data[i] != ASCII_RETURN) pasted.data[kept++] = pasted.data[i];
+		else if (pasted.data[i+1] != ASCII_NEWLINE) pasted.data[kept++] = ASCII_NEWLINE;
+	pasted.length = kept;
+	while (pasted.length > 0 && strchr(" \n", pasted.data[pasted.length-1])) pasted.length--; // Enter is still needed for one line
+	if (memchr(pasted.data, ASCII_NEWLINE, pasted.length) == NULL) {
+		for (size_t i = 0; i < pasted.length; i++)
+			if ((unsigned char) pasted.data[i] < ASCII_SPACE) pasted.data[i] = ASCII_SPACE; // e.g. Tab, which would misalign the line
+		insert(pasted.data, pasted.length);
+		return true;
+	}
+	insert(pasted.data, pasted.length);
+	move_to(terminalColumn, 0);
+	emit("\x1b[J", 3); // The lines replace the line as shown
+	emit(line.data, line.length); // The terminal still turns LF into CR LF
+	emit("\r\n", 2);
+	flush();
+	char* finished = malloc(line.length+1); // Freed by the handler, like readline's lines
+	memcpy(finished, line.data, line.length+1);
+	line.length = shown.length = cursor = terminalColumn = 0;
+	line.data[0] = ASCII_NULL;
+	handler(finished);
+	return false;
+}
+
+/*
+ * Moves pasted text from the pending input into the paste, up to the
+ * end of the paste if it has arrived.
+ * Returns:
+ *   1 if the paste goes on, 0 if it ended, -1 if it ended by accepting lines.
+ */
+static int take_paste(void) {
+	char* end = memmem(pending, pendingLength, PASTE_END, PASTE_END_SIZE);
+	size_t taken = end != NULL ? (size_t) (end - pending) : pendingLength;
+	if (end == NULL) // Leaves what may be the start of the end for the next read
+		for (size_t kept = PASTE_END_SIZE-1; kept > 0; kept--)
+			if (kept <= pendingLength && !memcmp(pending+pendingLength-kept, PASTE_END, kept)) {
+				taken -= kept;
+				break;
+			}
+	reserve(&pasted, pasted.length+taken);
+	memcpy(pasted.data+pasted.length, pending, taken);
+	pasted.length += taken;
+	size_t used = taken + (end != NULL ? PASTE_END_SIZE : 0);
+	memmove(pending, pending+used, pendingLength-used);
+	pendingLength -= used;
+	if (end == NULL) return 1;
+	pasting = false;
+	return end_paste() ? 0 : -1;
+}
+
+/*
+ * Applies the keys in the pending input, then redraws what changed.
+ * Returns:
+ *   false if a line was finished, leaving the rest to the next prompt.
+ */
+static bool consume(void) {
+	while (pendingLength > 0) {
+		if (pasting) {
+			int state = take_paste();
+			if (state == -1) return false;
+			if (state == 1) break; // The rest of the paste is still to come
+			continue;
+		}
+		size_t used;
+		int key = decode(&used);
+		if (used == 0) break; // Wait for the rest of the sequence
+		char text[EDITOR_INPUT_SIZE];
+		memcpy(text, pending, used);
+		memmove(pending, pending+used, pendingLength-used); // Before the key, which may start a new prompt
+		pendingLength -= used;
+		if (!press(key, text, used)) return false;
+	}
+	refresh();
+	flush();
+	return true;
+}
+
+/*
+ * Reads whatever the terminal has, applies each key, then redraws the
+ * changed part of the line once. Call when standard input is readable.
+ */
+void editor_read(void) {
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ssize_t count = read(STDIN_FILENO, pending+pendingLength, sizeof(pending)-pendingLength);
+	if (count <= 0) {
+		if (count == 0 || (errno != EINTR && errno != EAGAIN)) handler(NULL);
+		return;
+	}
+	pendingLength += count;
+	if (!consume()) return; // A command ran in between, so the timing means nothing
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	uint64_t latency = (end.tv_sec-start.tv_sec) * 1000000000ULL + end.tv_nsec - start.tv_nsec;
+	unsigned int bucket = 0;
+	while (bucket+1 < LATENCY_BUCKETS && (latency/1000) >> bucket > 0) bucket++;
+	latencies[bucket]++;
+	latencyTotal += latency;
+	if (latency > latencyMax) latencyMax = latency;
+	keystrokes++;
+}
+
+/*
+ * Finds the bucket below which the given share of latencies fall.
+ * Returns:
+ *   Its upper bound, in microseconds.
+ */
+static size_t percentile(double share) {
+	size_t seen = 0;
+	for (unsigned int i = 0; i < LATENCY_BUCKETS; i++)
+		if ((seen += latencies[i]) >= share * keystrokes) return (size_t) 1 << i;
+	return (size_t) 1 << (LATENCY_BUCKETS-1);
+}
+
+/*
+ * Prints the keystroke-to-render latency (the 'keystats' builtin).
+ */
+void editor_report(void) {
+	if (keystrokes == 0) {
+		puts("keystats: No keystrokes measured (set EDITOR=BUILTIN in ~/.tsh-rc).");
+		return;
+	}
+	printf("keystrokes: %zu\n", keystrokes);
+	printf("latency:    mean %.1f us, p50 <= %zu us, p99 <= %zu us, max %.1f us\n", latencyTotal / 1000.0 / keystrokes,
+	       percentile(0.5), percentile(0.99), latencyMax / 1000.0);
+	printf("redraw:     %zu bytes, %.1f per keystroke\n", bytesDrawn, (double) bytesDrawn / keystrokes);
+}
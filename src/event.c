@@ -0,0 +1,249 @@
+// Standard: gnu99
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "allocator.h"
+#include "event.h"
+
+#define EVENT_BATCH	16	// Events handled per call to epoll_wait().
+
+typedef struct event_watcher {
+	int fd;              	// The watched file descriptor.
+	EventHandler handler;	// Called when 'fd' is readable.
+	void* data;          	// Passed to 'handler'.
+	bool timer;          	// 'fd' is a timerfd owned by the loop.
+	bool repeat;         	// Timer fires until cancelled.
+	bool dead;           	// Unwatched, freed at the end of the batch.
+	struct event_watcher* next;
+} watcher;
+
+static int epollfd = -1;          	// The epoll instance.
+static int sigfd = -1;            	// Delivers every handled signal.
+static sigset_t handled;          	// Signals routed through 'sigfd'.
+static SignalHandler signalHandlers[NSIG];
+static watcher* watchers = NULL;  	// Every registered watcher.
+static bool stopped = false;      	// Set by event_stop().
+
+/*
+ * Creates the event loop.
+ * Returns:
+ *   true on success, false if epoll is unavailable.
+ */
+bool event_init(void) {
+	epollfd = epoll_create1(EPOLL_CLOEXEC);
+	sigemptyset(&handled);
+	return epollfd != -1;
+}
+
+/*
+ * Finds the live watcher for a file descriptor.
+ * Argument(s):
+ *   int fd: the file descriptor.
+ * Returns:
+ *   The watcher, or NULL if 'fd' is not watched.
+ */
+static watcher* find_watcher(int fd) {
+	for (watcher* w = watchers; w != NULL; w = w->next)
+		if (w->fd == fd && !w->dead) return w;
+	return NULL;
+}
+
+/*
+ * Registers a watcher with the loop.
+ * Argument(s):
+ *   int fd: the file descriptor to watch.
+ *   EventHandler handler: called whenever 'fd' is readable.
+ *   void* data: passed to 'handler'.
+ * Returns:
+ *   The new watcher, or NULL if 'fd' can not be watched (e.g. a regular file).
+ */
+static watcher* add_watcher(int fd, EventHandler handler, void* data) {
+	watcher* w = tsh_calloc(MEM_SHELL, 1, sizeof(watcher));
+	w->fd = fd;
+	w->handler = handler;
+	w->data = data;
+	struct epoll_event event = {.events = EPOLLIN, .data.ptr = w};
+	if (epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &event) == -1) {
+		tsh_free(w);
+		return NULL;
+	}
+	w->next = watchers;
+	watchers = w;
+	return w;
+}
+
+/*
+ * Calls a handler whenever a file descriptor becomes readable.
+ * Argument(s):
+ *   int fd: the file descriptor to watch.
+ *   EventHandler handler: called with 'fd' and 'data'.
+ *   void* data: passed to 'handler'.
+ * Returns:
+ *   true on success, false if 'fd' can not be watched.
+ */
+bool event_watch(int fd, EventHandler handler, void* data) {
+	return add_watcher(fd, handler, data) != NULL;
+}
+
+/*
+ * Stops watching a file descriptor. Safe to call from any handler.
+ * Argument(s):
+ *   int fd: the file descriptor.
+ */
+void event_unwatch(int fd) {
+	watcher* w = find_watcher(fd);
+	if (w == NULL) return;
+	epoll_ctl(epollfd, EPOLL_CTL_DEL, fd, NULL);
+	w->dead = true;
+}
+
+/*
+ * Frees watchers that were unwatched during the last batch of events.
+ */
+static void bury_watchers(void) {
+	for (watcher** w = &watchers; *w != NULL; ) {
+		if ((*w)->dead) {
+			watcher* dead = *w;
+			*w = dead->next;
+			if (dead->timer) close(dead->fd);
+			tsh_free(dead);
+		} else w = &(*w)->next;
+	}
+}
+
+/*
+ * Calls a handler after a delay, and optionally every period thereafter.
+ * Argument(s):
+ *   unsigned int milliseconds: the delay (and period).
+ *   bool repeat: keep firing until cancelled.
+ *   EventHandler handler: called with the timer and 'data'.
+ *   void* data: passed to 'handler'.
+ * Returns:
+ *   The timer, for event_cancel(), or -1 on failure.
+ */
+int event_timer(unsigned int milliseconds, bool repeat, EventHandler handler, void* data) {
+	int timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (timer == -1) return -1;
+	struct timespec delay = {milliseconds / 1000, (milliseconds % 1000) * 1000000L};
+	struct itimerspec spec = {repeat ? delay : (struct timespec) {0, 0}, delay};
+	watcher* w = NULL;
+	if (timerfd_settime(timer, 0, &spec, NULL) == -1 || (w = add_watcher(timer, handler, data)) == NULL) {
+		close(timer);
+		return -1;
+	}
+	w->timer = true;
+	w->repeat = repeat;
+	return timer;
+}
+
+/*
+ * Cancels a timer before it fires (again).
+ * Argument(s):
+ *   int timer: a timer returned by event_timer().
+ */
+void event_cancel(int timer) {
+	event_unwatch(timer);
+}
+
+/*
+ * Reads every pending signal from the signalfd and dispatches it.
+ */
+static void dispatch_signals(int fd, void* data) {
+	(void) data;
+	struct signalfd_siginfo info;
+	while (read(fd, &info, sizeof(info)) == sizeof(info))
+		if (signalHandlers[info.ssi_signo] != NULL)
+			signalHandlers[info.ssi_signo](info.ssi_signo);
+}
+
+/*
+ * Handles a signal from the loop rather than asynchronously. The signal
+ * is blocked in the shell; launch_apply() unblocks it in children.
+ * Argument(s):
+ *   int signal: the signal number.
+ *   SignalHandler handler: called with the signal number.
+ * Returns:
+ *   true on success, false otherwise.
+ */
+bool event_signal(int signal, SignalHandler handler) {
+	sigaddset(&handled, signal);
+	if (sigprocmask(SIG_BLOCK, &handled, NULL) == -1) return false;
+	int fd = signalfd(sigfd, &handled, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (fd == -1) return false;
+	if (sigfd == -1) {
+		sigfd = fd;
+		if (!event_watch(fd, dispatch_signals, NULL)) return false;
+	}
+	signalHandlers[signal] = handler;
+	return true;
+}
+
+/*
+ * Throws away any pending instance of a handled signal.
+ * Argument(s):
+ *   int signal: the signal number.
+ */
+void event_discard(int signal) {
+	if (!sigismember(&handled, signal)) return;
+	sigset_t discarded;
+	sigemptyset(&discarded);
+	sigaddset(&discarded, signal);
+	struct timespec now = {0, 0};
+	while (sigtimedwait(&discarded, NULL, &now) > 0);
+}
+
+/*
+ * Tells whether a handled signal has arrived and is waiting for the loop,
+ * e.g. Ctrl-C pressed while a command ran.
+ * Argument(s):
+ *   int signal: the signal number.
+ */
+bool event_pending(int signal) {
+	sigset_t pending;
+	return sigismember(&handled, signal) && !sigpending(&pending) && sigismember(&pending, signal);
+}
+
+/*
+ * Runs the loop until event_stop() is called.
+ */
+void event_run(void) {
+	struct epoll_event events[EVENT_BATCH];
+	stopped = false;
+	while (!stopped) {
+		int ready = epoll_wait(epollfd, events, EVENT_BATCH, -1);
+		if (ready == -1) {
+			if (errno == EINTR) continue;
+			perror("T-Shell: epoll_wait");
+			break;
+		}
+		for (int i = 0; i < ready && !stopped; i++) {
+			watcher* w = (watcher*) events[i].data.ptr;
+			if (w->dead) continue;
+			if (w->timer) {
+				uint64_t expirations;
+				if (read(w->fd, &expirations, sizeof(expirations)) != sizeof(expirations)) continue;
+				if (!w->repeat) event_unwatch(w->fd);
+			}
+			w->handler(w->fd, w->data);
+		}
+		bury_watchers();
+	}
+}
+
+/*
+ * Makes event_run() return once the current handler finishes.
+ */
+void event_stop(void) {
+	stopped = true;
+}
@@ -0,0 +1,604 @@
+// Standard: gnu99
+
+#define _GNU_SOURCE
+
+#include <pwd.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "allocator.h"
+#include "expansion.h"
+#include "tsh.h"
+#include "data-structs/vector.h"
+
+#define NO_PART	-1
+
+/*
+ * A word is parsed once into a chain of parts. Brace expressions become
+ * a choice between chains, or a range, and are only walked (never
+ * copied out) when the words are generated. Compiled words (see
+ * expansion_compile()) also hold variables and command substitutions,
+ * whose values are fetched each time the words are generated.
+ */
+typedef enum part_kind {
+	PART_TEXT,    	// Literal text, quotes already removed
+	PART_CHOICE,  	// {a,b,c}
+	PART_RANGE,   	// {1..10}, {a..z}, {01..10..3}
+	PART_VARIABLE,	// $name, ${name}
+	PART_COMMAND  	// $(...), `...`
+} PartKind;
+
+typedef struct part {
+	PartKind kind;
+	int next;          	// The following part, NO_PART at the end of the chain.
+	size_t offset;     	// PART_TEXT, PART_VARIABLE, PART_COMMAND: where the text, name or command is in 'literals',
+	size_t length;     	// and how long it is.
+	bool quoted;       	// PART_VARIABLE, PART_COMMAND: inside double quotes, so the value is not split.
+	unsigned int first;	// PART_CHOICE: the first alternative in 'choices',
+	unsigned int count;	// and how many there are.
+	long from, to, step;	// PART_RANGE: the bounds, and the distance between values.
+	int width;         	// PART_RANGE: zero padded to this many digits.
+	bool letters;      	// PART_RANGE: of characters rather than numbers.
+} Part;
+
+typedef struct buffer {
+	char* data;
+	size_t length;
+	size_t capacity;
+} buffer;
+
+struct expansion_word {
+	Part* parts;
+	int* choices;       	// The first part of every alternative.
+	char* literals;     	// The literal text, and the names and commands, each ending in a Null.
+	int head;           	// The first part, NO_PART if the word is empty.
+	bool quoted;        	// The word had quotes or escapes, so it is kept even if empty and is never an operator.
+};
+
+typedef struct expander {
+	const char* line;   	// The line being parsed.
+	bool variables;     	// Parse variables and command substitutions too.
+	Part* parts;        	// The parts of the word being parsed.
+	size_t partCount, partCapacity;
+	int* choices;
+	size_t choiceCount, choiceCapacity;
+	buffer literals;
+	bool quoted;
+	const ExpansionWord* word;	// The word being generated.
+	ExpansionValue value; 	// Gives the values of its variables and commands.
+	int expanded;       	// Variables and commands in the word being generated.
+	buffer current;     	// The word being generated.
+	buffer output;      	// Every generated word.
+	size_t* offsets;    	// Where each word starts in 'output'.
+	bool* flags;        	// Whether each word is quoted (see Expansion).
+	size_t wordCount, wordCapacity, flagCapacity;
+	bool overflow;      	// Too many words.
+} expander;
+
+typedef struct continuation {
+	int part;                        	// Where to carry on once a chain ends,
+	const struct continuation* next; 	// and after that.
+} continuation;
+
+/*
+ * Makes room for 'needed' elements of 'size' bytes, doubling the array.
+ */
+static void* grow(void* array, size_t* capacity, size_t needed, size_t size) {
+	if (needed <= *capacity) return array;
+	*capacity = needed * 2;
+	return tsh_realloc(MEM_PARSER, array, *capacity * size);
+}
+
+static void append(buffer* b, const char* text, size_t length) {
+	b->data = grow(b->data, &b->capacity, b->length + length + 1, sizeof(char));
+	memcpy(b->data + b->length, text, length);
+	b->length += length;
+}
+
+static int add_part(expander* e, Part part, int* head, int* tail) {
+	e->parts = grow(e->parts, &e->partCapacity, e->partCount + 1, sizeof(Part));
+	part.next = NO_PART;
+	int index = e->partCount++;
+	e->parts[index] = part;
+	if (*tail != NO_PART) e->parts[*tail].next = index;
+	else *head = index;
+	*tail = index;
+	return index;
+}
+
+/*
+ * Adds literal text to a chain, extending its last part if that part
+ * ends where the text goes.
+ */
+static void add_text(expander* e, const char* text, size_t length, int* head, int* tail) {
+	if (*tail != NO_PART && e->parts[*tail].kind == PART_TEXT &&
+	    e->parts[*tail].offset + e->parts[*tail].length == e->literals.length)
+		e->parts[*tail].length += length;
+	else add_part(e, (Part) {.kind = PART_TEXT, .offset = e->literals.length, .length = length}, head, tail);
+	append(&e->literals, text, length);
+}
+
+/*
+ * Skips a quoted or escaped character sequence.
+ * Returns:
+ *   The position of its last character.
+ */
+static size_t skip_quoted(const char* line, size_t i, size_t end) {
+	if (line[i] == '\\') return i+1 < end ? i+1 : i;
+	char quote = line[i];
+	for (i++; i < end && line[i] != quote; i++)
+		if (quote == '"' && line[i] == '\\' && i+1 < end) i++;
+	return i;
+}
+
+/*
+ * Finds the end of a command substitution or of a braced variable that
+ * starts at 'i' ("$(", "${" or '`'), when variables are parsed.
+ * Returns:
+ *   The position of its last character, or 'i' if there is none there.
+ */
+static size_t skip_expansion(const expander* e, size_t i, size_t end) {
+	const char* line = e->line;
+	if (!e->variables || i+1 >= end) return i;
+	if (line[i] == '`') {
+		for (size_t j = i+1; j < end; j++) {
+			if (line[j] == '\\' && j+1 < end) j++;
+			else if (line[j] == '`') return j;
+		}
+		return end-1;
+	}
+	if (line[i] != '$' || (line[i+1] != '(' && line[i+1] != '{')) return i;
+	char open = line[i+1], close = open == '(' ? ')' : '}';
+	int depth = 0;
+	for (size_t j = i+1; j < end; j++) {
+		if (open == '(' && (line[j] == '\\' || line[j] == '\'' || line[j] == '"')) j = skip_quoted(line, j, end);
+		else if (line[j] == open) depth++;
+		else if (line[j] == close && --depth == 0) return j;
+	}
+	return open == '(' ? end-1 : i; // An unterminated "${" is just text
+}
+
+/*
+ * Reads one end of a range: a number, or a single character.
+ */
+static bool range_bound(const char* text, size_t length, long* value, bool* letter, int* width) {
+	if (length == 1 && !(text[0] >= '0' && text[0] <= '9')) {
+		*value = (unsigned char) text[0];
+		*letter = true;
+		return true;
+	}
+	char number[length+1];
+	memcpy(number, text, length);
+	number[length] = ASCII_NULL;
+	char* end;
+	*value = strtol(number, &end, 10);
+	*letter = false;
+	bool padded = number[0] == '0' || (number[0] == '-' && number[1] == '0');
+	*width = padded && length > 1 ? (int) length : 0;
+	return end != number && *end == ASCII_NULL;
+}
+
+/*
+ * Reads the inside of a brace expression as a range: FROM..TO[..STEP].
+ */
+static bool parse_range(const char* text, size_t length, Part* part) {
+	const char* dots = memmem(text, length, "..", 2);
+	if (dots == NULL) return false;
+	const char* second = dots+2;
+	const char* stepDots = memmem(second, text+length-second, "..", 2);
+	const char* toEnd = stepDots != NULL ? stepDots : text+length;
+	bool fromLetter, toLetter, stepLetter;
+	int fromWidth = 0, toWidth = 0, stepWidth = 0;
+	*part = (Part) {.kind = PART_RANGE, .step = 1};
+	if (!range_bound(text, dots-text, &part->from, &fromLetter, &fromWidth) ||
+	    !range_bound(second, toEnd-second, &part->to, &toLetter, &toWidth) || fromLetter != toLetter)
+		return false;
+	if (stepDots != NULL && (!range_bound(stepDots+2, text+length-stepDots-2, &part->step, &stepLetter, &stepWidth) || stepLetter))
+		return false;
+	if (part->step < 0) part->step = -part->step;
+	if (part->step == 0) part->step = 1;
+	part->letters = fromLetter;
+	part->width = fromWidth > toWidth ? fromWidth : toWidth;
+	return true;
+}
+
+/*
+ * Skips a quoted or escaped character sequence, as skip_quoted(), but
+ * also skips the commands and variables in double quotes when variables
+ * are parsed, so their own quotes don't end the outer ones.
+ */
+static size_t skip_word_quoted(const expander* e, size_t i, size_t end) {
+	if (!e->variables || e->line[i] != '"') return skip_quoted(e->line, i, end);
+	for (i++; i < end && e->line[i] != '"'; i++) {
+		if (e->line[i] == '\\' && i+1 < end) i++;
+		else if (e->line[i] == '$' || e->line[i] == '`') i = skip_expansion(e, i, end);
+	}
+	return i;
+}
+
+static int parse_chain(expander* e, size_t start, size_t end, bool wordStart);
+
+/*
+ * Tries to read a brace expression starting at 'open'. Anything that is
+ * not a list with a comma or a valid range stays literal, as in sh.
+ * Returns:
+ *   The position of the closing brace, or 0 if it is not an expression.
+ */
+static size_t parse_brace(expander* e, size_t open, size_t end, int* head, int* tail) {
+	const char* line = e->line;
+	size_t commas = 0, close = 0;
+	int depth = 0;
+	for (size_t i = open+1; i < end && close == 0; i++) {
+		if (line[i] == '\\' || line[i] == '\'' || line[i] == '"') i = skip_word_quoted(e, i, end);
+		else if (line[i] == '$' || line[i] == '`') i = skip_expansion(e, i, end);
+		else if (line[i] == '{') depth++;
+		else if (line[i] == '}' && depth-- == 0) close = i;
+		else if (line[i] == ',' && depth == 0) commas++;
+	}
+	if (close == 0) return 0;
+	if (commas == 0) {
+		Part range;
+		if (!parse_range(line+open+1, close-open-1, &range)) return 0;
+		add_part(e, range, head, tail);
+		return close;
+	}
+	int alternatives[commas+1]; // Collected first, so nested choices can't interleave with them
+	size_t count = 0, start = open+1;
+	depth = 0;
+	for (size_t i = open+1; i <= close; i++) {
+		if (i < close && (line[i] == '\\' || line[i] == '\'' || line[i] == '"')) i = skip_word_quoted(e, i, end);
+		else if (i < close && (line[i] == '$' || line[i] == '`')) i = skip_expansion(e, i, end);
+		else if (i < close && line[i] == '{') depth++;
+		else if (i < close && line[i] == '}') depth--;
+		else if (i == close || (line[i] == ',' && depth == 0)) {
+			alternatives[count++] = parse_chain(e, start, i, false);
+			start = i+1;
+		}
+	}
+	e->choices = grow(e->choices, &e->choiceCapacity, e->choiceCount + count, sizeof(int));
+	memcpy(e->choices + e->choiceCount, alternatives, count * sizeof(int));
+	add_part(e, (Part) {.kind = PART_CHOICE, .first = e->choiceCount, .count = count}, head, tail);
+	e->choiceCount += count;
+	return close;
+}
+
+/*
+ * Expands a leading '~' or '~user' into a home directory.
+ * Returns:
+ *   Where the rest of the word starts, or 'start' if there is no tilde prefix.
+ */
+static size_t parse_tilde(expander* e, size_t start, size_t end, int* head, int* tail) {
+	size_t i = start+1;
+	while (i < end && e->line[i] != '/') {
+		if (strchr("\\'\"{},$`", e->line[i]) != NULL) return start; // Not a plain user name
+		i++;
+	}
+	if (i == start+1 && e->variables) { // $HOME when the word runs, as it may change
+		add_part(e, (Part) {.kind = PART_VARIABLE, .offset = e->literals.length, .length = 4, .quoted = true}, head, tail);
+		append(&e->literals, "HOME", 5);
+		return i;
+	}
+	const char* home = NULL;
+	if (i == start+1) home = getenv("HOME");
+	else {
+		char name[i-start];
+		memcpy(name, e->line+start+1, i-start-1);
+		name[i-start-1] = ASCII_NULL;
+		struct passwd* user = getpwnam(name);
+		if (user != NULL) home = user->pw_dir;
+	}
+	if (home == NULL) return start; // Left as it is
+	add_text(e, home, strlen(home), head, tail);
+	return i;
+}
+
+/*
+ * Reads a variable or command substitution starting at 'i', adding it
+ * to the chain, when variables are parsed.
+ * Returns:
+ *   Where the rest of the word starts, or 'i' if there is none there
+ *   (e.g. a lone '$').
+ */
+static size_t parse_dollar(expander* e, size_t i, size_t end, bool quoted, int* head, int* tail) {
+	const char* line = e->line;
+	if (!e->variables || i+1 >= end) return i;
+	size_t from = i+1, to = i+1; // The name or command
+	PartKind kind = PART_VARIABLE;
+	size_t close = skip_expansion(e, i, end);
+	if (line[i] == '`' || line[i+1] == '(') {
+		kind = PART_COMMAND;
+		from = i;
+		to = close+1;
+	} else if (line[i+1] == '{') {
+		if (close == i) return i;
+		from = i+2;
+		to = close;
+	} else if (strchr("?#@*", line[i+1]) != NULL || (line[i+1] >= '0' && line[i+1] <= '9')) to = i+2;
+	else while (to < end && (line[to] == '_' || (line[to] >= 'a' && line[to] <= 'z') ||
+	                         (line[to] >= 'A' && line[to] <= 'Z') || (to > from && line[to] >= '0' && line[to] <= '9')))
+		to++;
+	if (to == from) return i;
+	add_part(e, (Part) {.kind = kind, .offset = e->literals.length, .length = to-from, .quoted = quoted}, head, tail);
+	append(&e->literals, line+from, to-from);
+	append(&e->literals, "", 1); // Ends the name, and keeps text after it a separate part
+	return kind == PART_VARIABLE && line[i+1] != '{' ? to : close+1;
+}
+
+/*
+ * Parses [start, end) of the line into a chain of parts, removing quotes.
+ * Returns:
+ *   The first part, or NO_PART if it is empty.
+ */
+static int parse_chain(expander* e, size_t start, size_t end, bool wordStart) {
+	const char* line = e->line;
+	int head = NO_PART, tail = NO_PART;
+	size_t i = start;
+	if (wordStart && line[i] == '~') i = parse_tilde(e, start, end, &head, &tail);
+	while (i < end) {
+		char c = line[i];
+		if (c == '\'' || c == '"') {
+			size_t close = skip_word_quoted(e, i, end);
+			for (size_t j = i+1; j < close; j++) {
+				size_t next = c == '"' && (line[j] == '$' || line[j] == '`') ? parse_dollar(e, j, close, true, &head, &tail) : j;
+				if (next != j) j = next-1;
+				else {
+					if (c == '"' && line[j] == '\\' && j+1 < close && strchr("\"\\$`", line[j+1])) j++;
+					add_text(e, line+j, 1, &head, &tail);
+				}
+			}
+			e->quoted = true;
+			i = close+1;
+		} else if (c == '\\' && i+1 < end) {
+			add_text(e, line+i+1, 1, &head, &tail);
+			e->quoted = true;
+			i += 2;
+		} else {
+			size_t close = c == '{' ? parse_brace(e, i, end, &head, &tail) : 0;
+			size_t next = c == '$' || c == '`' ? parse_dollar(e, i, end, false, &head, &tail) : i;
+			if (next != i) i = next;
+			else {
+				if (close == 0) add_text(e, line+i, 1, &head, &tail);
+				i = close == 0 ? i+1 : close+1;
+			}
+		}
+	}
+	return head;
+}
+
+/*
+ * Adds the generated word to the output, unless it is empty.
+ */
+static void finish(expander* e) {
+	if (e->current.length == 0 && !e->word->quoted) return; // e.g. x{,} or a vanished brace
+	if (e->wordCount == EXPANSION_MAX_WORDS) {
+		e->overflow = true;
+		return;
+	}
+	e->offsets = grow(e->offsets, &e->wordCapacity, e->wordCount + 1, sizeof(size_t));
+	e->flags = grow(e->flags, &e->flagCapacity, e->wordCount + 1, sizeof(bool));
+	e->flags[e->wordCount] = e->word->quoted || e->expanded > 0;
+	e->offsets[e->wordCount++] = e->output.length;
+	append(&e->output, e->current.data == NULL ? "" : e->current.data, e->current.length);
+	append(&e->output, "", 1); // The Null
+}
+
+static void generate(expander* e, int part, const continuation* after);
+
+/*
+ * Carries on with the value of an unquoted variable or command split at
+ * blanks: the first field ends the word being built, the last one starts
+ * the word the rest of the chain goes on.
+ */
+static void generate_fields(expander* e, const char* value, int next, const continuation* after) {
+	size_t mark = e->current.length;
+	char* prefix = tsh_calloc(MEM_PARSER, mark+1, sizeof(char)); // Splitting overwrites it
+	if (mark > 0) memcpy(prefix, e->current.data, mark);
+	while (*value != ASCII_NULL && !e->overflow) {
+		size_t blanks = strspn(value, " \t\n");
+		if (blanks > 0) {
+			finish(e);
+			e->current.length = 0;
+		}
+		size_t length = strcspn(value+blanks, " \t\n");
+		append(&e->current, value+blanks, length);
+		value += blanks+length;
+	}
+	generate(e, next, after);
+	e->current.length = 0;
+	append(&e->current, prefix, mark);
+	tsh_free(prefix);
+}
+
+/*
+ * Walks every combination of the parts depth first, writing each word
+ * as soon as it is complete. Only the word being built is held, however
+ * many words a range or choice yields.
+ * Argument(s):
+ *   int part: the next part of the current chain.
+ *   const continuation* after: where to carry on once the chain ends.
+ */
+static void generate(expander* e, int part, const continuation* after) {
+	if (e->overflow) return;
+	if (part == NO_PART) {
+		if (after != NULL) generate(e, after->part, after->next);
+		else finish(e);
+		return;
+	}
+	Part p = e->word->parts[part];
+	size_t mark = e->current.length;
+	if (p.kind == PART_TEXT) {
+		append(&e->current, e->word->literals + p.offset, p.length);
+		generate(e, p.next, after);
+	} else if (p.kind == PART_CHOICE) {
+		continuation rest = {p.next, after};
+		for (unsigned int i = 0; i < p.count && !e->overflow; i++) {
+			e->current.length = mark;
+			generate(e, e->word->choices[p.first + i], &rest);
+		}
+	} else if (p.kind == PART_RANGE) {
+		unsigned long count = (p.from <= p.to ? p.to - p.from : p.from - p.to) / p.step + 1;
+		long direction = p.from <= p.to ? 1 : -1;
+		for (unsigned long i = 0; i < count && !e->overflow; i++) {
+			long value = p.from + direction * (long) i * p.step;
+			char text[24];
+			int length = p.letters ? snprintf(text, sizeof(text), "%c", (char) value)
+			                       : snprintf(text, sizeof(text), "%0*ld", p.width, value);
+			e->current.length = mark;
+			append(&e->current, text, length);
+			generate(e, p.next, after);
+		}
+	} else { // A variable or command, whose value is text however it reads
+		char* value = e->value(e->word->literals + p.offset, p.kind == PART_COMMAND);
+		e->expanded++;
+		if (!p.quoted) generate_fields(e, value, p.next, after);
+		else {
+			append(&e->current, value, strlen(value));
+			generate(e, p.next, after);
+		}
+		e->expanded--;
+		tsh_free(value);
+	}
+	e->current.length = mark;
+}
+
+/*
+ * Hands the generated words over to the result, and releases the rest.
+ */
+static bool collect(expander* e, bool expanded, Expansion* result) {
+	if (e->overflow) {
+		fprintf(stderr, COLOR_RED "T-Shell: Brace expansion makes more than %d words.\n" COLOR_RESET, EXPANSION_MAX_WORDS);
+		expanded = false;
+	}
+	result->text = e->output.data;
+	result->words = (Vector) {0, NULL};
+	result->quoted = NULL;
+	if (expanded && e->wordCount > 0) { // Offsets become pointers once the text stops moving
+		result->words = (Vector) {e->wordCount, tsh_calloc(MEM_VECTOR, e->wordCount, sizeof(void*))};
+		for (size_t w = 0; w < e->wordCount; w++)
+			result->words.array[w] = e->output.data + e->offsets[w];
+		result->quoted = e->flags;
+		e->flags = NULL;
+	}
+	tsh_free(e->parts);
+	tsh_free(e->choices);
+	tsh_free(e->literals.data);
+	tsh_free(e->current.data);
+	tsh_free(e->offsets);
+	tsh_free(e->flags);
+	return expanded;
+}
+
+/*
+ * Splits a line into words and expands each of them in one pass: quote
+ * removal, tilde ('~', '~user') and braces ('{a,b}', '{1..10}').
+ * Argument(s):
+ *   const char* input: the line, after command substitution.
+ *   Expansion* result: receives the argument vector.
+ * Returns:
+ *   false, after printing why, if the line could not be expanded.
+ * Memory Management:
+ *   Release the result with expansion_free(), whatever is returned.
+ */
+bool expand_line(const char* input, Expansion* result) {
+	expander e = {0};
+	e.line = input;
+	size_t length = strlen(input), i = 0;
+	bool expanded = true;
+	while (expanded && !e.overflow) {
+		while (i < length && strchr(" \t\n", input[i]) != NULL) i++;
+		if (i == length) break;
+		size_t start = i;
+		for (; i < length && strchr(" \t\n", input[i]) == NULL; i++) {
+			if (input[i] != '\\' && input[i] != '\'' && input[i] != '"') continue;
+			i = skip_quoted(input, i, length);
+			if (i == length) {
+				fprintf(stderr, COLOR_RED "T-Shell: Unterminated quote.\n" COLOR_RESET);
+				expanded = false;
+				break;
+			}
+		}
+		if (!expanded) break;
+		e.partCount = e.choiceCount = e.literals.length = e.current.length = 0;
+		e.quoted = false;
+		int head = parse_chain(&e, start, i, true);
+		ExpansionWord word = {e.parts, e.choices, e.literals.data, head, e.quoted};
+		e.word = &word;
+		generate(&e, head, NULL);
+	}
+	return collect(&e, expanded, result);
+}
+
+/*
+ * Parses a word once, so that it can be expanded many times (e.g. by a
+ * loop) without reading it again. Besides quotes, '~' and braces, it may
+ * hold variables ($name, ${name}, $1, $?, ...) and command substitutions
+ * ($(...), `...`), expanded with their current values every time.
+ * Argument(s):
+ *   const char* text: the word as typed.
+ *   size_t length: the length of 'text'.
+ * Memory Management:
+ *   Release the word with expansion_word_free().
+ */
+ExpansionWord* expansion_compile(const char* text, size_t length) {
+	expander e = {0};
+	e.line = text;
+	e.variables = true;
+	int head = parse_chain(&e, 0, length, true);
+	append(&e.literals, "", 1); // Ends the text of a plain word (see expansion_word_text())
+	ExpansionWord* word = tsh_calloc(MEM_PARSER, 1, sizeof(ExpansionWord));
+	*word = (ExpansionWord) {e.parts, e.choices, e.literals.data, head, e.quoted};
+	return word;
+}
+
+/*
+ * Expands compiled words into an argument vector, the same as a typed
+ * line would be. The values of variables and commands are only text:
+ * they are split at blanks when unquoted, but never read as quotes,
+ * braces or operators.
+ * Argument(s):
+ *   ExpansionWord* const* words: the words, from expansion_compile().
+ *   unsigned int count: how many there are.
+ *   ExpansionValue value: gives the values of variables and commands.
+ *   Expansion* result: receives the argument vector.
+ * Returns:
+ *   false, after printing why, if the words could not be expanded.
+ * Memory Management:
+ *   Release the result with expansion_free(), whatever is returned.
+ */
+bool expansion_expand(ExpansionWord* const* words, unsigned int count, ExpansionValue value, Expansion* result) {
+	expander e = {0};
+	e.value = value;
+	for (unsigned int i = 0; i < count && !e.overflow; i++) {
+		e.word = words[i];
+		e.current.length = 0;
+		generate(&e, words[i]->head, NULL);
+	}
+	return collect(&e, true, result);
+}
+
+/*
+ * The literal text of a compiled word, quotes removed, as for a name
+ * (e.g. a for loop's variable). Only meaningful for a plain word.
+ */
+const char* expansion_word_text(const ExpansionWord* word) {
+	return word->literals;
+}
+
+void expansion_word_free(ExpansionWord* word) {
+	if (word == NULL) return;
+	tsh_free(word->parts);
+	tsh_free(word->choices);
+	tsh_free(word->literals);
+	tsh_free(word);
+}
+
+void expansion_free(Expansion* result) {
+	tsh_free(result->words.array);
+	tsh_free(result->quoted);
+	tsh_free(result->text);
+	result->words = (Vector) {0, NULL};
+	result->quoted = NULL;
+	result->text = NULL;
+}
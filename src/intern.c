@@ -0,0 +1,111 @@
+// Standard: gnu99
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "allocator.h"
+#include "intern.h"
+
+static const char** slots = NULL;	// Open addressing table of the interned strings.
+static size_t capacity = 0;      	// Number of slots.
+static size_t count = 0;         	// Number of interned strings.
+static size_t bytes = 0;         	// Characters held, terminators included.
+static size_t lookups = 0;       	// Calls to intern().
+static size_t hits = 0;          	// Calls that found the string already interned.
+
+/*
+ * FNV-1a, over the whole string.
+ */
+static uint64_t hash(const char* text) {
+	uint64_t hash = 14695981039346656037ULL;
+	for (const unsigned char* c = (const unsigned char*) text; *c != 0; c++)
+		hash = (hash ^ *c) * 1099511628211ULL;
+	return hash;
+}
+
+/*
+ * Finds the slot holding 'text', or the empty slot where it belongs.
+ */
+static const char** probe(const char** table, size_t size, const char* text) {
+	size_t index = hash(text) & (size-1);
+	while (table[index] != NULL && strcmp(table[index], text))
+		index = (index+1) & (size-1);
+	return &table[index];
+}
+
+/*
+ * Doubles the table, moving every string to its new slot.
+ */
+static void grow(void) {
+	size_t size = capacity == 0 ? INTERN_INITIAL_SLOTS : capacity*2;
+	const char** table = tsh_calloc(MEM_INTERN, size, sizeof(char*));
+	for (size_t i = 0; i < capacity; i++)
+		if (slots[i] != NULL) *probe(table, size, slots[i]) = slots[i];
+	tsh_free(slots);
+	slots = table;
+	capacity = size;
+}
+
+/*
+ * Returns the one copy of a string shared by everyone who interns it,
+ * so interned strings can be compared by address.
+ * Argument(s):
+ *   const char* text: the string.
+ * Memory Management:
+ *   Never free the returned string; it lives until intern_free().
+ * Returns:
+ *   The interned copy of 'text'.
+ */
+const char* intern(const char* text) {
+	lookups++;
+	if (count*2 >= capacity) grow();
+	const char** slot = probe(slots, capacity, text);
+	if (*slot != NULL) {
+		hits++;
+		return *slot;
+	}
+	size_t length = strlen(text)+1;
+	char* copy = tsh_calloc(MEM_INTERN, length, sizeof(char));
+	memcpy(copy, text, length);
+	bytes += length;
+	count++;
+	return *slot = copy;
+}
+
+/*
+ * Looks a string up without interning it, for words that only matter if
+ * something (an alias, builtin, function or coprocess) is already named
+ * so. Keeps arbitrary words, e.g. generated file names, out of the table.
+ * Argument(s):
+ *   const char* text: the string.
+ * Returns:
+ *   The interned copy of 'text', or NULL if it was never interned.
+ */
+const char* intern_find(const char* text) {
+	lookups++;
+	if (capacity == 0) return NULL;
+	const char* found = *probe(slots, capacity, text);
+	if (found != NULL) hits++;
+	return found;
+}
+
+/*
+ * Prints the size and hit rate of the intern table (part of 'mem').
+ */
+void intern_report(void) {
+	printf("interned: %zu strings, %zu bytes, %zu slots, %zu/%zu lookups hit (%.1f%%)\n", count, bytes, capacity,
+	       hits, lookups, lookups == 0 ? 0.0 : 100.0 * hits / lookups);
+}
+
+/*
+ * Releases every interned string.
+ */
+void intern_free(void) {
+	for (size_t i = 0; i < capacity; i++)
+		tsh_free((char*) slots[i]);
+	tsh_free(slots);
+	slots = NULL;
+	capacity = count = bytes = 0;
+}
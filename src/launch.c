@@ -0,0 +1,167 @@
+// Standard: gnu99
+
+#define _GNU_SOURCE
+
+#include <sched.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "launch.h"
+#include "tsh.h"
+#include "data-structs/vector.h"
+
+#define IOPRIO_WHO_PROCESS	1	// ioprio_set() target is a single process.
+#define IOPRIO_CLASS_SHIFT	13	// Bits reserved for the level within a class.
+#define NUMA_MAX_NODES		64	// Nodes representable in the policy mask.
+
+typedef struct launch_options {
+	bool pinned;       	// Restrict the CPUs the command may run on
+	cpu_set_t cpus;    	// The allowed CPUs
+	bool niced;        	// Change the scheduling priority
+	int niceness;      	// The new nice value
+	int ioclass;       	// I/O scheduling class (0 leaves it alone)
+	int iolevel;       	// Priority within the I/O class
+	int numaNode;      	// Memory node to bind to (-1 leaves it alone)
+} LaunchOptions;
+
+static LaunchOptions options; // Applied to every child of the current command.
+
+/*
+ * Parses a CPU list such as "0-7,12,14-15".
+ * Argument(s):
+ *   char* list: the CPU list.
+ *   cpu_set_t* cpus: where the CPUs are stored.
+ * Returns:
+ *   true if the list was valid, false otherwise.
+ */
+static bool parse_cpus(char* list, cpu_set_t* cpus) {
+	CPU_ZERO(cpus);
+	char* end = list;
+	while (*end != ASCII_NULL) {
+		long first = strtol(list, &end, 10);
+		long last = first;
+		if (end == list || first < 0) return false;
+		if (*end == '-') {
+			list = end+1;
+			last = strtol(list, &end, 10);
+			if (end == list || last < first) return false;
+		}
+		for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+			CPU_SET(cpu, cpus);
+		if (*end == ',') end++;
+		else if (*end != ASCII_NULL) return false;
+		list = end;
+	}
+	return CPU_COUNT(cpus) > 0;
+}
+
+/*
+ * Parses an I/O priority such as "idle", "be:4" or "1:0".
+ * Argument(s):
+ *   char* priority: the I/O class, optionally followed by ':' and a level.
+ * Returns:
+ *   true if the priority was valid, false otherwise.
+ */
+static bool parse_ioprio(char* priority) {
+	char* level = strchr(priority, ':');
+	if (level != NULL) *level = ASCII_NULL;
+	bool valid = true;
+	if (!strcmp(priority, "rt") || !strcmp(priority, "1")) options.ioclass = 1;
+	else if (!strcmp(priority, "be") || !strcmp(priority, "2")) options.ioclass = 2;
+	else if (!strcmp(priority, "idle") || !strcmp(priority, "3")) options.ioclass = 3;
+	else valid = false;
+	options.iolevel = 4;
+	if (level != NULL) {
+		*level++ = ':'; // Left whole for error messages
+		char* end;
+		long value = strtol(level, &end, 10);
+		if (end == level || *end != ASCII_NULL || value < 0 || value > 7) valid = false;
+		else options.iolevel = value;
+	}
+	return valid;
+}
+
+/*
+ * Strips launch prefixes from the front of a command and remembers them:
+ *   pin CPUS:         run on the given CPUs only (e.g. 0-7,12).
+ *   prio [-n] N:      run with nice value N.
+ *   ioprio CLASS[:N]: run in I/O class rt, be or idle.
+ *   numa NODE:        allocate memory from the given NUMA node only.
+ * Prefixes can be combined, as in "pin 0-3 prio 10 make". They are not
+ * named nice and ionice so those programs still run as usual.
+ * Argument(s):
+ *   Vector* tokens: a pointer to the tokenized user input.
+ * Returns:
+ *   false if a prefix was malformed, true otherwise.
+ */
+bool launch_parse(Vector* tokens) {
+	options = (LaunchOptions) {.numaNode = -1};
+	while (tokens->size > 0) {
+		char* prefix = (char*) vector_get(tokens, 0);
+		bool valid = true;
+		unsigned int consumed = 2;
+		if (tokens->size < 3 && (!strcmp(prefix, "pin") || !strcmp(prefix, "prio") ||
+		                         !strcmp(prefix, "ioprio") || !strcmp(prefix, "numa"))) {
+			fprintf(stderr, COLOR_RED "T-Shell: %s: Missing command.\n" COLOR_RESET, prefix);
+			return false;
+		}
+		if (!strcmp(prefix, "pin")) {
+			valid = parse_cpus((char*) vector_get(tokens, 1), &options.cpus);
+			options.pinned = valid;
+		} else if (!strcmp(prefix, "prio")) {
+			char* value = (char*) vector_get(tokens, 1);
+			if (!strcmp(value, "-n") && tokens->size > 3) {
+				value = (char*) vector_get(tokens, 2);
+				consumed = 3;
+			}
+			char* end;
+			options.niceness = strtol(value, &end, 10);
+			options.niced = valid = *end == ASCII_NULL && end != value;
+		} else if (!strcmp(prefix, "ioprio")) {
+			valid = parse_ioprio((char*) vector_get(tokens, 1));
+		} else if (!strcmp(prefix, "numa")) {
+			char* end;
+			options.numaNode = strtol((char*) vector_get(tokens, 1), &end, 10);
+			valid = *end == ASCII_NULL && options.numaNode >= 0 && options.numaNode < NUMA_MAX_NODES;
+		} else break;
+		if (!valid) {
+			fprintf(stderr, COLOR_RED "T-Shell: %s: Invalid argument \'%s\'.\n" COLOR_RESET,
+			        prefix, (char*) vector_get(tokens, consumed-1));
+			return false;
+		}
+		while (consumed-- > 0) vector_delete(tokens, 0);
+	}
+	return true;
+}
+
+/*
+ * Applies the current launch options to the calling process.
+ * Called in every child between fork and exec.
+ */
+void launch_apply(void) {
+	sigset_t none;
+	sigemptyset(&none);
+	sigprocmask(SIG_SETMASK, &none, NULL); // The shell blocks signals for its event loop
+	if (options.pinned && sched_setaffinity(0, sizeof(cpu_set_t), &options.cpus))
+		perror("T-Shell: pin");
+	if (options.niced && setpriority(PRIO_PROCESS, 0, options.niceness))
+		perror("T-Shell: prio");
+	if (options.ioclass > 0 &&
+	    syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, (options.ioclass << IOPRIO_CLASS_SHIFT) | options.iolevel))
+		perror("T-Shell: ioprio");
+	if (options.numaNode >= 0) {
+		#ifdef SYS_set_mempolicy
+			unsigned long nodemask = 1UL << options.numaNode;
+			if (syscall(SYS_set_mempolicy, 2 /* MPOL_BIND */, &nodemask, NUMA_MAX_NODES+1))
+				perror("T-Shell: numa");
+		#else
+			fprintf(stderr, "T-Shell: numa: Not supported on this system.\n");
+		#endif
+	}
+}
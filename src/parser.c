@@ -0,0 +1,50 @@
+// Standard: gnu99
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "parser.h"
+#include "strutil/strutil.h"
+#include "tsh.h"
+
+/*
+ * Splits the next command off a command list. Operators that are quoted,
+ * escaped, or inside "$(...)" or backticks belong to the command and are
+ * not split on.
+ * Argument(s):
+ *   char** line: the rest of the list, advanced past the command and its operator.
+ *   ListOperator* next: where the operator that follows the command is stored.
+ * Note for Memory Management:
+ *   Free the returned string when done.
+ * Returns:
+ *   The trimmed command (possibly empty), or NULL at the end of the list.
+ */
+char* parser_next_command(char** line, ListOperator* next) {
+	char* start = *line;
+	if (*start == ASCII_NULL) return NULL;
+	char quote = ASCII_NULL;
+	int depth = 0; // Nesting of $( )
+	char* c = start;
+	*next = LIST_SEQUENCE;
+	for (; *c != ASCII_NULL; c++) {
+		if (quote != ASCII_NULL) {
+			if (*c == '\\' && quote == '"' && c[1] != ASCII_NULL) c++;
+			else if (*c == quote) quote = ASCII_NULL;
+		} else if (*c == '\\' && c[1] != ASCII_NULL) c++; // Escaped, as in \;
+		else if (*c == '\'' || *c == '"' || *c == '`') quote = *c;
+		else if (c[0] == '$' && c[1] == '(') depth++, c++;
+		else if (*c == ')' && depth > 0) depth--;
+		else if (depth == 0) {
+			if (*c == ';') break;
+			if (c[0] == '&' && c[1] == '&') { *next = LIST_AND; break; }
+			if (c[0] == '|' && c[1] == '|') { *next = LIST_OR; break; }
+		}
+	}
+	char* end = c;
+	if (*c != ASCII_NULL) c += (*next == LIST_SEQUENCE) ? 1 : 2;
+	*line = c;
+	while (start < end && (*start == ASCII_SPACE || *start == '\t')) start++;
+	while (end > start && (end[-1] == ASCII_SPACE || end[-1] == '\t')) end--;
+	return strutil_substring(start, 0, end-start);
+}
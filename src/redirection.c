@@ -1,21 +1,38 @@
 // Standard: gnu99
 
+#define _GNU_SOURCE
+
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <readline/readline.h>
+
+#include "allocator.h"
+#include "builtin.h"
+#include "intern.h"
+#include "launch.h"
 #include "redirection.h"
+#include "tsh.h"
+#include "data-structs/vector.h"
 
 typedef struct redirection_symbol {
 	char* symbol;		// The symbol itself.
 	unsigned int index; // Its index in argv.
 } redir_sym;
 
+static Vector* entered = NULL;        	// Lines entered ahead of time, see redirect_lines().
+static unsigned int* enteredNext = NULL;
+
 /*
  * Raises an error with the given message, then terminates the program.
  * Argument(s):
@@ -42,7 +59,7 @@ static char** args_in_range(char* argv[], unsigned int start, unsigned int end)
 	unsigned int index;
 	for (unsigned int i = start; i <= end; i++) {
 		index = i-start;
-		args = realloc(args, (index+1) * sizeof(char*));
+		args = tsh_realloc(MEM_PARSER, args, (index+1) * sizeof(char*));
 		if (i == end) args[index] = NULL;
 		else args[index] = argv[i];
 	}
@@ -50,16 +67,33 @@ static char** args_in_range(char* argv[], unsigned int start, unsigned int end)
 }
 
 /*
- * Finds the given redirection symbol.
+ * Runs the child's command in the child itself if it is a builtin, so
+ * builtins can write to pipes and files (e.g. 'out | grep x'). Returns
+ * only if it is not a builtin.
+ */
+static void run_builtin_child(char* argv[], const bool* quoted) {
+	if (builtin_find(intern_find(argv[0])) == BUILTIN_NONE) return;
+	Vector tokens = vector_init(0);
+	for (unsigned int i = 0; argv[i] != NULL; i++)
+		vector_add(&tokens, i, argv[i]);
+	int status = run_tokens(&tokens, quoted);
+	fflush(stdout);
+	_exit(status);
+}
+
+/*
+ * Finds the given redirection symbol. Quoted words (e.g. '>') are
+ * arguments, not symbols.
  * Argument(s):
  *   int argc: The number of command line arguments.
  *   char* argv[]: The command line arguments.
+ *   const bool* quoted: Whether each argument was quoted, or NULL if none were.
  *   const char* symbol: The symbol to search for.
  *   redir_sym* sym: A pointer to the struct to store the symbol and its index in.
  */
-static void find_symbol(int argc, char* argv[], const char* symbol, redir_sym* rsym) {
+static void find_symbol(int argc, char* argv[], const bool* quoted, const char* symbol, redir_sym* rsym) {
 	for (int i = 1; i < (argc-1); i++) {
-		if (!strcmp(argv[i], symbol)) {
+		if (!strcmp(argv[i], symbol) && (quoted == NULL || !quoted[i])) {
 			rsym->symbol = argv[i];
 			rsym->index = i;
 			break;
@@ -72,31 +106,194 @@ static void find_symbol(int argc, char* argv[], const char* symbol, redir_sym* r
  * Argument(s):
  *   int argc: The number of command line arguments.
  *   char* argv[]: The command line arguments.
+ *   const bool* quoted: Whether each argument was quoted, or NULL if none were.
  * Returns:
- *   A 1 for Success or 0 as Failure.
+ *   The exit status of the program, or REDIRECT_NONE if there is no '<'.
  */
-int redirect_in(int argc, char* argv[]) {
+int redirect_in(int argc, char* argv[], const bool* quoted) {
 	redir_sym isym = {NULL, 0};
-	find_symbol(argc, argv, "<", &isym);
+	find_symbol(argc, argv, quoted, "<", &isym);
 	if (isym.symbol != NULL) {
 		char** before = args_in_range(argv, 0, isym.index);
 		char** after = args_in_range(argv, isym.index+1, argc);
-		int ret;
-		pid_t childPID = fork();
+		int ret = EXIT_FAILURE;
 		FILE* inf = fopen(after[0], "r");
+		if (inf == NULL) {
+			perror(after[0]);
+			tsh_free(before);
+			tsh_free(after);
+			return ret;
+		}
+		pid_t childPID = fork();
 		if (childPID == -1) // It broke
 			raise_errno(before[0]);
 		else if (childPID == 0) { // Child
 			dup2(fileno(inf), 0); // Make inf be the read end
+			launch_apply();
 			if (execvp(before[0], before))
 				raise_errno(before[0]);
 		} else // Parent
-			wait(&ret);
+			ret = wait_for(childPID);
 		fclose(inf);
-		free(before);
-		free(after);
-		return REDIRECT_SUCCESS;
-	} else return REDIRECT_FAILURE;
+		tsh_free(before);
+		tsh_free(after);
+		return ret;
+	} else return REDIRECT_NONE;
+}
+
+/*
+ * Creates a file descriptor that reads back the given content. Small
+ * payloads go through a pipe, which holds them without blocking; larger
+ * ones are written to an anonymous in-memory file so nothing touches the
+ * disk and the writer never waits on pipe capacity.
+ * Argument(s):
+ *   const char* content: the data to be read back.
+ *   size_t length: the number of bytes in 'content'.
+ * Returns:
+ *   A readable file descriptor positioned at the start of the content, or -1.
+ */
+static int inline_input(const char* content, size_t length) {
+	int filedes[2];
+	if (length > PIPE_BUF) {
+		int memfd = memfd_create("tsh-heredoc", MFD_CLOEXEC);
+		if (memfd != -1) {
+			size_t written = 0;
+			while (written < length) {
+				ssize_t amount = write(memfd, content+written, length-written);
+				if (amount < 0) break;
+				written += amount;
+			}
+			if (written == length && lseek(memfd, 0, SEEK_SET) == 0)
+				return memfd;
+			close(memfd);
+		}
+	}
+	if (pipe(filedes)) return -1;
+	if (length <= PIPE_BUF) { // Fits in the pipe without blocking
+		if (write(filedes[1], content, length) < 0) perror("T-Shell: write");
+	} else { // memfd_create is unavailable, so feed the pipe from an orphaned writer
+		pid_t writerPID = fork();
+		if (writerPID == 0) {
+			close(filedes[0]);
+			if (fork() == 0 && write(filedes[1], content, length) < 0)
+				_exit(EXIT_FAILURE);
+			_exit(EXIT_SUCCESS);
+		} else if (writerPID > 0) waitpid(writerPID, NULL, 0);
+	}
+	close(filedes[1]);
+	return filedes[0];
+}
+
+/*
+ * Reads the body of a Here-Document from the user, up to the delimiter:
+ * first from the lines entered ahead (see redirect_lines()), then from
+ * the terminal.
+ * Argument(s):
+ *   const char* delimiter: the line that ends the document.
+ *   size_t* length: where the length of the body is stored.
+ * Note for Memory Management:
+ *   Free the returned string when done.
+ * Returns:
+ *   The body of the document, each line ending in a newline.
+ */
+static char* read_heredoc(const char* delimiter, size_t* length) {
+	size_t capacity = BUFFER_SIZE;
+	char* body = tsh_calloc(MEM_PARSER, capacity, sizeof(char));
+	*length = 0;
+	char* line;
+	while ((line = entered != NULL && *enteredNext < entered->size ? strdup(vector_get(entered, (*enteredNext)++))
+	                                                               : readline("> ")) != NULL && strcmp(line, delimiter)) {
+		size_t lineLength = strlen(line);
+		while (*length + lineLength + 2 > capacity) capacity *= 2;
+		body = tsh_realloc(MEM_PARSER, body, capacity);
+		memcpy(body + *length, line, lineLength);
+		*length += lineLength;
+		body[(*length)++] = ASCII_NEWLINE;
+		free(line);
+	}
+	free(line);
+	return body;
+}
+
+/*
+ * Gives Here-Documents lines the user entered ahead of time (e.g. the
+ * rest of a paste) to read their bodies from, before the terminal.
+ * Argument(s):
+ *   Vector* lines: the lines, or NULL to read only from the terminal.
+ *   unsigned int* next: the next line to read, moved past those read.
+ */
+void redirect_lines(Vector* lines, unsigned int* next) {
+	entered = lines;
+	enteredNext = next;
+}
+
+/*
+ * Feeds inline text to the Standard Input of a program, either as a
+ * Here-String (cmd <<< words) or a Here-Document (cmd << DELIMITER).
+ * Argument(s):
+ *   int argc: The number of command line arguments.
+ *   char* argv[]: The command line arguments.
+ *   const bool* quoted: Whether each argument was quoted, or NULL if none were.
+ * Returns:
+ *   The exit status of the program, or REDIRECT_NONE if there is no '<<' or '<<<'.
+ */
+int redirect_heredoc(int argc, char* argv[], const bool* quoted) {
+	redir_sym hsym = {NULL, 0};
+	find_symbol(argc, argv, quoted, "<<<", &hsym);
+	if (hsym.symbol == NULL) find_symbol(argc, argv, quoted, "<<", &hsym);
+	if (hsym.symbol == NULL) {
+		for (int i = 1; i < (argc-1); i++) { // Delimiter attached, as in <<EOF
+			if (!strncmp(argv[i], "<<", 2) && argv[i][2] != '<' && argv[i][2] != ASCII_NULL && (quoted == NULL || !quoted[i])) {
+				hsym.symbol = argv[i];
+				hsym.index = i;
+				break;
+			}
+		}
+	}
+	if (hsym.symbol == NULL) return REDIRECT_NONE;
+	char** before = args_in_range(argv, 0, hsym.index);
+	char* content = NULL;
+	size_t length = 0;
+	if (!strcmp(hsym.symbol, "<<<")) { // The rest of the line, plus a newline
+		for (int i = hsym.index+1; i < (argc-1); i++) {
+			size_t wordLength = strlen(argv[i]);
+			content = tsh_realloc(MEM_PARSER, content, length + wordLength + 1);
+			memcpy(content+length, argv[i], wordLength);
+			length += wordLength;
+			content[length++] = (i < (argc-2)) ? ASCII_SPACE : ASCII_NEWLINE;
+		}
+	} else {
+		const char* delimiter = hsym.symbol[2] != ASCII_NULL ? hsym.symbol+2 : argv[hsym.index+1];
+		if (delimiter == NULL) {
+			fprintf(stderr, COLOR_RED "T-Shell: <<: Missing delimiter.\n" COLOR_RESET);
+			tsh_free(before);
+			return EXIT_FAILURE;
+		}
+		content = read_heredoc(delimiter, &length);
+	}
+	int infd = inline_input(content, length);
+	tsh_free(content);
+	if (infd == -1) {
+		perror(COLOR_RED "T-Shell: <<");
+		fputs(COLOR_RESET, stderr);
+		tsh_free(before);
+		return EXIT_FAILURE;
+	}
+	int ret = EXIT_FAILURE;
+	pid_t childPID = fork();
+	if (childPID == -1) // It broke
+		raise_errno(before[0]);
+	else if (childPID == 0) { // Child
+		dup2(infd, 0); // Make the inline text be the read end
+		close(infd);
+		launch_apply();
+		if (execvp(before[0], before))
+			raise_errno(before[0]);
+	} else // Parent
+		ret = wait_for(childPID);
+	close(infd);
+	tsh_free(before);
+	return ret;
 }
 
 /*
@@ -104,46 +301,109 @@ int redirect_in(int argc, char* argv[]) {
  * Argument(s):
  *   int argc: The number of command line arguments.
  *   char* argv[]: The command line arguments.
+ *   const bool* quoted: Whether each argument was quoted, or NULL if none were.
  * Returns:
- *   A 1 for Success or 0 as Failure.
+ *   The exit status of the program, or REDIRECT_NONE if there is no '>'.
  */
-int redirect_out(int argc, char* argv[]) {
+int redirect_out(int argc, char* argv[], const bool* quoted) {
 	redir_sym osym = {NULL, 0};
-	find_symbol(argc, argv, ">", &osym);
-	if (osym.symbol == NULL) find_symbol(argc, argv, ">>", &osym);
+	find_symbol(argc, argv, quoted, ">", &osym);
+	if (osym.symbol == NULL) find_symbol(argc, argv, quoted, ">>", &osym);
 	if (osym.symbol != NULL) {
 		char** before = args_in_range(argv, 0, osym.index);
 		char** after = args_in_range(argv, osym.index+1, argc);
-		int ret;
-		int filedes[2];
-		pipe(filedes);
-		pid_t childPID = fork();
-		if (childPID == -1) // It broke
-			raise_errno(before[0]);
-		else if (childPID == 0) { // Child
-			close(filedes[0]);
-			dup2(filedes[1], 1); // Make stdout be the write end
-			if (execvp(before[0], before))
+		int ret = EXIT_FAILURE;
+		int flags = O_WRONLY | O_CREAT;
+		if (!strcmp(osym.symbol, ">")) flags |= O_TRUNC; // Overwrite file
+		else flags |= O_APPEND; // Append to file
+		int outfd = open(after[0], flags, 0666);
+		if (outfd == -1)
+			perror(after[0]);
+		else {
+			pid_t childPID = fork();
+			if (childPID == -1) // It broke
 				raise_errno(before[0]);
-		} else { // Parent
-			close(filedes[1]);
-			wait(&ret);
+			else if (childPID == 0) { // Child
+				dup2(outfd, 1); // Make stdout be the file
+				close(outfd);
+				run_builtin_child(before, quoted);
+				launch_apply();
+				if (execvp(before[0], before))
+					raise_errno(before[0]);
+			} else // Parent
+				ret = wait_for(childPID);
+			close(outfd);
 		}
-		FILE* outf;
-		if (!strcmp(osym.symbol, ">"))
-			outf = fopen(after[0], "w+"); // Overwrite file
-		else if (!strcmp(osym.symbol, ">>"))
-			outf = fopen(after[0], "a+"); // Append to file
-		FILE* inf = fdopen(filedes[0], "r");
-		char buffer[64];
-		while (fgets(buffer, 64, inf) != NULL)
-			fprintf(outf, "%s", buffer);
-		fclose(outf);
-		fclose(inf);
-		free(before);
-		free(after);
-		return REDIRECT_SUCCESS;
-	} else return REDIRECT_FAILURE;
+		tsh_free(before);
+		tsh_free(after);
+		return ret;
+	} else return REDIRECT_NONE;
+}
+
+/*
+ * Tells whether a command sends its Standard Output to another process,
+ * so a builtin has to run in a child at one end (e.g. 'out | grep x').
+ * Argument(s):
+ *   int argc: The number of command line arguments.
+ *   char* argv[]: The command line arguments.
+ *   const bool* quoted: Whether each argument was quoted, or NULL if none were.
+ */
+bool redirect_output(int argc, char* argv[], const bool* quoted) {
+	const char* symbols[] = {"|", "=>", "=>>"};
+	for (unsigned int i = 0; i < sizeof(symbols) / sizeof(symbols[0]); i++) {
+		redir_sym rsym = {NULL, 0};
+		find_symbol(argc, argv, quoted, symbols[i], &rsym);
+		if (rsym.symbol != NULL) return true;
+	}
+	return false;
+}
+
+/*
+ * Sends the shell's own Standard Output to the file named by '>' or
+ * '>>' and takes both words out of the command, so a builtin writes to
+ * the file and still runs in the shell (e.g. 'cd /usr > /dev/null').
+ * redirect_restore() switches it back.
+ * Argument(s):
+ *   Vector* tokens: the command's words.
+ *   bool* quoted: whether each word was quoted, kept in step, or NULL.
+ *   int* saved: receives a copy of the Standard Output, or -1.
+ * Returns:
+ *   false, after printing why, if the file is missing or could not be opened.
+ */
+bool redirect_builtin(Vector* tokens, bool* quoted, int* saved) {
+	redir_sym osym = {NULL, 0};
+	*saved = -1;
+	find_symbol(tokens->size+1, (char**) tokens->array, quoted, ">", &osym);
+	if (osym.symbol == NULL) find_symbol(tokens->size+1, (char**) tokens->array, quoted, ">>", &osym);
+	if (osym.symbol == NULL) return true;
+	if (osym.index+1 >= tokens->size) {
+		fprintf(stderr, COLOR_RED "T-Shell: %s: Missing file name.\n" COLOR_RESET, osym.symbol);
+		return false;
+	}
+	char* file = vector_get(tokens, osym.index+1);
+	int outfd = open(file, O_WRONLY | O_CREAT | (!strcmp(osym.symbol, ">") ? O_TRUNC : O_APPEND), 0666);
+	if (outfd == -1) {
+		perror(file);
+		return false;
+	}
+	fflush(stdout);
+	*saved = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 10);
+	dup2(outfd, STDOUT_FILENO);
+	close(outfd);
+	vector_delete(tokens, osym.index+1);
+	vector_delete(tokens, osym.index);
+	if (quoted != NULL) memmove(quoted+osym.index, quoted+osym.index+2, (tokens->size-osym.index) * sizeof(bool));
+	return true;
+}
+
+/*
+ * Puts back the Standard Output after redirect_builtin().
+ */
+void redirect_restore(int saved) {
+	if (saved == -1) return;
+	fflush(stdout);
+	dup2(saved, STDOUT_FILENO);
+	close(saved);
 }
 
 /*
@@ -152,45 +412,197 @@ int redirect_out(int argc, char* argv[]) {
  * Argument(s):
  *   int argc: The number of command line arguments.
  *   char* argv[]: The command line arguments.
+ *   const bool* quoted: Whether each argument was quoted, or NULL if none were.
  * Returns:
- *   A 1 for Success or 0 as Failure.
+ *   The exit status of the second program, or REDIRECT_NONE if there is no '|'.
  */
-int redirect_pipe(int argc, char* argv[]) {
+int redirect_pipe(int argc, char* argv[], const bool* quoted) {
 	redir_sym psym = {NULL, 0};
-	find_symbol(argc, argv, "|", &psym);
+	find_symbol(argc, argv, quoted, "|", &psym);
 	if (psym.symbol != NULL) {
 		char** before = args_in_range(argv, 0, psym.index);
 		char** after = args_in_range(argv, psym.index+1, argc);
-		int ret;
 		int filedes[2];
 		pipe(filedes);
-		pid_t childPID = fork(); // Run first program
-		if (childPID == -1) // It broke
+		pid_t firstPID = fork(); // Run first program
+		if (firstPID == -1) // It broke
 			raise_errno(before[0]);
-		else if (childPID == 0) { // Child
+		else if (firstPID == 0) { // Child
 			close(filedes[0]);
 			dup2(filedes[1], 1); // Make stdout be the write end
+			close(filedes[1]);
+			run_builtin_child(before, quoted);
+			launch_apply();
 			if (execvp(before[0], before))
 				raise_errno(before[0]);
-		} else { // Parent
-			close(filedes[1]);
-			wait(&ret);
 		}
-		childPID = fork(); // Run second program
-		if (childPID == -1) // It broke
-			raise_errno(before[0]);
-		if (childPID == 0) { // Child
-			close(filedes[1]);
+		close(filedes[1]);
+		pid_t secondPID = fork(); // Run second program
+		if (secondPID == -1) // It broke
+			raise_errno(after[0]);
+		if (secondPID == 0) { // Child
 			dup2(filedes[0], 0); // Make stdin be the read end
+			launch_apply();
 			if (execvp(after[0], after))
-				raise_errno(before[0]);
+				raise_errno(after[0]);
 		}
-		else { // Parent
-			close(filedes[0]);
-			wait(&ret);
+		close(filedes[0]);
+		wait_for(firstPID); // Both run at once, so neither blocks on a full pipe
+		int ret = wait_for(secondPID);
+		tsh_free(before);
+		tsh_free(after);
+		return ret;
+	} else return REDIRECT_NONE;
+}
+
+/*
+ * Copies 'length' bytes through a user space buffer. Used when the
+ * kernel refuses to splice, e.g. into files opened for appending.
+ * Argument(s):
+ *   int from: the descriptor to read from.
+ *   int to: the descriptor to write to.
+ *   size_t length: the number of bytes to copy, or 0 for everything.
+ * Returns:
+ *   The number of bytes copied, or -1 on error.
+ */
+static ssize_t copy_fallback(int from, int to, size_t length) {
+	char buffer[BUFSIZ];
+	size_t copied = 0;
+	while (length == 0 || copied < length) {
+		size_t want = sizeof(buffer);
+		if (length != 0 && length-copied < want) want = length-copied;
+		ssize_t amount = read(from, buffer, want);
+		if (amount <= 0) return amount < 0 ? -1 : (ssize_t) copied;
+		for (ssize_t done = 0; done < amount; ) {
+			ssize_t written = write(to, buffer+done, amount-done);
+			if (written < 0) return -1;
+			done += written;
 		}
-		free(before);
-		free(after);
-		return REDIRECT_SUCCESS;
-	} else return REDIRECT_FAILURE;
+		copied += amount;
+	}
+	return copied;
+}
+
+/*
+ * Moves exactly 'length' bytes from a pipe to a descriptor.
+ * Argument(s):
+ *   int from: the read end of a pipe.
+ *   int to: the destination descriptor.
+ *   size_t length: the number of bytes to move.
+ * Returns:
+ *   0 on success, -1 on error.
+ */
+static int splice_all(int from, int to, size_t length) {
+	while (length > 0) {
+		ssize_t moved = splice(from, NULL, to, NULL, length, SPLICE_F_MOVE);
+		if (moved < 0 && errno == EINVAL) moved = copy_fallback(from, to, length);
+		if (moved <= 0) return -1;
+		length -= moved;
+	}
+	return 0;
+}
+
+/*
+ * Sends the Standard Output of a program, or of a pipe (a | b => file),
+ * to several files at once, and optionally on to another program
+ * (cmd => file1 file2 | other). Data is
+ * duplicated with tee(2) and moved with splice(2), so it is never copied
+ * into the shell's memory. "=>>" appends to the files instead.
+ * Argument(s):
+ *   int argc: The number of command line arguments.
+ *   char* argv[]: The command line arguments.
+ *   const bool* quoted: Whether each argument was quoted, or NULL if none were.
+ * Returns:
+ *   The exit status of the last program, or REDIRECT_NONE if there is no '=>'.
+ */
+int redirect_tee(int argc, char* argv[], const bool* quoted) {
+	redir_sym tsym = {NULL, 0};
+	find_symbol(argc, argv, quoted, "=>", &tsym);
+	if (tsym.symbol == NULL) find_symbol(argc, argv, quoted, "=>>", &tsym);
+	if (tsym.symbol == NULL) return REDIRECT_NONE;
+	redir_sym psym = {NULL, 0}; // A '|' after the files; one before is part of the producer
+	find_symbol(argc-tsym.index, argv+tsym.index, quoted == NULL ? NULL : quoted+tsym.index, "|", &psym);
+	psym.index += tsym.index;
+	unsigned int end = psym.symbol != NULL ? psym.index : (unsigned int) argc-1;
+	unsigned int amount = end - tsym.index - 1; // Number of files
+	if (amount == 0) {
+		fprintf(stderr, COLOR_RED "T-Shell: %s: Needs at least one file, as in cmd %s FILE... [| cmd].\n" COLOR_RESET,
+		        tsym.symbol, tsym.symbol);
+		return EXIT_FAILURE;
+	}
+	int flags = O_WRONLY | O_CREAT | (strcmp(tsym.symbol, "=>") ? O_APPEND : O_TRUNC);
+	int outputs[amount+1];
+	for (unsigned int i = 0; i < amount; i++) {
+		outputs[i] = open(argv[tsym.index+1+i], flags, 0666);
+		if (outputs[i] == -1) {
+			perror(argv[tsym.index+1+i]);
+			while (i-- > 0) close(outputs[i]);
+			return EXIT_FAILURE;
+		}
+	}
+	char** before = args_in_range(argv, 0, tsym.index);
+	int source[2], scratch[2], onward[2];
+	pipe(source);
+	pipe(scratch);
+	pid_t childPID = fork(); // Run the producer
+	if (childPID == -1) // It broke
+		raise_errno(before[0]);
+	else if (childPID == 0) { // Child
+		close(source[0]);
+		dup2(source[1], 1); // Make stdout be the write end
+		close(source[1]);
+		run_builtin_child(before, quoted);
+		int status = redirect_pipe(tsym.index+1, before, quoted); // a | b => file
+		if (status != REDIRECT_NONE) _exit(status);
+		launch_apply();
+		if (execvp(before[0], before))
+			raise_errno(before[0]);
+	}
+	close(source[1]);
+	pid_t consumerPID = 0;
+	if (psym.symbol != NULL) { // Run the program at the end of the pipe
+		char** after = args_in_range(argv, psym.index+1, argc);
+		pipe(onward);
+		consumerPID = fork();
+		if (consumerPID == -1) // It broke
+			raise_errno(after[0]);
+		else if (consumerPID == 0) { // Child
+			close(onward[1]);
+			dup2(onward[0], 0); // Make stdin be the read end
+			launch_apply();
+			if (execvp(after[0], after))
+				raise_errno(after[0]);
+		}
+		close(onward[0]);
+		outputs[amount++] = onward[1];
+		tsh_free(after);
+	}
+	while (amount > 0) {
+		ssize_t length;
+		if (amount == 1) { // Nothing to duplicate, just move it along
+			length = splice(source[0], NULL, outputs[0], NULL, INT_MAX, SPLICE_F_MOVE);
+			if (length < 0 && errno == EINVAL) length = copy_fallback(source[0], outputs[0], BUFSIZ);
+			if (length <= 0) break;
+			continue;
+		}
+		length = tee(source[0], scratch[1], INT_MAX, 0); // Duplicate what is available
+		if (length <= 0) break; // End of output
+		bool failed = splice_all(scratch[0], outputs[0], length);
+		for (unsigned int i = 1; i+1 < amount && !failed; i++)
+			failed = tee(source[0], scratch[1], length, 0) != length ||
+			         splice_all(scratch[0], outputs[i], length);
+		if (failed || splice_all(source[0], outputs[amount-1], length)) {
+			perror(COLOR_RED "T-Shell: =>");
+			fputs(COLOR_RESET, stderr);
+			break;
+		}
+	}
+	for (unsigned int i = 0; i < amount; i++) close(outputs[i]);
+	close(source[0]);
+	close(scratch[0]);
+	close(scratch[1]);
+	int ret = wait_for(childPID);
+	if (consumerPID > 0) ret = wait_for(consumerPID);
+	tsh_free(before);
+	return ret;
 }
@@ -0,0 +1,266 @@
+// Standard: gnu99
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "allocator.h"
+#include "event.h"
+#include "launch.h"
+#include "segment.h"
+#include "tsh.h"
+
+/*
+ * A prompt segment is a '%' code whose value is too slow to compute
+ * while the user waits for the prompt. Each prompt shows the last known
+ * value and starts a worker process that computes a fresh one and writes
+ * it down a pipe; when it arrives the prompt is repainted in place. A
+ * worker that takes longer than SEGMENT_TIMEOUT_MS is killed, along with
+ * anything it started, and the old value stays.
+ */
+typedef struct segment {
+	char code;                              	// Follows '%' in PROMPT=.
+	void (*compute)(char* value, size_t size);	// Runs in the worker.
+	bool local;                             	// Depends on the working directory.
+	char value[SEGMENT_VALUE_SIZE];         	// The last known value.
+	char* directory;                        	// Where it was computed, if 'local'.
+	char* pending;                          	// Where the worker is computing it.
+	pid_t worker;                           	// The running worker, or -1.
+	int output;                             	// Its end of the worker's pipe.
+	int timer;                              	// Kills the worker when it fires.
+} segment;
+
+static void compute_branch(char* value, size_t size);
+static void compute_load(char* value, size_t size);
+
+static segment segments[] = {
+	{.code = 'B', .compute = compute_branch, .local = true, .worker = -1, .output = -1, .timer = -1},
+	{.code = 'L', .compute = compute_load, .local = false, .worker = -1, .output = -1, .timer = -1},
+};
+#define SEGMENT_COUNT	(sizeof(segments) / sizeof(segments[0]))
+
+static SegmentRepaint repaint = NULL;	// Set once the event loop runs.
+
+/*
+ * Finds the Git directory of the repository containing the working
+ * directory, following '.git' files as used by worktrees and submodules.
+ * Returns:
+ *   false outside a repository.
+ */
+static bool find_git_directory(char* path, size_t size) {
+	if (getcwd(path, size) == NULL) return false;
+	while (true) {
+		size_t length = strlen(path);
+		snprintf(path + length, size - length, "%s.git", path[length-1] == '/' ? "" : "/");
+		struct stat info;
+		if (!stat(path, &info)) {
+			if (S_ISDIR(info.st_mode)) return true;
+			FILE* link = fopen(path, "r");
+			char target[BUFFER_SIZE];
+			bool found = link != NULL && fscanf(link, "gitdir: %255s", target) == 1;
+			if (link != NULL) fclose(link);
+			if (!found) return false;
+			if (target[0] == '/') snprintf(path, size, "%s", target);
+			else snprintf(path + length, size - length, "/%s", target); // Relative to the '.git' file
+			return true;
+		}
+		path[length] = ASCII_NULL;
+		if (!strcmp(path, "/")) return false;
+		char* parent = strrchr(path, '/');
+		if (parent == path) parent[1] = ASCII_NULL; // Keeps the root
+		else *parent = ASCII_NULL;
+	}
+}
+
+/*
+ * The current Git branch (or abbreviated commit, when detached),
+ * followed by '*' if tracked files have uncommitted changes.
+ */
+static void compute_branch(char* value, size_t size) {
+	char path[BUFSIZ];
+	if (!find_git_directory(path, sizeof(path) - 6)) return;
+	strcat(path, "/HEAD");
+	FILE* head = fopen(path, "r");
+	char line[BUFFER_SIZE] = "";
+	if (head == NULL || fgets(line, sizeof(line), head) == NULL) {
+		if (head != NULL) fclose(head);
+		return;
+	}
+	fclose(head);
+	line[strcspn(line, "\n")] = ASCII_NULL;
+	if (!strncmp(line, "ref: refs/heads/", 16)) snprintf(value, size - 1, "%s", line + 16);
+	else snprintf(value, size - 1, "%.7s", line);
+	int status[2]; // 'git status' is the slow part
+	if (pipe(status)) return;
+	pid_t git = fork();
+	if (git == 0) {
+		int null = open("/dev/null", O_RDWR);
+		dup2(null, STDIN_FILENO);
+		dup2(null, STDERR_FILENO);
+		dup2(status[1], STDOUT_FILENO);
+		launch_apply(); // Unblocks the signals the shell's event loop holds
+		execlp("git", "git", "--no-optional-locks", "status", "--porcelain", "--untracked-files=no", (char*) NULL);
+		_exit(127);
+	}
+	close(status[1]);
+	char change;
+	if (git > 0 && read(status[0], &change, 1) == 1) strcat(value, "*");
+	close(status[0]); // A dirty tree needs only one line of it
+	if (git > 0) waitpid(git, NULL, 0);
+}
+
+/*
+ * The load average of the last minute.
+ */
+static void compute_load(char* value, size_t size) {
+	double load;
+	if (getloadavg(&load, 1) == 1) snprintf(value, size, "%.2f", load);
+}
+
+static segment* find_segment(char code) {
+	for (size_t i = 0; i < SEGMENT_COUNT; i++)
+		if (segments[i].code == code) return &segments[i];
+	return NULL;
+}
+
+/*
+ * Starts repainting the prompt when segments change. Until then (i.e.
+ * when input is not driven by the event loop) segments stay empty.
+ * Argument(s):
+ *   SegmentRepaint handler: rebuilds and redraws the prompt.
+ */
+void segment_init(SegmentRepaint handler) {
+	repaint = handler;
+}
+
+/*
+ * Checks whether a prompt code is an asynchronous segment.
+ */
+bool segment_exists(char code) {
+	return find_segment(code) != NULL;
+}
+
+/*
+ * Stops waiting for a segment's worker.
+ */
+static void finish(segment* s) {
+	event_unwatch(s->output);
+	close(s->output);
+	event_cancel(s->timer);
+	s->output = s->timer = s->worker = -1;
+	tsh_free(s->pending);
+	s->pending = NULL;
+}
+
+/*
+ * Takes a fresh value from a worker and repaints the prompt if it changed.
+ */
+static void handle_value(int fd, void* data) {
+	segment* s = data;
+	char value[SEGMENT_VALUE_SIZE];
+	ssize_t length;
+	while ((length = read(fd, value, sizeof(value) - 1)) == -1 && errno == EINTR);
+	value[length > 0 ? length : 0] = ASCII_NULL; // Nothing means empty, e.g. outside a repository
+	bool moved = s->local && (s->directory == NULL || strcmp(s->directory, s->pending));
+	bool changed = moved || strcmp(value, s->value);
+	strcpy(s->value, value);
+	if (moved) {
+		tsh_free(s->directory);
+		s->directory = s->pending;
+		s->pending = NULL;
+	}
+	finish(s);
+	if (changed) repaint();
+}
+
+/*
+ * Kills a worker that is taking too long, and whatever it started.
+ */
+static void handle_timeout(int timer, void* data) {
+	(void) timer;
+	segment* s = data;
+	kill(-s->worker, SIGKILL); // Reaped with every other child
+	s->timer = -1;
+	finish(s);
+}
+
+/*
+ * Starts a worker for a segment.
+ */
+static void spawn(segment* s) {
+	int channel[2];
+	if (pipe2(channel, O_CLOEXEC)) return;
+	fflush(stdout);
+	s->worker = fork();
+	if (s->worker == 0) {
+		setpgid(0, 0); // Out of the terminal's way, and killed as one
+		close(channel[0]);
+		char value[SEGMENT_VALUE_SIZE] = "";
+		s->compute(value, sizeof(value));
+		ssize_t written = write(channel[1], value, strlen(value)); // Less than PIPE_BUF, so all at once
+		_exit(written == -1 ? EXIT_FAILURE : EXIT_SUCCESS);
+	}
+	close(channel[1]);
+	if (s->worker > 0) setpgid(s->worker, s->worker); // Whichever of the two runs first
+	if (s->worker == -1 || !event_watch(channel[0], handle_value, s)) {
+		if (s->worker > 0) kill(s->worker, SIGKILL);
+		close(channel[0]);
+		s->worker = -1;
+		return;
+	}
+	s->output = channel[0];
+	s->timer = event_timer(SEGMENT_TIMEOUT_MS, false, handle_timeout, s);
+	char* cwd = getcwd(NULL, 0);
+	s->pending = tsh_calloc(MEM_PROMPT, cwd != NULL ? strlen(cwd)+1 : 1, sizeof(char));
+	if (cwd != NULL) strcpy(s->pending, cwd);
+	free(cwd); // From getcwd(), not the tsh allocator
+}
+
+/*
+ * Starts workers for the segments a prompt format uses, unless one is
+ * still running.
+ * Argument(s):
+ *   const char* format: PROMPT= from '~/.tsh-rc'.
+ */
+void segment_refresh(const char* format) {
+	if (repaint == NULL) return;
+	for (const char* code = strchr(format, '%'); code != NULL; code = strchr(code+1, '%')) {
+		segment* s = find_segment(code[1]);
+		if (s != NULL && s->worker == -1) spawn(s);
+	}
+}
+
+/*
+ * Gets the last known value of a segment.
+ * Returns:
+ *   The value, or "" if none is known yet for the working directory.
+ */
+const char* segment_value(char code) {
+	segment* s = find_segment(code);
+	if (s == NULL) return "";
+	if (!s->local) return s->value;
+	char* cwd = getcwd(NULL, 0);
+	bool current = cwd != NULL && s->directory != NULL && !strcmp(cwd, s->directory);
+	free(cwd); // From getcwd(), not the tsh allocator
+	return current ? s->value : ""; // Another repository's branch would mislead
+}
+
+void segment_free(void) {
+	for (size_t i = 0; i < SEGMENT_COUNT; i++) {
+		if (segments[i].worker > 0) {
+			kill(-segments[i].worker, SIGKILL);
+			finish(&segments[i]);
+		}
+		tsh_free(segments[i].directory);
+		segments[i].directory = NULL;
+	}
+}
@@ -0,0 +1,169 @@
+// Standard: gnu99
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "allocator.h"
+#include "event.h"
+#include "server.h"
+#include "tsh.h"
+
+/*
+ * 'tsh --server SOCKET' reads the configuration and aliases once, then
+ * serves 'tools/tsh-client' over a Unix domain socket. Each connection
+ * is handled by a fork of the initialised server, so requests run side
+ * by side and nothing is read again: the request's descriptors become
+ * its Standard Input, Output and Error, it moves to the client's
+ * working directory and takes the client's environment, runs the line
+ * and sends back its exit status.
+ */
+static int listener = -1;         	// The listening socket.
+static ServerRunner runner = NULL;	// Runs a request's command line.
+
+/*
+ * Reads exactly 'length' bytes from a connection.
+ */
+static bool receive(int connection, char* buffer, size_t length) {
+	while (length > 0) {
+		ssize_t count = read(connection, buffer, length);
+		if (count == -1 && errno == EINTR) continue;
+		if (count <= 0) return false;
+		buffer += count;
+		length -= count;
+	}
+	return true;
+}
+
+/*
+ * Handles one request. Runs in its own process and does not return.
+ */
+static void serve(int connection) {
+	server_request request;
+	struct iovec io = {&request, sizeof(request)};
+	union {
+		char buffer[CMSG_SPACE(sizeof(int) * SERVER_FDS)];
+		struct cmsghdr align;
+	} control;
+	struct msghdr message = {.msg_iov = &io, .msg_iovlen = 1, .msg_control = control.buffer, .msg_controllen = sizeof(control.buffer)};
+	ssize_t length;
+	while ((length = recvmsg(connection, &message, MSG_CMSG_CLOEXEC)) == -1 && errno == EINTR);
+	struct cmsghdr* rights = CMSG_FIRSTHDR(&message);
+	if (length != sizeof(request) || request.magic != SERVER_MAGIC || rights == NULL ||
+	    rights->cmsg_level != SOL_SOCKET || rights->cmsg_type != SCM_RIGHTS ||
+	    rights->cmsg_len != CMSG_LEN(sizeof(int) * SERVER_FDS) ||
+	    (uint64_t) request.commandLength + request.environmentLength > SERVER_MAX_REQUEST)
+		_exit(EXIT_FAILURE); // Not a client
+	int fds[SERVER_FDS];
+	memcpy(fds, CMSG_DATA(rights), sizeof(fds));
+	size_t total = request.commandLength + request.environmentLength;
+	char* payload = tsh_calloc(MEM_SHELL, total+1, sizeof(char)); // The Null ends the last variable
+	if (!receive(connection, payload, total)) _exit(EXIT_FAILURE);
+
+	for (int i = 0; i < SERVER_FDS; i++) { // Out of the way of 0, 1 and 2 first
+		int moved = fcntl(fds[i], F_DUPFD_CLOEXEC, SERVER_FDS);
+		close(fds[i]);
+		fds[i] = moved;
+	}
+	dup2(fds[SERVER_STDIN], STDIN_FILENO);
+	dup2(fds[SERVER_STDOUT], STDOUT_FILENO);
+	dup2(fds[SERVER_STDERR], STDERR_FILENO);
+	int status = 126;
+	if (fchdir(fds[SERVER_CWD]))
+		fprintf(stderr, COLOR_RED "T-Shell: --server: Can not enter the working directory: %s\n" COLOR_RESET, strerror(errno));
+	else {
+		clearenv();
+		for (char* variable = payload + request.commandLength; variable < payload + total; variable += strlen(variable)+1)
+			if (strchr(variable, '=') != NULL) putenv(variable); // The payload outlives the process
+		char* line = tsh_calloc(MEM_PARSER, request.commandLength+1, sizeof(char));
+		memcpy(line, payload, request.commandLength);
+		status = runner(line);
+		tsh_free(line);
+	}
+	fflush(stdout);
+	fflush(stderr);
+	server_reply reply = {SERVER_MAGIC, status};
+	if (send(connection, &reply, sizeof(reply), MSG_NOSIGNAL) != sizeof(reply)) _exit(EXIT_FAILURE); // The client went away
+	_exit(EXIT_SUCCESS);
+}
+
+/*
+ * Accepts a connection from a client of the same user and forks to serve it.
+ */
+static void accept_request(int fd, void* data) {
+	(void) data;
+	int connection = accept4(fd, NULL, NULL, SOCK_CLOEXEC);
+	if (connection == -1) return;
+	struct ucred peer;
+	socklen_t size = sizeof(peer);
+	if (getsockopt(connection, SOL_SOCKET, SO_PEERCRED, &peer, &size) || peer.uid != geteuid()) {
+		close(connection);
+		return;
+	}
+	pid_t pid = fork();
+	if (pid == 0) {
+		close(listener);
+		serve(connection);
+	} else if (pid == -1) perror("T-Shell: --server: fork");
+	close(connection);
+}
+
+/*
+ * Reaps finished requests.
+ */
+static void reap(int signal) {
+	(void) signal;
+	while (waitpid(-1, NULL, WNOHANG) > 0);
+}
+
+static void stop(int signal) {
+	(void) signal;
+	event_stop();
+}
+
+/*
+ * Serves requests until SIGTERM or SIGINT.
+ * Argument(s):
+ *   const char* path: where to create the socket; a socket left there
+ *                     by a previous server is replaced.
+ *   ServerRunner run: runs a command line and returns its exit status.
+ * Returns:
+ *   The exit status of the shell.
+ */
+int server_run(const char* path, ServerRunner run) {
+	struct sockaddr_un address = {.sun_family = AF_UNIX};
+	if (strlen(path) >= sizeof(address.sun_path)) {
+		fprintf(stderr, COLOR_RED "T-Shell: --server: %s: Path too long for a socket.\n" COLOR_RESET, path);
+		return EXIT_FAILURE;
+	}
+	strcpy(address.sun_path, path);
+	struct stat info;
+	if (!lstat(path, &info) && S_ISSOCK(info.st_mode)) unlink(path); // Never anything else
+	runner = run;
+	listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	mode_t mask = umask(0077); // Only this user may connect
+	bool listening = listener != -1 && !bind(listener, (struct sockaddr*) &address, sizeof(address)) &&
+	                 !listen(listener, SOMAXCONN);
+	umask(mask);
+	if (!listening || !event_init() || !event_watch(listener, accept_request, NULL) ||
+	    !event_signal(SIGCHLD, reap) || !event_signal(SIGTERM, stop) || !event_signal(SIGINT, stop)) {
+		fprintf(stderr, COLOR_RED "T-Shell: --server: %s: %s\n" COLOR_RESET, path, strerror(errno));
+		if (listener != -1) close(listener);
+		return EXIT_FAILURE;
+	}
+	event_run();
+	close(listener);
+	unlink(path);
+	return EXIT_SUCCESS;
+}
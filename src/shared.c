@@ -0,0 +1,242 @@
+// Standard: gnu99
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <readline/history.h>
+
+#include "allocator.h"
+#include "shared.h"
+#include "data-structs/vector.h"
+
+#define SHARED_MAGIC	0x31485354	// "TSH1"
+#define SHARED_WAIT 	100       	// Milliseconds to wait for another session to set the segment up.
+#define SHARED_SPINS	1024      	// Reads of an odd alias generation before suspecting a dead writer.
+
+typedef struct alias_slot {
+	char name[SHARED_ALIAS_NAME];      	// Empty if the slot is free.
+	char command[SHARED_ALIAS_COMMAND];
+} alias_slot;
+
+typedef struct shared_line {
+	uint64_t sequence;     	// Position in the ring plus one once written, 0 while being written.
+	uint32_t pid;          	// The session that ran it.
+	char text[SHARED_LINE];
+} shared_line;
+
+/*
+ * One segment per user, holding the alias table and the History ring.
+ * Aliases are rewritten whole under a sequence lock: writers take flock()
+ * and make 'generation' odd while they copy, readers retry if it was odd
+ * or changed. History is appended without locks: a writer claims a
+ * position by incrementing 'head', then publishes the entry by storing
+ * its sequence number last.
+ */
+typedef struct shared_segment {
+	uint32_t magic;     	// SHARED_MAGIC once the creator has set it up.
+	uint32_t size;      	// sizeof(shared_segment), in case the layout changes.
+	uint64_t generation;	// Alias table sequence lock.
+	alias_slot aliases[SHARED_ALIASES];
+	uint64_t head;      	// Number of lines ever appended.
+	shared_line history[SHARED_HISTORY];
+} shared_segment;
+
+static shared_segment* segment = NULL;	// NULL in per-process mode.
+static int segmentfd = -1;
+static uint64_t cursor = 0;          	// Next History entry to pull in.
+
+/*
+ * FNV-1a, to place aliases in the shared table.
+ */
+static uint32_t hash(const char* text) {
+	uint32_t hash = 2166136261U;
+	for (const unsigned char* c = (const unsigned char*) text; *c != 0; c++)
+		hash = (hash ^ *c) * 16777619U;
+	return hash;
+}
+
+/*
+ * Attaches to this user's shared segment, creating it if this is the
+ * first session.
+ * Returns:
+ *   true if sessions share aliases and History, false to stay per-process.
+ */
+bool shared_init(void) {
+	char name[32];
+	snprintf(name, sizeof(name), "/tsh-%u", (unsigned int) getuid());
+	bool creator = (segmentfd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600)) != -1;
+	if (!creator && (errno != EEXIST || (segmentfd = shm_open(name, O_RDWR | O_CLOEXEC, 0)) == -1))
+		return false;
+	struct stat info;
+	if (creator && ftruncate(segmentfd, sizeof(shared_segment))) info.st_size = 0;
+	else for (int waited = 0; !fstat(segmentfd, &info) && info.st_size == 0 && waited < SHARED_WAIT; waited++)
+		usleep(1000); // The creator has not sized it yet
+	void* area = MAP_FAILED;
+	if (info.st_size == sizeof(shared_segment))
+		area = mmap(NULL, sizeof(shared_segment), PROT_READ | PROT_WRITE, MAP_SHARED, segmentfd, 0);
+	if (area == MAP_FAILED) {
+		close(segmentfd);
+		segmentfd = -1;
+		return false;
+	}
+	segment = area;
+	if (creator) { // Fresh pages are zeroed, so only the header needs setting
+		segment->size = sizeof(shared_segment);
+		__atomic_store_n(&segment->magic, SHARED_MAGIC, __ATOMIC_RELEASE);
+	} else for (int waited = 0; __atomic_load_n(&segment->magic, __ATOMIC_ACQUIRE) != SHARED_MAGIC && waited < SHARED_WAIT; waited++)
+		usleep(1000);
+	if (segment->magic != SHARED_MAGIC || segment->size != sizeof(shared_segment)) { // Another version of tsh
+		shared_free();
+		return false;
+	}
+	uint64_t head = __atomic_load_n(&segment->head, __ATOMIC_ACQUIRE);
+	cursor = head > SHARED_HISTORY ? head - SHARED_HISTORY : 0; // Starts with the recent History of every session
+	return true;
+}
+
+/*
+ * Checks whether this session is attached to the shared segment.
+ */
+bool shared_active(void) {
+	return segment != NULL;
+}
+
+/*
+ * Replaces the shared alias table. Aliases too long for their slots,
+ * or beyond the table's capacity, are left out.
+ * Argument(s):
+ *   Vector* names: the alias names.
+ *   Vector* commands: the real command for each name.
+ */
+void shared_publish_aliases(Vector* names, Vector* commands) {
+	alias_slot* table = tsh_calloc(MEM_ALIAS, SHARED_ALIASES, sizeof(alias_slot));
+	for (unsigned int i = 0, used = 0; i < names->size && used < SHARED_ALIASES; i++) {
+		const char* name = vector_get(names, i);
+		const char* command = vector_get(commands, i);
+		if (strlen(name) >= SHARED_ALIAS_NAME || strlen(command) >= SHARED_ALIAS_COMMAND) continue;
+		uint32_t index = hash(name) % SHARED_ALIASES;
+		while (table[index].name[0] != 0 && strcmp(table[index].name, name))
+			index = (index+1) % SHARED_ALIASES;
+		used += table[index].name[0] == 0;
+		strcpy(table[index].name, name);
+		strcpy(table[index].command, command);
+	}
+	flock(segmentfd, LOCK_EX); // One writer at a time
+	__atomic_add_fetch(&segment->generation, 1, __ATOMIC_RELAXED); // Odd: readers wait
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(segment->aliases, table, sizeof(segment->aliases));
+	__atomic_add_fetch(&segment->generation, 1, __ATOMIC_RELEASE);
+	flock(segmentfd, LOCK_UN);
+	tsh_free(table);
+}
+
+/*
+ * Waits until no session is rewriting the alias table.
+ * A writer that died part way leaves the generation odd. Its lock died
+ * with it, so taking the lock tells a slow writer from a dead one; then
+ * the generation is made even again, and the table, part old and part
+ * new, serves until the next publish.
+ * Returns:
+ *   The generation of the table, always even.
+ */
+static uint64_t stable_generation(void) {
+	uint64_t generation;
+	for (int spins = 0; (generation = __atomic_load_n(&segment->generation, __ATOMIC_ACQUIRE)) & 1; spins++) {
+		if (spins < SHARED_SPINS) continue;
+		flock(segmentfd, LOCK_EX); // Waits for a writer that is still alive
+		generation = __atomic_load_n(&segment->generation, __ATOMIC_ACQUIRE);
+		if (generation & 1) generation = __atomic_add_fetch(&segment->generation, 1, __ATOMIC_RELEASE);
+		flock(segmentfd, LOCK_UN);
+		break;
+	}
+	return generation;
+}
+
+/*
+ * Looks up an alias in the shared table.
+ * Argument(s):
+ *   const char* name: the alias.
+ *   char* command: receives the real command.
+ *   size_t size: the size of 'command'.
+ * Returns:
+ *   true if 'name' is an alias.
+ */
+bool shared_alias(const char* name, char* command, size_t size) {
+	uint32_t start = hash(name) % SHARED_ALIASES;
+	uint64_t generation;
+	bool found;
+	do {
+		generation = stable_generation();
+		found = false;
+		for (uint32_t i = 0, index = start; i < SHARED_ALIASES && segment->aliases[index].name[0] != 0; i++) {
+			if (!strncmp(segment->aliases[index].name, name, SHARED_ALIAS_NAME)) {
+				strncpy(command, segment->aliases[index].command, size-1);
+				command[size-1] = 0;
+				found = true;
+				break;
+			}
+			index = (index+1) % SHARED_ALIASES;
+		}
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while (__atomic_load_n(&segment->generation, __ATOMIC_RELAXED) != generation); // Rewritten meanwhile
+	return found;
+}
+
+/*
+ * Appends a line to the shared History ring.
+ * Argument(s):
+ *   const char* line: the line, skipped if longer than SHARED_LINE.
+ */
+void shared_history_add(const char* line) {
+	size_t length = strlen(line);
+	if (segment == NULL || length >= SHARED_LINE) return;
+	uint64_t position = __atomic_fetch_add(&segment->head, 1, __ATOMIC_ACQ_REL);
+	shared_line* entry = &segment->history[position % SHARED_HISTORY];
+	__atomic_store_n(&entry->sequence, 0, __ATOMIC_RELAXED); // Readers skip it until it is complete
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	entry->pid = getpid();
+	memcpy(entry->text, line, length+1);
+	__atomic_store_n(&entry->sequence, position+1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Adds lines run by other sessions since the last call to the
+ * readline History list.
+ */
+void shared_history_sync(void) {
+	if (segment == NULL) return;
+	uint64_t head = __atomic_load_n(&segment->head, __ATOMIC_ACQUIRE);
+	if (head - cursor > SHARED_HISTORY) cursor = head - SHARED_HISTORY; // The rest was overwritten
+	uint32_t pid = getpid();
+	char text[SHARED_LINE];
+	for (; cursor < head; cursor++) {
+		shared_line* entry = &segment->history[cursor % SHARED_HISTORY];
+		uint64_t sequence = __atomic_load_n(&entry->sequence, __ATOMIC_ACQUIRE);
+		if (sequence == 0) continue; // Still being written (or its writer died), so missed
+		if (sequence != cursor+1) continue; // Already overwritten by a newer line
+		uint32_t owner = entry->pid;
+		memcpy(text, entry->text, sizeof(text));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&entry->sequence, __ATOMIC_RELAXED) != sequence) continue; // Overwritten while copying
+		text[sizeof(text)-1] = 0;
+		if (owner != pid) add_history(text);
+	}
+}
+
+/*
+ * Detaches from the shared segment. It stays behind for other sessions.
+ */
+void shared_free(void) {
+	if (segment != NULL) munmap(segment, sizeof(shared_segment));
+	if (segmentfd != -1) close(segmentfd);
+	segment = NULL;
+	segmentfd = -1;
+}
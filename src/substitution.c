@@ -0,0 +1,216 @@
+// Standard: gnu99
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "allocator.h"
+#include "strutil/strutil.h"
+#include "substitution.h"
+#include "tsh.h"
+
+typedef struct capture_buffer {
+	char* data;     	// The captured output.
+	size_t length;  	// Bytes currently in use.
+	size_t capacity;	// Bytes allocated.
+} capture;
+
+static capture output = {NULL, 0, 0}; // Reused by every substitution within a line.
+
+/*
+ * Makes sure the capture buffer can hold 'extra' more bytes.
+ * Argument(s):
+ *   size_t extra: the number of bytes about to be written.
+ */
+static void capture_reserve(size_t extra) {
+	if (output.length + extra <= output.capacity) return;
+	size_t capacity = output.capacity ? output.capacity : BUFFER_SIZE;
+	while (capacity < output.length + extra) capacity *= 2;
+	output.data = tsh_realloc(MEM_PARSER, output.data, capacity);
+	output.capacity = capacity;
+}
+
+/*
+ * Runs a command through the shell and captures its Standard Output.
+ * The output is left in 'output', with trailing newlines stripped and
+ * every run of whitespace collapsed into a single space (word splitting).
+ * Argument(s):
+ *   char* command: the command list to run (consumed by the child only).
+ */
+static void capture_command(char* command) {
+	output.length = 0;
+	int filedes[2];
+	if (pipe(filedes)) {
+		perror(COLOR_RED "T-Shell: substitution");
+		fputs(COLOR_RESET, stdout);
+		return;
+	}
+	fflush(stdout); // Don't let the child inherit pending output
+	pid_t childPID = fork();
+	if (childPID == -1) {
+		perror(COLOR_RED "T-Shell: fork");
+		fputs(COLOR_RESET, stdout);
+		close(filedes[0]);
+		close(filedes[1]);
+		return;
+	} else if (childPID == 0) { // Child
+		close(filedes[0]);
+		dup2(filedes[1], 1); // Make stdout be the write end
+		close(filedes[1]);
+		exit(run_list(command));
+	}
+	close(filedes[1]);
+	ssize_t amount;
+	do {
+		capture_reserve(BUFFER_SIZE);
+		amount = read(filedes[0], output.data + output.length, output.capacity - output.length);
+		if (amount > 0) output.length += amount;
+	} while (amount > 0);
+	close(filedes[0]);
+	waitpid(childPID, NULL, 0);
+
+	while (output.length > 0 && output.data[output.length-1] == ASCII_NEWLINE)
+		output.length--;
+	size_t words = 0;
+	for (size_t i = 0; i < output.length; i++) { // Splits the output into words
+		char c = output.data[i];
+		if (c == ASCII_SPACE || c == '\t' || c == ASCII_NEWLINE) {
+			if (words > 0 && output.data[words-1] != ASCII_SPACE)
+				output.data[words++] = ASCII_SPACE;
+		} else output.data[words++] = c;
+	}
+	if (words > 0 && output.data[words-1] == ASCII_SPACE) words--;
+	output.length = words;
+}
+
+/*
+ * Finds the end of a substitution that begins at 'start'.
+ * Argument(s):
+ *   char* start: points at the '$' of "$(" or at an opening backtick.
+ * Returns:
+ *   A pointer to the closing character, or NULL if it is unterminated.
+ */
+static char* find_closing(char* start) {
+	if (*start == '`') return strchr(start+1, '`');
+	int depth = 0;
+	for (char* c = start+1; *c != ASCII_NULL; c++) {
+		if (*c == '(') depth++;
+		else if (*c == ')' && --depth == 0) return c;
+	}
+	return NULL;
+}
+
+/*
+ * Appends text to a growing string.
+ */
+static char* append(char* result, size_t* length, size_t* capacity, const char* text, size_t amount) {
+	if (*length+amount+1 > *capacity) {
+		while (*length+amount+1 > *capacity) *capacity *= 2;
+		result = tsh_realloc(MEM_PARSER, result, *capacity);
+	}
+	memcpy(result+*length, text, amount);
+	*length += amount;
+	return result;
+}
+
+/*
+ * Appends the captured output so that it is only split into words and
+ * never read as syntax: each word goes in single quotes, or inside
+ * double quotes the characters they treat specially are escaped.
+ */
+static char* append_output(char* result, size_t* length, size_t* capacity, bool inDouble) {
+	for (size_t i = 0; i < output.length; ) {
+		char c = output.data[i];
+		if (inDouble) {
+			if (strchr("\"\\$`", c) != NULL) result = append(result, length, capacity, "\\", 1);
+			result = append(result, length, capacity, &c, 1);
+			i++;
+		} else if (c == ASCII_SPACE) { // Words are already one space apart
+			result = append(result, length, capacity, " ", 1);
+			i++;
+		} else {
+			size_t end = i;
+			while (end < output.length && output.data[end] != ASCII_SPACE) end++;
+			result = append(result, length, capacity, "'", 1);
+			for (; i < end; i++) {
+				if (output.data[i] == '\'') result = append(result, length, capacity, "'\\''", 4);
+				else result = append(result, length, capacity, output.data+i, 1);
+			}
+			result = append(result, length, capacity, "'", 1);
+		}
+	}
+	return result;
+}
+
+static void release_output(void) {
+	tsh_free(output.data);
+	output.data = NULL;
+	output.length = output.capacity = 0;
+}
+
+/*
+ * Replaces every "$(command)" and "`command`" in the input with the
+ * output of the command, quoted so that it stays text: operators,
+ * quotes and braces in it are not syntax. Text inside single quotes is
+ * left alone.
+ * Argument(s):
+ *   char* input: the user input, freed if any substitution is made.
+ * Note for Memory Management:
+ *   Free the returned string when done.
+ * Returns:
+ *   The input with all substitutions applied.
+ */
+char* substitute(char* input) {
+	if (strchr(input, '`') == NULL && !strutil_contains(input, "$(")) return input;
+	size_t length = 0;
+	size_t capacity = strlen(input)+1;
+	char* result = tsh_calloc(MEM_PARSER, capacity, sizeof(char));
+	char quote = ASCII_NULL;
+	for (char* c = input; *c != ASCII_NULL; c++) {
+		char* end = NULL;
+		if (quote == '\'') {
+			if (*c == '\'') quote = ASCII_NULL;
+		} else if (*c == '\\' && c[1] != ASCII_NULL) {
+			result = append(result, &length, &capacity, c++, 1); // The escaped character follows
+		} else if (*c == '\'' && quote == ASCII_NULL) quote = '\'';
+		else if (*c == '"') quote = quote == '"' ? ASCII_NULL : '"';
+		else if (*c == '`' || (c[0] == '$' && c[1] == '('))
+			end = find_closing(c);
+		if (end == NULL) {
+			result = append(result, &length, &capacity, c, 1);
+			continue;
+		}
+		char* inner = *c == '`' ? c+1 : c+2;
+		char* command = strutil_substring(inner, 0, end-inner);
+		capture_command(command);
+		tsh_free(command);
+		result = append_output(result, &length, &capacity, quote == '"');
+		c = end;
+	}
+	result[length] = ASCII_NULL;
+	release_output();
+	tsh_free(input);
+	return result;
+}
+
+/*
+ * Runs a single substitution and returns its output as it is, split
+ * into words but not quoted, for callers that quote it themselves.
+ * Argument(s):
+ *   const char* text: the whole "$(command)" or "`command`".
+ * Note for Memory Management:
+ *   Free the returned string when done.
+ */
+char* substitute_output(const char* text) {
+	const char* inner = text[0] == '`' ? text+1 : text+2;
+	char* command = strutil_substring((char*) inner, 0, strlen(inner)-1);
+	capture_command(command);
+	tsh_free(command);
+	char* result = tsh_calloc(MEM_PARSER, output.length+1, sizeof(char));
+	if (output.length > 0) memcpy(result, output.data, output.length);
+	release_output();
+	return result;
+}
@@ -1,64 +1,129 @@
 // Standard: gnu99
 
 #include <errno.h>
+#include <fcntl.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
 #include <readline/history.h>
 #include <readline/readline.h>
 
+#include "allocator.h"
 #include "alias.h"
+#include "audit.h"
+#include "bench.h"
+#include "builtin.h"
+#include "cache.h"
+#include "capture.h"
 #include "configuration.h"
+#include "coproc.h"
 #include "data-structs/hash.h"
+#include "directory.h"
+#include "editor.h"
+#include "event.h"
+#include "expansion.h"
+#include "intern.h"
+#include "launch.h"
+#include "parser.h"
 #include "redirection.h"
+#include "segment.h"
+#include "server.h"
+#include "shared.h"
 #include "strutil/strutil.h"
+#include "substitution.h"
 #include "tsh.h"
 #include "data-structs/vector.h"
+#include "vm.h"
+#include "watch.h"
 
 /*
  * Changes the current working directory.
  * Argument(s):
  *   Vector* tokens: a pointer to the tokenized user input
+ * Returns:
+ *   0 on success, 1 on failure.
  */
-static void changeDir(Vector* tokens) {
+static int changeDir(Vector* tokens) {
 	int error = 0;
 	if (tokens->size == 2) // Changes to the given directory
 		error = chdir((char*) vector_get(tokens, 1));
 	else if (tokens->size == 1) // Changes to the user's home directory
 		error = chdir(getenv("HOME"));
-	else
+	else {
 		printf(COLOR_RED "T-Shell: cd: Too many arguments.\n" COLOR_RESET);
+		return EXIT_FAILURE;
+	}
 	if (error) {
 		perror(COLOR_RED "T-Shell: cd");
 		puts(COLOR_RESET);
+		return EXIT_FAILURE;
 	}
+	directory_visit(); // Ranks it for 'z'
+	return EXIT_SUCCESS;
+}
+
+static struct timeval childUser;  	// CPU time of every child waited for,
+static struct timeval childSystem;	// in user and kernel mode.
+
+/*
+ * Waits for a child process to finish, adding its CPU time to the tally.
+ * Argument(s):
+ *   pid_t pid: the child to wait for.
+ * Returns:
+ *   The exit status of the child, or 128 plus the signal that killed it.
+ */
+int wait_for(pid_t pid) {
+	int status;
+	struct rusage usage;
+	while (wait4(pid, &status, 0, &usage) == -1)
+		if (errno != EINTR) return EXIT_FAILURE;
+	timeradd(&childUser, &usage.ru_utime, &childUser);
+	timeradd(&childSystem, &usage.ru_stime, &childSystem);
+	if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+	return WEXITSTATUS(status);
+}
+
+/*
+ * Reports the CPU time of every child waited for so far.
+ * Argument(s):
+ *   struct timeval* user: receives the time spent in user mode.
+ *   struct timeval* system: receives the time spent in the kernel.
+ */
+void wait_usage(struct timeval* user, struct timeval* system) {
+	*user = childUser;
+	*system = childSystem;
 }
 
 /*
  * Runs an external program.
  * Argument(s):
  *   char** extArgv: potential arguments for the program
+ * Returns:
+ *   The exit status of the program.
  */
-static void execute(char** extArgv) {
-	int childExitStatus;
+static int execute(char** extArgv) {
 	pid_t childPID = fork(); /* Creates a new process for an
 	                            external program to run in */
 	if (childPID >= 0) { // Was fork successful?
 		if (childPID == 0) {
+			launch_apply(); // CPU affinity, priority and memory policy
 			if (execvp(extArgv[0], extArgv) == -1) { // Run child process
 				printf(COLOR_RED "T-Shell: exec: \'%s\' is not a recognized command...\n" COLOR_RESET, extArgv[0]);
 				exit(EXIT_FAILURE);
 			}
-		} else wait(&childExitStatus); // Parent (this) process waits for child to finish
+		} else return wait_for(childPID); // Parent (this) process waits for child to finish
 	} else {
 		perror(COLOR_RED "T-Shell: fork");
 		puts(COLOR_RESET);
 	}
+	return EXIT_FAILURE;
 }
 
 /*
@@ -72,126 +137,680 @@ static void execute(char** extArgv) {
  *   The absolute path of the file.
  */
 char* construct_path(char* filename) {
-	char* filePath = calloc(BUFFER_SIZE, sizeof(char));
+	char* filePath = tsh_calloc(MEM_SHELL, BUFFER_SIZE, sizeof(char));
 	strcpy(filePath, getenv("HOME"));
 	strcat(filePath, "/");
 	strcat(filePath, filename);
 	return filePath;
 }
 
+static volatile sig_atomic_t interrupted = 0; // Ctrl-C when input is a file, see tsh_interrupted().
+
 /*
  * Defines how Control-C (SIGINT) behaves.
  */
-static void ctrlC() {/* Intentionally Blank */}
+static void ctrlC() {
+	interrupted = 1;
+}
+
+static Configuration config;	// Options read from '~/.tsh-rc'.
+static HashTable rawcmds;   	// Aliases mapped to the real commands.
+static Vector aliases;      	// The aliased command names.
+static char* history_path;  	// Absolute path of the History file.
+static bool running = true; 	// Cleared by the exit builtins.
+static bool looping = false;	// Input is driven by the event loop.
+static bool editing = false;	// Lines come from the built-in editor, not readline.
+static Vector pendingHistory;	// This session's lines not yet written to the History file.
+static int historyTimer = -1;	// Writes the pending entries when it fires.
+static char* script = NULL;  	// Lines of a compound command still missing its end.
 
 /*
- * The Shells main function.
+ * Checks whether the shell should keep running, i.e. no exit builtin has run.
+ */
+bool tsh_running(void) {
+	return running;
+}
+
+/*
+ * Checks whether Ctrl-C was pressed since the current line started, so
+ * compiled loops and functions can stop. The event loop keeps SIGINT
+ * blocked, so it waits there until the line is done.
+ */
+bool tsh_interrupted(void) {
+	return interrupted || event_pending(SIGINT);
+}
+
+/*
+ * Forgets the lines not yet written to the History file.
+ */
+static void discard_history(void) {
+	for (unsigned int i = 0; i < pendingHistory.size; i++)
+		tsh_free(vector_get(&pendingHistory, i));
+	vector_empty(&pendingHistory);
+}
+
+/*
+ * Runs a builtin command.
+ * Argument(s):
+ *   Builtin id: the builtin named by the command.
+ *   Vector* tokens: the command and its arguments.
+ *   const bool* quoted: whether each word was quoted.
+ *   int* status: receives the exit status.
+ * Returns:
+ *   false if the command is not a builtin after all (e.g. 'help' with
+ *   arguments), so it runs as an external program instead.
+ */
+static bool run_builtin(Builtin id, Vector* tokens, const bool* quoted, int* status) {
+	*status = EXIT_SUCCESS;
+	switch (id) {
+		case BUILTIN_HELP:
+			if (tokens->size != 1) return false;
+			puts(COLOR_GREEN);
+			puts("help: Displays this message.");
+			puts("exit, quit, logout: Closes the shell.");
+			puts("cd [dir]: Attempts to change into the given directory.");
+			puts("z [-l] [words]: Jumps to (or lists) the most frecent directory matching the words.");
+			puts("pushd [dir], popd, dirs: Manage the directory stack.");
+			puts("history clear: Empties the history file.");
+			puts("bench [-n N] [-w WARMUP] [-v] [-c CSV] [-j JSON] cmd: Times repeated runs of cmd.");
+			puts("out [N | -l]: Replays the output of the Nth last command (CAPTURE= in ~/.tsh-rc), or lists them.");
+			puts("coproc NAME cmd | coproc -k NAME | coproc: Starts cmd as a coprocess, reached with >&NAME and <&NAME; ends or lists them.");
+			puts("cache [--ttl S] [--dep FILE]... cmd: Replays the saved output of cmd while it and its dependencies are unchanged.");
+			puts("mem: Reports the shell's memory usage by subsystem.");
+			puts("keystats: Reports the built-in line editor's keystroke latency.");
+			puts("pin CPUS | prio [-n] N | ioprio CLASS[:N] | numa NODE cmd: Launches cmd with the given affinity or priority.");
+			puts("if, while, until, for, case, name() { ... }: Control flow and functions.");
+			puts(COLOR_RESET);
+			return true;
+		case BUILTIN_EXIT:
+		case BUILTIN_QUIT:
+		case BUILTIN_LOGOUT:
+			if (tokens->size != 1) return false;
+			running = false;
+			return true;
+		case BUILTIN_MEM:
+			if (tokens->size != 1) return false;
+			mem_report();
+			intern_report();
+			return true;
+		case BUILTIN_KEYSTATS:
+			if (tokens->size != 1) return false;
+			editor_report();
+			return true;
+		case BUILTIN_HISTORY:
+			if (tokens->size != 2 || strcmp((char*) vector_get(tokens, 1), "clear")) return false;
+			discard_history();
+			*status = truncate(history_path, 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+			return true;
+		case BUILTIN_BENCH: *status = bench_run(tokens, quoted); return true;
+		case BUILTIN_OUT: *status = capture_replay(tokens); return true;
+		case BUILTIN_CACHE: *status = cache_run(tokens, quoted); return true;
+		case BUILTIN_COPROC: *status = coproc_run(tokens); return true;
+		case BUILTIN_CD: *status = changeDir(tokens); return true;
+		case BUILTIN_Z: *status = directory_jump(tokens); return true;
+		case BUILTIN_PUSHD: *status = directory_push(tokens); return true;
+		case BUILTIN_POPD: *status = directory_pop(tokens); return true;
+		case BUILTIN_DIRS: *status = directory_print(tokens); return true;
+		default: return false;
+	}
+}
+
+/*
+ * Runs a tokenized command: builtins, aliases, functions, redirection
+ * and external programs.
+ * Argument(s):
+ *   Vector* tokens: the command's words, which may be rearranged.
+ *   const bool* quoted: whether each word was quoted, and so is never an
+ *   operator (see Expansion), or NULL if none were.
+ * Returns:
+ *   The exit status of the command.
+ */
+int run_tokens(Vector* tokens, const bool* quoted) {
+	int status = EXIT_SUCCESS;
+	if (tokens->size == 0) return EXIT_SUCCESS;
+	unsigned int words = tokens->size;
+	if (!launch_parse(tokens)) return EXIT_FAILURE;
+	int shift = words - tokens->size; // Where the flag of each remaining word is
+	const char* command = intern_find((char*) vector_get(tokens, 0)); // Compared by address; NULL if nothing has this name
+	//==================================================================================
+	// Injecting the real commands into user input before running.
+	char line[BUFFER_SIZE];
+	char* rawcmd = shared_active() || command == NULL ? NULL : (char*) hash_lookUp(&rawcmds, command);
+	if (rawcmd != NULL) {
+		strncpy(line, rawcmd, sizeof(line)-1);
+		line[sizeof(line)-1] = ASCII_NULL;
+	}
+	unsigned int injected = 0; // Words from an alias, never quoted
+	if (rawcmd != NULL || (shared_active() && shared_alias((char*) vector_get(tokens, 0), line, sizeof(line)))) { // Does the command have an alias?
+		Vector args = vector_split(line, " ");
+		for (register unsigned int j = args.size-1; j > 0; j--)
+			vector_add(tokens, 1, vector_get(&args, j));
+		vector_set(tokens, 0, vector_get(&args, 0)); // The real command replaces the alias
+		injected = args.size;
+		shift += 1 - (int) args.size;
+		tsh_free(args.array);
+		command = intern_find((char*) vector_get(tokens, 0));
+	}
+	bool* flags = tsh_calloc(MEM_PARSER, tokens->size+1, sizeof(bool)); // Kept in step as words are taken out
+	for (unsigned int j = injected; quoted != NULL && j < tokens->size; j++)
+		flags[j] = quoted[j+shift];
+	//==================================================================================
+	int saved[2];
+	if (!coproc_redirect(tokens, flags, saved)) { // '>&NAME' and '<&NAME'
+		tsh_free(flags);
+		return EXIT_FAILURE;
+	}
+	Builtin builtin = builtin_find(command);
+	bool piped = redirect_output(tokens->size+1, (char**) tokens->array, flags); // Builtins then run in the child writing to the pipe
+	int savedOut = -1; // A builtin's '> FILE' is done in the shell, so 'cd' and 'exit' still work
+	if (builtin != BUILTIN_NONE && !piped && !redirect_builtin(tokens, flags, &savedOut)) {
+		coproc_restore(saved);
+		tsh_free(flags);
+		return EXIT_FAILURE;
+	}
+	if ((piped || !run_builtin(builtin, tokens, flags, &status)) &&
+	    (status = vm_call(command, tokens)) == VM_NOT_FUNCTION) {
+		//------------------------------------------------------------------------------
+		// Sets up argv, then runs the command
+		char* extArgv[tokens->size+1];
+		for (register unsigned int j = 0; j < tokens->size; j++)
+			extArgv[j] = (char*) vector_get(tokens, j);
+		extArgv[tokens->size] = NULL;
+		if ((status = redirect_tee(tokens->size+1, extArgv, flags)) == REDIRECT_NONE &&
+			(status = redirect_pipe(tokens->size+1, extArgv, flags)) == REDIRECT_NONE &&
+			(status = redirect_heredoc(tokens->size+1, extArgv, flags)) == REDIRECT_NONE &&
+			(status = redirect_in(tokens->size+1, extArgv, flags)) == REDIRECT_NONE &&
+			(status = redirect_out(tokens->size+1, extArgv, flags)) == REDIRECT_NONE
+		) status = execute(extArgv); // Executes the external program
+		//------------------------------------------------------------------------------
+	}
+	redirect_restore(savedOut);
+	coproc_restore(saved);
+	tsh_free(flags);
+	return status;
+}
+
+/*
+ * Runs a single line of user input.
+ * Argument(s):
+ *   char* input: the line to run, freed before returning.
+ * Returns:
+ *   The exit status of the command.
+ */
+int run_command(char* input) {
+	input = substitute(input); // Replaces $(...) and `...` with their output
+	Expansion expansion; // Quotes, '~' and braces, straight into the argument vector
+	int status = expand_line(input, &expansion) ? run_tokens(&expansion.words, expansion.quoted) : EXIT_FAILURE;
+	expansion_free(&expansion);
+	tsh_free(input);
+	return status;
+}
+
+/*
+ * Runs a list of commands separated by ';', '&&' and '||'.
+ * Argument(s):
+ *   char* input: the list to run, freed before returning.
+ * Returns:
+ *   The exit status of the last command that ran.
+ */
+int run_list(char* input) {
+	int status = EXIT_SUCCESS;
+	ListOperator operator = LIST_SEQUENCE; // The operator before the next command
+	ListOperator next;
+	char* rest = input;
+	char* command;
+	while (running && (command = parser_next_command(&rest, &next)) != NULL) {
+		if (command[0] == ASCII_NULL || (operator == LIST_AND && status != EXIT_SUCCESS) ||
+		    (operator == LIST_OR && status == EXIT_SUCCESS))
+			tsh_free(command); // Skipped, the status carries over
+		else {
+			char* text = tsh_calloc(MEM_PARSER, strlen(command)+1, sizeof(char));
+			strcpy(text, command); // run_command() frees the command
+			audit_start(); // One record per command that runs
+			status = run_command(command);
+			audit_finish(text, status);
+			tsh_free(text);
+		}
+		operator = next;
+	}
+	tsh_free(input);
+	return status;
+}
+
+/*
+ * Writes this session's lines recorded since the last flush to the
+ * History file, in one write. They are kept apart from the History list,
+ * which also gains lines from other sessions (see shared_history_sync()).
+ * Argument(s):
+ *   int timer: the timer that fired (unused).
+ *   void* data: unused.
  */
-int main(void) {
-	signal(SIGINT, ctrlC); /* Sets the behavior for a Control Character,
-	                          specifically Ctrl-C (SIGINT) */
-	Configuration config = config_read();
-	HashTable rawcmds;
-	Vector aliases;
-	alias_init(&rawcmds, &aliases);
-	char* history_path = construct_path(".tsh-history");
-	while (true) {
-		char* prompt = config_build_prompt(&config); // Building the Prompt from configuration
+static void flush_history(int timer, void* data) {
+	(void) timer;
+	(void) data;
+	historyTimer = -1;
+	if (pendingHistory.size == 0) return;
+	size_t length = 0;
+	for (unsigned int i = 0; i < pendingHistory.size; i++)
+		length += strlen(vector_get(&pendingHistory, i)) + 1;
+	char* text = tsh_calloc(MEM_SHELL, length, sizeof(char));
+	for (unsigned int i = 0, position = 0; i < pendingHistory.size; i++) {
+		size_t size = strlen(vector_get(&pendingHistory, i));
+		memcpy(text+position, vector_get(&pendingHistory, i), size);
+		position += size;
+		text[position++] = ASCII_NEWLINE;
+	}
+	int fd = open(history_path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+	for (size_t done = 0; fd != -1 && done < length; ) {
+		ssize_t written = write(fd, text+done, length-done);
+		if (written <= 0) break;
+		done += written;
+	}
+	if (fd != -1) close(fd);
+	tsh_free(text);
+	discard_history();
+}
+
+/*
+ * Builds the prompt, or the continuation prompt while a compound
+ * command is unfinished.
+ * Memory Management:
+ *   Free the returned prompt when done.
+ */
+static char* build_prompt(void) {
+	if (script == NULL) return config_build_prompt(&config); // Building the Prompt from configuration
+	char* prompt = tsh_calloc(MEM_PROMPT, 3, sizeof(char));
+	strcpy(prompt, "> ");
+	return prompt;
+}
+
+static void handle_line(char* input);
+
+/*
+ * Builds the prompt and hands it to the line editor, ready for the next line.
+ */
+static void show_prompt(void) {
+	shared_history_sync(); // Picks up lines run in other sessions
+	if (script == NULL) segment_refresh(config.prompt); // Shown as they were until the workers answer
+	char* prompt = build_prompt();
+	if (editing) editor_start(prompt, handle_line);
+	else rl_callback_handler_install(prompt, handle_line); // Both keep their own copy
+	tsh_free(prompt);
+}
+
+/*
+ * Starts keeping the output of a line for 'out', unless the line is a
+ * replay itself.
+ * Returns:
+ *   true if capture_end() must follow the line.
+ */
+static bool capture_line(const char* input) {
+	while (*input == ASCII_SPACE) input++;
+	if (!strncmp(input, "out", 3) && (input[3] == ASCII_NULL || input[3] == ASCII_SPACE)) return false;
+	return capture_begin(input);
+}
+
+/*
+ * Adds a line to the History, for this session and others.
+ */
+static void record_line(const char* input) {
+	add_history(input); // Add input to History list
+	shared_history_add(input); // and to other sessions' lists
+	char* line = tsh_calloc(MEM_SHELL, strlen(input)+1, sizeof(char));
+	strcpy(line, input);
+	vector_add(&pendingHistory, pendingHistory.size, line); // and, soon, to the History file
+}
+
+/*
+ * Runs a line of user input, or the rest of an unfinished compound command.
+ * Argument(s):
+ *   const char* input: the line; several lines are compiled as one script.
+ * Returns:
+ *   The exit status of the line.
+ */
+static int execute_line(const char* input) {
+	interrupted = 0;
+	char* line = tsh_calloc(MEM_PARSER, strlen(input)+1, sizeof(char));
+	strcpy(line, input); // Readline's copy is not from the tsh allocator
+	if (script == NULL && !vm_handles(line)) { // Plain commands skip the compiler
+		bool captured = capture_line(input);
+		int status = run_list(line); // Audits each command
+		if (captured) capture_end();
+		return status;
+	}
+	if (script != NULL) { // Continues an unfinished compound command
+		size_t length = strlen(script);
+		script = tsh_realloc(MEM_PARSER, script, length+strlen(line)+2);
+		script[length] = ASCII_NEWLINE;
+		strcpy(script+length+1, line);
+		tsh_free(line);
+		line = script;
+	}
+	Program* program;
+	int result = vm_compile(line, &program);
+	if (result == VM_INCOMPLETE) { // Wait for more lines
+		script = line;
+		return EXIT_SUCCESS;
+	}
+	script = NULL;
+	if (result == VM_SYNTAX_ERROR) {
+		tsh_free(line);
+		return 2;
+	}
+	bool captured = capture_line(line);
+	audit_start();
+	int status = vm_execute(program);
+	audit_finish(line, status); // The whole construct, every line of it
+	if (captured) capture_end();
+	tsh_free(line);
+	vm_free(program);
+	return status;
+}
+
+/*
+ * Records and runs a line of user input.
+ * Argument(s):
+ *   char* input: the line, as returned by readline.
+ * Returns:
+ *   The exit status of the line.
+ */
+static int process_line(char* input) {
+	record_line(input);
+	if (!looping) flush_history(-1, NULL); // Write input to History file
+	else if (historyTimer == -1 && (historyTimer = event_timer(HISTORY_FLUSH_MS, false, flush_history, NULL)) == -1)
+		flush_history(-1, NULL);
+	return execute_line(input);
+}
+
+/*
+ * Adds the delimiters of the Here-Documents a line starts (cmd << WORD,
+ * cmd <<WORD) to the list, so the lines of their bodies that follow are
+ * not taken for commands.
+ */
+static void heredoc_delimiters(const char* line, Vector* delimiters) {
+	if (strstr(line, "<<") == NULL) return;
+	Expansion words;
+	if (expand_line(line, &words)) {
+		for (unsigned int i = 1; i < words.words.size; i++) {
+			const char* word = vector_get(&words.words, i);
+			if (words.quoted[i] || strncmp(word, "<<", 2) || word[2] == '<') continue;
+			if (word[2] == ASCII_NULL && i+1 == words.words.size) break;
+			const char* delimiter = word[2] != ASCII_NULL ? word+2 : (char*) vector_get(&words.words, ++i);
+			char* copy = tsh_calloc(MEM_PARSER, strlen(delimiter)+1, sizeof(char));
+			strcpy(copy, delimiter);
+			vector_add(delimiters, delimiters->size, copy);
+		}
+	}
+	expansion_free(&words);
+}
+
+/*
+ * Records and runs several lines entered at once, e.g. a bracketed paste.
+ * Every line goes into the History with one write, then the lines run
+ * one after another with no prompt in between, or as one script if they
+ * hold a compound command. A Here-Document reads its body from the lines
+ * after its command, not from the terminal, so a block with one always
+ * runs line by line.
+ * Argument(s):
+ *   char* input: the lines, separated by newlines.
+ * Returns:
+ *   The exit status of the last line run.
+ */
+static int process_block(char* input) {
+	char* block = tsh_calloc(MEM_PARSER, strlen(input)+1, sizeof(char));
+	strcpy(block, input);
+	strutil_replaceAll(block, ASCII_RETURN, ASCII_NEWLINE); // Some terminals paste line ends as CR
+	Vector lines = vector_init(0); // Blank ones too, as a Here-Document may hold them
+	Vector delimiters = vector_init(0); // Of the Here-Documents whose bodies are still to come
+	size_t length = 0; // Of the lines, joined
+	bool compound = false, heredocs = false;
+	for (char* start = block; *start != ASCII_NULL; ) {
+		char* end = start + strcspn(start, "\n");
+		bool last = *end == ASCII_NULL;
+		*end = ASCII_NULL;
+		if (start[strspn(start, " \t")] != ASCII_NULL) record_line(start); // Blank lines are not worth recording
+		vector_add(&lines, lines.size, start);
+		length += end - start + 1;
+		if (delimiters.size > 0) { // A line of a Here-Document's body
+			if (!strcmp(start, vector_get(&delimiters, 0))) {
+				tsh_free(vector_get(&delimiters, 0));
+				vector_delete(&delimiters, 0);
+			}
+		} else {
+			compound = compound || vm_handles(start);
+			heredoc_delimiters(start, &delimiters);
+			heredocs = heredocs || delimiters.size > 0;
+		}
+		start = last ? end : end+1;
+	}
+	for (unsigned int i = 0; i < delimiters.size; i++) tsh_free(vector_get(&delimiters, i)); // The rest comes from the terminal
+	tsh_free(delimiters.array);
+	if (historyTimer != -1) event_cancel(historyTimer);
+	flush_history(-1, NULL); // One write for the whole block
+	int status = EXIT_SUCCESS;
+	if ((script == NULL && !compound) || heredocs) { // Compound commands still gather their lines, see execute_line()
+		unsigned int next = 0;
+		redirect_lines(&lines, &next); // Here-Documents move 'next' past their bodies
+		while (next < lines.size && running && status != 128 + SIGINT) { // Ctrl-C stops the rest too
+			const char* line = vector_get(&lines, next++);
+			if (line[strspn(line, " \t")] != ASCII_NULL) status = execute_line(line);
+		}
+		redirect_lines(NULL, NULL);
+	} else if (lines.size > 0) { // Compiled as one script
+		char* joined = tsh_calloc(MEM_PARSER, length, sizeof(char));
+		for (unsigned int i = 0; i < lines.size; i++) {
+			if (i > 0) strcat(joined, "\n");
+			strcat(joined, vector_get(&lines, i));
+		}
+		status = execute_line(joined);
+		tsh_free(joined);
+	}
+	tsh_free(lines.array);
+	tsh_free(block);
+	return status;
+}
+
+/*
+ * Called by the line editor whenever a complete line has been entered.
+ * Argument(s):
+ *   char* input: the line, or NULL at the end of input (Ctrl-D).
+ */
+static void handle_line(char* input) {
+	if (editing) editor_stop(); // Gives the terminal back while the command runs
+	else rl_callback_handler_remove();
+	if (input == NULL) { // Exits when Ctrl-D is pressed
+		puts("");
+		running = false;
+	} else if (input[0] != ASCII_NULL) { // If the user typed something
+		int status = strchr(input, ASCII_NEWLINE) != NULL ? process_block(input) : process_line(input);
+		if (status == 128 + SIGINT) puts(""); // Move past the echoed ^C
+		event_discard(SIGINT); // Ctrl-C was meant for the command
+	}
+	free(input);
+	if (running) show_prompt();
+	else event_stop();
+}
+
+/*
+ * Feeds the line editor whenever the terminal has input.
+ */
+static void handle_input(int fd, void* data) {
+	(void) fd;
+	(void) data;
+	if (editing) editor_read();
+	else rl_callback_read_char();
+}
+
+/*
+ * Rebuilds the prompt and redraws it in place, keeping the line being typed.
+ */
+static void redraw_prompt(void) {
+	char* prompt = build_prompt();
+	if (editing) {
+		editor_set_prompt(prompt);
+		editor_redisplay(); // Redraws the prompt in place
+	} else {
+		rl_set_prompt(prompt);
+		fputs("\r" CLEAR_LINE, rl_outstream); // Redraw the prompt in place
+		rl_on_new_line();
+		rl_redisplay();
+	}
+	tsh_free(prompt);
+}
+
+/*
+ * Applies changes to '~/.tsh-rc' and '~/.tsh-alias', then redraws the
+ * prompt in case it changed.
+ */
+static void handle_config_change(int fd, void* data) {
+	(void) fd;
+	(void) data;
+	if (!watch_poll(&config, &rawcmds, &aliases)) return; // Some other file in $HOME
+	redraw_prompt();
+}
+
+/*
+ * Control-C (SIGINT) abandons the line being typed, along with any
+ * unfinished compound command.
+ */
+static void handle_interrupt(int signal) {
+	(void) signal;
+	if (script != NULL) {
+		tsh_free(script);
+		script = NULL;
+		char* prompt = build_prompt();
+		if (editing) editor_set_prompt(prompt);
+		else rl_set_prompt(prompt);
+		tsh_free(prompt);
+	}
+	if (editing) {
+		editor_cancel();
+		return;
+	}
+	rl_replace_line("", 0);
+	rl_crlf();
+	rl_on_new_line();
+	rl_redisplay();
+}
+
+/*
+ * Reaps children nobody is waiting for.
+ */
+static void handle_child(int signal) {
+	(void) signal;
+	pid_t pid;
+	int status;
+	while ((pid = waitpid(-1, &status, WNOHANG)) > 0) coproc_exited(pid, status);
+}
+
+/*
+ * Keeps the line editor's idea of the terminal size up to date.
+ */
+static void handle_resize(int signal) {
+	(void) signal;
+	if (editing) editor_resize();
+	else rl_resize_terminal();
+}
+
+/*
+ * Reads lines from the terminal (or a pipe or file) and runs them until
+ * the end of input or an exit builtin.
+ */
+static void interact(void) {
+	int watchfd = watch_init(); // Reloads '~/.tsh-rc' and '~/.tsh-alias' when they change
+	if (event_init()) {
+		rl_catch_signals = 0; // Signals arrive through the event loop instead
+		rl_catch_sigwinch = 0;
+		event_signal(SIGINT, handle_interrupt);
+		event_signal(SIGCHLD, handle_child);
+		event_signal(SIGWINCH, handle_resize);
+		if (watchfd != -1) event_watch(watchfd, handle_config_change, NULL);
+		looping = event_watch(fileno(rl_instream ? rl_instream : stdin), handle_input, NULL);
+		editing = looping && config.editor && isatty(STDIN_FILENO); // Readline still serves pipes
+	} else signal(SIGINT, ctrlC); /* Sets the behavior for a Control Character,
+	                                 specifically Ctrl-C (SIGINT) */
+	if (looping) { // Input that can be polled, i.e. a terminal or a pipe
+		capture_init(config.capture); // Output is only worth keeping for a person to see
+		segment_init(redraw_prompt); // Slow prompt segments arrive through the loop
+		show_prompt();
+		event_run();
+		if (editing) editor_stop();
+		else rl_callback_handler_remove();
+		flush_history(-1, NULL);
+	} else while (running) { // Input from a regular file
+		watch_poll(&config, &rawcmds, &aliases);
+		shared_history_sync();
+		char* prompt = build_prompt();
 		char* input = readline(prompt); // Get User input
-		free(prompt);
+		tsh_free(prompt);
 		if (input == NULL) { // Exits when Ctrl-D is pressed
 			puts("");
 			break;
-		} else if (input[0] != ASCII_NULL) { // If the user typed something
-			add_history(input); // Add input to History list
-			append_history(1, history_path); // Write input to History file
-			if (!strcmp(input, "help")) {
-				puts(COLOR_GREEN);
-				puts("help: Displays this message.");
-				puts("exit, quit, logout: Closes the shell.");
-				puts("cd [dir]: Attempts to change into the given directory.");
-				puts("history clear: Empties the history file.");
-				puts(COLOR_RESET);
-			} else if (!strcmp(input, "exit") || !strcmp(input, "quit") || !strcmp(input, "logout")) {
-				free(input);
-				break;
-			} else if (!strcmp(input, "history clear")) {
-				truncate(history_path, 0);
-			} else {
-				//==================================================================================
-				// Expands Tilde '~' to the Users Home Directory
-				if (strutil_contains(input, "~")) {
-					char* home = getenv("HOME");
-					int freei = 0;
-					unsigned int tokenNum = 0;
-					int length = 1;
-					char* tempInput = NULL;
-					char** tokens = strutil_split(input, " ", &tokenNum);
-					length += strlen(tokens[0]);
-					tempInput = realloc(tempInput, ++length * sizeof(char));
-					strcpy(tempInput, tokens[0]);
-					strcat(tempInput, " ");
-					for (register unsigned int i = 1; i < tokenNum; i++) {
-						if (tokens[i][0] == '~') {
-							char* sub = strutil_substring(tokens[i], 1, strlen(tokens[i]));
-							char* temp = calloc(strlen(home)+strlen(sub)+1, sizeof(char));
-							strcpy(temp, home);
-							strcat(temp, sub);
-							free(sub);
-							tokens[i] = temp;
-							freei = i;
-						}
-						length += strlen(tokens[i]);
-						tempInput = realloc(tempInput, length * sizeof(char));
-						strcat(tempInput, tokens[i]);
-						if (i < (tokenNum-1)) {
-							tempInput = realloc(tempInput, ++length * sizeof(char));
-							strcat(tempInput, " ");
-						}
-					}
-					free(tokens[freei]);
-					free(tokens);
-					free(input);
-					input = tempInput;
-				}
-				//==================================================================================
-		 		Vector tokens = vector_split(input, " "); // User input tokens
-		 		#define COMMAND (char*) vector_get(&tokens, 0)
-				//==================================================================================
-				// Injecting the real commands into user input before running.
-				char line[BUFFER_SIZE];
-				for (register unsigned int i = 0; i < aliases.size; i++) {
-					if (!strcmp(COMMAND, (char*) vector_get(&aliases, i))) { // Does the command have an alias?
-						strncpy(line, (char*) hash_lookUp(&rawcmds, COMMAND), sizeof(line));
-						Vector args = vector_split(line, " ");
-						for (register unsigned int j = args.size-1; j > 0; j--)
-							vector_add(&tokens, 1, vector_get(&args, j));
-						free(args.array);
-						break;
-					}
-				}
-				//==================================================================================
-				if (!strcmp(COMMAND, "cd")) changeDir(&tokens);
-				else {
-					//------------------------------------------------------------------------------
-					// Sets up argv, then runs the command
-					char* extArgv[tokens.size+1];
-					for (register unsigned int j = 0; j < tokens.size; j++)
-						extArgv[j] = (char*) vector_get(&tokens, j);
-					extArgv[tokens.size] = NULL;
-					if (!redirect_pipe(tokens.size+1, extArgv) &&
-						!redirect_in(tokens.size+1, extArgv) &&
-						!redirect_out(tokens.size+1, extArgv)
-					) execute(extArgv); // Executes the external program
-					//------------------------------------------------------------------------------
-				}
-				#undef COMMAND
-				free(tokens.array);
-				free(input);
-			}
-		} else free(input);
+		} else if (input[0] != ASCII_NULL) // If the user typed something
+			process_line(input);
+		free(input);
+	}
+}
+
+/*
+ * Runs a command line sent to the server (see server.c). It is not added
+ * to the History, as requests come from programs rather than people.
+ * Argument(s):
+ *   char* line: the whole line, which may span several lines.
+ * Returns:
+ *   The exit status of the line.
+ */
+static int serve_line(char* line) {
+	int status;
+	Program* program;
+	if (!vm_handles(line)) {
+		char* copy = tsh_calloc(MEM_PARSER, strlen(line)+1, sizeof(char));
+		strcpy(copy, line); // run_list() frees it
+		return run_list(copy); // Audits each command
+	}
+	audit_start();
+	if ((status = vm_compile(line, &program)) == VM_INCOMPLETE || status == VM_SYNTAX_ERROR) {
+		if (status == VM_INCOMPLETE) fprintf(stderr, COLOR_RED "T-Shell: Unexpected end of command.\n" COLOR_RESET);
+		status = 2;
+	} else {
+		status = vm_execute(program);
+		vm_free(program);
+	}
+	audit_finish(line, status);
+	return status;
+}
+
+/*
+ * The Shells main function.
+ */
+int main(int argc, char* argv[]) {
+	bool serving = argc > 1 && !strcmp(argv[1], "--server");
+	if (serving && argc != 3) {
+		fprintf(stderr, COLOR_RED "T-Shell: Usage: tsh [--server SOCKET]\n" COLOR_RESET);
+		return EXIT_FAILURE;
 	}
-	free(history_path); // Free History file path
+	builtin_init(); // Builtin names into their perfect hash slots
+	config = config_read();
+	if (config.shared && shared_init()) { // Aliases live in the shared segment instead
+		alias_share();
+		rawcmds = hash_init(1);
+		aliases = vector_init(0);
+	} else alias_init(&rawcmds, &aliases);
+	history_path = construct_path(".tsh-history");
+	directory_init(); // Opens the 'z' database
+	if (config.audit) audit_init(); // Maps '~/.tsh-audit'
+	int status = EXIT_SUCCESS;
+	if (serving) status = server_run(argv[2], serve_line); // Every request starts from here, already set up
+	else interact();
+	tsh_free(script); // Unfinished at the end of input
+	directory_free();
+	audit_free();
+	capture_free();
+	segment_free();
+	coproc_free(); // Closing their input lets coprocesses finish
+	tsh_free(history_path); // Free History file path
 	alias_free(&rawcmds, &aliases); // Alias Freeing
-	return 0;
+	intern_free();
+	shared_free();
+	return status;
 }
@@ -0,0 +1,274 @@
+// Standard: gnu99
+
+#include <fnmatch.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "allocator.h"
+#include "expansion.h"
+#include "intern.h"
+#include "substitution.h"
+#include "tsh.h"
+#include "vm.h"
+
+#define CALL_DEPTH	256	// Deepest allowed chain of function calls.
+
+typedef struct buffer {
+	char* data;
+	size_t length;
+	size_t capacity;
+} buffer;
+
+typedef struct loop_state {
+	Expansion words;   	// The words being iterated over, owned by the loop.
+	unsigned int next; 	// The next word to assign.
+} loop_state;
+
+static const char** functionNames = NULL;	// Interned names of the defined functions.
+static Program** functions = NULL; 	// Their compiled bodies.
+static unsigned int functionCount = 0;
+static Vector* frame = NULL;       	// Arguments of the running function, if any.
+static unsigned int depth = 0;     	// Function calls in progress.
+static int lastStatus = 0;         	// Value of $?.
+
+static void append(buffer* b, const char* text, size_t length) {
+	if (b->length+length+1 > b->capacity) {
+		b->capacity = (b->length+length+1) * 2;
+		b->data = tsh_realloc(MEM_PARSER, b->data, b->capacity);
+	}
+	memcpy(b->data+b->length, text, length);
+	b->length += length;
+	b->data[b->length] = ASCII_NULL;
+}
+
+/*
+ * Appends the value of a variable: positional arguments, $#, $@, $?,
+ * or else the environment.
+ * Argument(s):
+ *   buffer* b: where the value goes.
+ *   const char* name: the variable's name.
+ */
+static void append_variable(buffer* b, const char* name) {
+	char number[16];
+	const char* value = NULL;
+	if (!strcmp(name, "?")) {
+		snprintf(number, sizeof(number), "%d", lastStatus);
+		value = number;
+	} else if (!strcmp(name, "#")) {
+		snprintf(number, sizeof(number), "%u", frame == NULL ? 0 : frame->size-1);
+		value = number;
+	} else if (!strcmp(name, "@") || !strcmp(name, "*")) {
+		for (unsigned int i = 1; frame != NULL && i < frame->size; i++) {
+			if (i > 1) append(b, " ", 1);
+			append(b, vector_get(frame, i), strlen(vector_get(frame, i)));
+		}
+	} else if (name[0] >= '0' && name[0] <= '9' && name[1] == ASCII_NULL) {
+		unsigned int index = name[0] - '0';
+		if (frame != NULL && index < frame->size) value = vector_get(frame, index);
+		else if (index == 0) value = "tsh";
+	} else value = getenv(name);
+	if (value != NULL) append(b, value, strlen(value));
+}
+
+/*
+ * Gives the value of a variable, or the output of a command, to
+ * expansion_expand().
+ */
+static char* lookup(const char* text, bool command) {
+	if (command) return substitute_output(text);
+	buffer value = {NULL, 0, 0};
+	append(&value, "", 0);
+	append_variable(&value, text);
+	return value.data;
+}
+
+/*
+ * Expands the words of a command, the same as a typed command: variables,
+ * command substitutions, '~' and braces, with quotes removed.
+ * Argument(s):
+ *   Command* command: the command.
+ *   Expansion* result: receives the words.
+ * Returns:
+ *   false, after printing why, if the words could not be expanded.
+ * Memory Management:
+ *   Release the result with expansion_free(), whatever is returned.
+ */
+static bool expand_command(Command* command, Expansion* result) {
+	return expansion_expand(command->argv, command->argc, lookup, result);
+}
+
+/*
+ * Runs a command through the shell, the same as a typed one.
+ * Returns:
+ *   The exit status of the command.
+ */
+static int exec_command(Command* command) {
+	Expansion words;
+	int status = expand_command(command, &words) ? run_tokens(&words.words, words.quoted) : EXIT_FAILURE; // Which may rearrange them
+	expansion_free(&words);
+	return status;
+}
+
+/*
+ * Defines a function, replacing any existing one with the same name.
+ * Argument(s):
+ *   const char* name: the function's name.
+ *   Program* body: its compiled body, which gains an owner.
+ */
+static void define_function(const char* name, Program* body) {
+	body->refs++;
+	name = intern(name);
+	for (unsigned int i = 0; i < functionCount; i++) {
+		if (functionNames[i] == name) {
+			vm_free(functions[i]); // Still alive if it is running
+			functions[i] = body;
+			return;
+		}
+	}
+	functionNames = tsh_realloc(MEM_PARSER, functionNames, (functionCount+1) * sizeof(char*));
+	functions = tsh_realloc(MEM_PARSER, functions, (functionCount+1) * sizeof(Program*));
+	functionNames[functionCount] = name;
+	functions[functionCount++] = body;
+}
+
+/*
+ * Runs a compiled program.
+ * Argument(s):
+ *   Program* program: the program, kept alive while it runs.
+ * Returns:
+ *   The exit status of the last command run.
+ */
+int vm_execute(Program* program) {
+	program->refs++;
+	int status = EXIT_SUCCESS;
+	loop_state* loops = NULL;
+	unsigned int loopCount = 0;
+	unsigned int pc = 0;
+	while (pc < program->length && tsh_running()) {
+		Instruction* in = &program->code[pc++];
+		switch (in->op) {
+			case OP_EXEC:
+				status = exec_command(&program->commands[in->operand]);
+				if (status == 128 + SIGINT || tsh_interrupted()) { // Ctrl-C ends loops, and callers see the status
+					status = 128 + SIGINT;
+					pc = program->length;
+				}
+				break;
+			case OP_JUMP:
+				pc = in->target;
+				break;
+			case OP_JUMP_FAILED:
+				if (status != EXIT_SUCCESS) pc = in->target;
+				break;
+			case OP_JUMP_PASSED:
+				if (status == EXIT_SUCCESS) pc = in->target;
+				break;
+			case OP_SUCCEED:
+				status = EXIT_SUCCESS;
+				break;
+			case OP_FOR_INIT: {
+				loops = tsh_realloc(MEM_PARSER, loops, (loopCount+1) * sizeof(loop_state));
+				loop_state* loop = &loops[loopCount++];
+				loop->next = 0;
+				if (program->commands[in->operand].argc > 0) {
+					if (!expand_command(&program->commands[in->operand], &loop->words)) status = EXIT_FAILURE;
+				} else { // No 'in': the function's arguments, as they are
+					buffer text = {NULL, 0, 0};
+					unsigned int count = frame == NULL ? 0 : frame->size-1;
+					for (unsigned int i = 1; i <= count; i++)
+						append(&text, vector_get(frame, i), strlen(vector_get(frame, i))+1);
+					loop->words = (Expansion) {{count, tsh_calloc(MEM_VECTOR, count+1, sizeof(void*))}, NULL, text.data};
+					for (unsigned int i = 0, offset = 0; i < count; offset += strlen(text.data+offset)+1)
+						loop->words.words.array[i++] = text.data+offset;
+				}
+				break;
+			}
+			case OP_FOR_NEXT: {
+				loop_state* loop = &loops[loopCount-1];
+				if (loop->next < loop->words.words.size)
+					setenv(expansion_word_text(program->commands[in->operand].argv[0]),
+					       vector_get(&loop->words.words, loop->next++), 1);
+				else pc = in->target;
+				break;
+			}
+			case OP_FOR_POP:
+				expansion_free(&loops[--loopCount].words);
+				break;
+			case OP_CASE: {
+				Expansion words;
+				bool matched = false;
+				if (expand_command(&program->commands[in->operand], &words))
+					for (unsigned int i = 1; !matched && i < words.words.size; i++)
+						matched = fnmatch(vector_get(&words.words, i), vector_get(&words.words, 0), 0) == 0;
+				if (!matched) pc = in->target;
+				expansion_free(&words);
+				break;
+			}
+			case OP_DEFINE:
+				define_function(program->functionNames[in->operand], program->functions[in->operand]);
+				status = EXIT_SUCCESS;
+				break;
+			case OP_RETURN:
+				if (in->operand > 0) status = in->operand - 1;
+				pc = program->length;
+				break;
+		}
+		lastStatus = status;
+	}
+	while (loopCount > 0) expansion_free(&loops[--loopCount].words); // Left by 'return' or 'exit'
+	tsh_free(loops);
+	vm_free(program);
+	return status;
+}
+
+/*
+ * Calls a function, if the command names one.
+ * Argument(s):
+ *   const char* name: the interned command name, or NULL.
+ *   Vector* tokens: the command; the function's name then its arguments.
+ * Returns:
+ *   The exit status of the function, or VM_NOT_FUNCTION.
+ */
+int vm_call(const char* name, Vector* tokens) {
+	for (unsigned int i = 0; i < functionCount; i++) {
+		if (functionNames[i] != name) continue;
+		if (depth >= CALL_DEPTH) {
+			printf(COLOR_RED "T-Shell: %s: Maximum function nesting exceeded.\n" COLOR_RESET, functionNames[i]);
+			return EXIT_FAILURE;
+		}
+		Vector* caller = frame;
+		frame = tokens;
+		depth++;
+		int status = vm_execute(functions[i]);
+		depth--;
+		frame = caller;
+		return status;
+	}
+	return VM_NOT_FUNCTION;
+}
+
+/*
+ * Releases a program once its last owner is done with it.
+ * Argument(s):
+ *   Program* program: the program, may be NULL.
+ */
+void vm_free(Program* program) {
+	if (program == NULL || --program->refs > 0) return;
+	for (unsigned int i = 0; i < program->commandCount; i++) {
+		Command* command = &program->commands[i];
+		for (unsigned int j = 0; j < command->argc; j++) expansion_word_free(command->argv[j]);
+		tsh_free(command->argv);
+	}
+	for (unsigned int i = 0; i < program->functionCount; i++) {
+		vm_free(program->functions[i]);
+		tsh_free(program->functionNames[i]);
+	}
+	tsh_free(program->functions);
+	tsh_free(program->functionNames);
+	tsh_free(program->commands);
+	tsh_free(program->code);
+	tsh_free(program);
+}
@@ -0,0 +1,107 @@
+// Standard: gnu99
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alias.h"
+#include "allocator.h"
+#include "audit.h"
+#include "capture.h"
+#include "configuration.h"
+#include "data-structs/hash.h"
+#include "shared.h"
+#include "tsh.h"
+#include "data-structs/vector.h"
+#include "watch.h"
+
+static int watchfd = -1;  	// The inotify instance, -1 if unavailable.
+static struct stat rcStat;	// '~/.tsh-rc' as of the last reload.
+static struct stat aliasStat;	// '~/.tsh-alias' as of the last reload.
+
+/*
+ * Checks whether a file has changed since it was last seen. Merely
+ * opening a file for writing also raises an event (config_read() does
+ * so to create '~/.tsh-rc'), so the event alone is not enough.
+ * Argument(s):
+ *   char* filename: the file name, relative to the home directory.
+ *   struct stat* seen: the file as last seen, updated if it changed.
+ * Returns:
+ *   true if the file changed.
+ */
+static bool file_changed(char* filename, struct stat* seen) {
+	struct stat now;
+	char* path = construct_path(filename);
+	bool changed = !stat(path, &now) && (now.st_ino != seen->st_ino || now.st_size != seen->st_size ||
+	               now.st_mtim.tv_sec != seen->st_mtim.tv_sec || now.st_mtim.tv_nsec != seen->st_mtim.tv_nsec);
+	tsh_free(path);
+	if (changed) *seen = now;
+	return changed;
+}
+
+/*
+ * Starts watching the home directory for changes to T-Shell's files.
+ * The directory is watched, rather than the files, so that editors
+ * which replace the file on save are noticed too.
+ * Returns:
+ *   The inotify file descriptor, or -1 if watching is unavailable.
+ */
+int watch_init(void) {
+	file_changed(".tsh-rc", &rcStat);
+	file_changed(".tsh-alias", &aliasStat);
+	watchfd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (watchfd == -1) return -1;
+	if (inotify_add_watch(watchfd, getenv("HOME"), IN_CLOSE_WRITE | IN_MOVED_TO) == -1) {
+		close(watchfd);
+		watchfd = -1;
+	}
+	return watchfd;
+}
+
+/*
+ * Applies any changes made to '~/.tsh-rc' or '~/.tsh-alias' since the
+ * last call. Never blocks; returns at once when nothing has changed.
+ * Argument(s):
+ *   Configuration* config: the shell configuration.
+ *   HashTable* rawcmds: the aliases mapped to their real commands.
+ *   Vector* aliases: the aliased command names.
+ * Returns:
+ *   true if either file was reloaded.
+ */
+bool watch_poll(Configuration* config, HashTable* rawcmds, Vector* aliases) {
+	if (watchfd == -1) return false;
+	char events[BUFSIZ] __attribute__((aligned(__alignof__(struct inotify_event))));
+	bool rcChanged = false;
+	bool aliasChanged = false;
+	ssize_t length;
+	while ((length = read(watchfd, events, sizeof(events))) > 0) {
+		for (char* e = events; e < events+length; e += sizeof(struct inotify_event) + ((struct inotify_event*) e)->len) {
+			struct inotify_event* event = (struct inotify_event*) e;
+			if (event->len == 0) continue;
+			if (!strcmp(event->name, ".tsh-rc")) rcChanged |= file_changed(".tsh-rc", &rcStat);
+			else if (!strcmp(event->name, ".tsh-alias")) aliasChanged |= file_changed(".tsh-alias", &aliasStat);
+		}
+	}
+	if (rcChanged) {
+		Configuration fresh = config_read();
+		if (fresh.colors != config->colors) config->colors = fresh.colors;
+		if (strcmp(fresh.prompt, config->prompt)) strcpy(config->prompt, fresh.prompt);
+		if (fresh.audit != config->audit) {
+			config->audit = fresh.audit;
+			if (config->audit) audit_init();
+			else audit_free();
+		}
+		if (fresh.capture != config->capture) { // The kept output goes with the old ring
+			config->capture = fresh.capture;
+			capture_free();
+			capture_init(config->capture);
+		}
+	} // SHARED and EDITOR are only read at startup
+	if (aliasChanged && shared_active()) alias_share(); // Every session sees the change at once
+	else if (aliasChanged) alias_reload(rawcmds, aliases);
+	return rcChanged || aliasChanged;
+}
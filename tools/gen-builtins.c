@@ -0,0 +1,58 @@
+// Standard: gnu99
+
+/*
+ * Generates 'include/builtin-table.h': a collision-free (perfect) hash
+ * of the builtin names in 'include/builtins.def'. Run by 'make builtins'.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "builtin.h"
+
+static const char* names[BUILTIN_COUNT] = {
+	#define BUILTIN(id, name) name,
+	#include "builtins.def"
+	#undef BUILTIN
+};
+
+static const char* ids[BUILTIN_COUNT] = {
+	#define BUILTIN(id, name) #id,
+	#include "builtins.def"
+	#undef BUILTIN
+};
+
+int main(void) {
+	uint32_t slots = 1;
+	while (slots < 2 * BUILTIN_COUNT) slots *= 2; // At most half full, so a seed turns up quickly
+	int table[slots];
+	for (uint32_t seed = 0; seed < UINT32_MAX; seed++) {
+		for (uint32_t i = 0; i < slots; i++) table[i] = -1;
+		bool collided = false;
+		for (int i = 0; i < BUILTIN_COUNT && !collided; i++) {
+			uint32_t slot = builtin_hash(names[i], seed) & (slots-1);
+			collided = table[slot] != -1;
+			table[slot] = i;
+		}
+		if (collided) continue;
+		puts("/*");
+		puts(" * Generated by tools/gen-builtins.c from 'builtins.def'. Do not edit;");
+		puts(" * run 'make builtins' instead.");
+		puts(" */");
+		puts("#ifndef BUILTIN_TABLE_H");
+		puts("#define BUILTIN_TABLE_H\n");
+		puts("#include \"builtin.h\"\n");
+		printf("#define BUILTIN_SEED \t%uU\t// Sends every builtin to its own slot.\n", seed);
+		printf("#define BUILTIN_SLOTS\t%u\t// Always a power of two.\n\n", slots);
+		puts("static const Builtin builtinSlots[BUILTIN_SLOTS] = {");
+		for (uint32_t i = 0; i < slots; i++)
+			printf("\t%s%s\n", table[i] == -1 ? "BUILTIN_NONE" : ids[table[i]], i+1 < slots ? "," : "");
+		puts("};\n");
+		puts("#endif");
+		return EXIT_SUCCESS;
+	}
+	fputs("gen-builtins: No perfect hash found.\n", stderr);
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,179 @@
+// Standard: gnu99
+
+/*
+ * Decodes and filters the audit log that T-Shell writes to
+ * '~/.tsh-audit' when AUDIT=ON. Built by 'make audit'.
+ *
+ * Usage: tsh-audit [-f] [-n COUNT] [-p PID] [-d DIR] [-s SECONDS] [-g TEXT] [FILE]
+ *   -f          only failed commands (non-zero status)
+ *   -n COUNT    only the last COUNT matching commands
+ *   -p PID      only commands run by that shell
+ *   -d DIR      only commands run in DIR or below it
+ *   -s SECONDS  only commands started in the last SECONDS seconds
+ *   -g TEXT     only commands containing TEXT
+ */
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "audit.h"
+
+typedef struct filter {
+	bool failed;
+	long pid;
+	const char* directory;
+	int64_t since;	// Nanoseconds since the Epoch, 0 for any time.
+	const char* text;
+} filter;
+
+typedef struct entry {
+	audit_record record;
+	char* command;
+	char* cwd;
+} entry;
+
+static void usage(void) {
+	fputs("Usage: tsh-audit [-f] [-n COUNT] [-p PID] [-d DIR] [-s SECONDS] [-g TEXT] [FILE]\n", stderr);
+	exit(2);
+}
+
+/*
+ * Copies text out of the pool, unless a session has written over it.
+ * Returns:
+ *   The text (malloc()ed), or NULL if it is gone or its length is not
+ *   one the shell writes (a damaged log).
+ */
+static char* fetch(audit_header* header, uint64_t position, uint32_t length) {
+	if (length > header->poolSize) return NULL;
+	char* text = malloc(length+1);
+	size_t start = position % header->poolSize;
+	size_t first = length < header->poolSize - start ? length : header->poolSize - start;
+	memcpy(text, AUDIT_TEXT(header) + start, first);
+	memcpy(text + first, AUDIT_TEXT(header), length - first);
+	text[length] = '\0';
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (__atomic_load_n(&header->poolNext, __ATOMIC_RELAXED) - position > header->poolSize) { // Overwritten meanwhile
+		free(text);
+		return NULL;
+	}
+	return text;
+}
+
+/*
+ * Copies a record out of the ring, unless it is being written or was
+ * replaced while it was copied.
+ */
+static bool read_record(audit_header* header, uint64_t index, entry* out) {
+	audit_record* slot = &AUDIT_RING(header)[index % header->records];
+	if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != index + 1) return false;
+	out->record = *slot;
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (__atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) != index + 1) return false;
+	out->command = fetch(header, out->record.command, out->record.commandLength);
+	out->cwd = fetch(header, out->record.cwd, out->record.cwdLength);
+	return true;
+}
+
+static bool wanted(entry* e, filter* f) {
+	if (f->failed && e->record.status == 0) return false;
+	if (f->pid != 0 && e->record.pid != f->pid) return false;
+	if (f->since != 0 && e->record.started < f->since) return false;
+	if (f->text != NULL && (e->command == NULL || strstr(e->command, f->text) == NULL)) return false;
+	if (f->directory != NULL) {
+		size_t length = strlen(f->directory);
+		while (length > 1 && f->directory[length-1] == '/') length--;
+		if (e->cwd == NULL || strncmp(e->cwd, f->directory, length) ||
+		    (e->cwd[length] != '\0' && e->cwd[length] != '/' && length > 1))
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Prints text on one line, showing newlines and tabs as \n and \t.
+ */
+static void print_escaped(const char* text) {
+	for (; *text != '\0'; text++) {
+		if (*text == '\n') fputs("\\n", stdout);
+		else if (*text == '\t') fputs("\\t", stdout);
+		else putchar(*text);
+	}
+}
+
+static void print(entry* e) {
+	time_t seconds = e->record.started / 1000000000LL;
+	struct tm local;
+	char when[32];
+	strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime_r(&seconds, &local));
+	double duration = e->record.duration / 1e9;
+	printf("%s.%03lld  %7d  %3d  %9.3fs  %s  ", when, (long long) (e->record.started / 1000000) % 1000,
+	       e->record.pid, e->record.status, duration, e->cwd ? e->cwd : "?");
+	print_escaped(e->command ? e->command : "?");
+	putchar('\n');
+}
+
+int main(int argc, char** argv) {
+	filter f = {false, 0, NULL, 0, NULL};
+	long count = -1;
+	int option;
+	while ((option = getopt(argc, argv, "fn:p:d:s:g:")) != -1) {
+		switch (option) {
+			case 'f': f.failed = true; break;
+			case 'n': count = atol(optarg); break;
+			case 'p': f.pid = atol(optarg); break;
+			case 'd': f.directory = optarg; break;
+			case 's': f.since = ((int64_t) time(NULL) - atol(optarg)) * 1000000000LL; break;
+			case 'g': f.text = optarg; break;
+			default: usage();
+		}
+	}
+	if (argc - optind > 1) usage();
+	char path[4096];
+	if (optind < argc) snprintf(path, sizeof(path), "%s", argv[optind]);
+	else snprintf(path, sizeof(path), "%s/.tsh-audit", getenv("HOME") ? getenv("HOME") : ".");
+
+	int fd = open(path, O_RDONLY);
+	struct stat info;
+	if (fd == -1 || fstat(fd, &info) || (size_t) info.st_size < sizeof(audit_header)) {
+		fprintf(stderr, "tsh-audit: Cannot read %s.\n", path);
+		return 1;
+	}
+	audit_header* header = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (header == MAP_FAILED || header->magic != AUDIT_MAGIC || header->records == 0 || header->poolSize == 0 ||
+	    header->records > (size_t) info.st_size / sizeof(audit_record) || header->poolSize > (size_t) info.st_size ||
+	    (size_t) info.st_size != AUDIT_SIZE(header->records, header->poolSize)) {
+		fprintf(stderr, "tsh-audit: %s is not a T-Shell audit log.\n", path);
+		return 1;
+	}
+
+	uint64_t next = __atomic_load_n(&header->next, __ATOMIC_ACQUIRE);
+	uint64_t first = next > header->records ? next - header->records : 0;
+	entry* entries = calloc(next - first + 1, sizeof(entry));
+	size_t matched = 0;
+	for (uint64_t i = first; i < next; i++) {
+		if (!read_record(header, i, &entries[matched])) continue;
+		if (wanted(&entries[matched], &f)) matched++;
+		else {
+			free(entries[matched].command);
+			free(entries[matched].cwd);
+		}
+	}
+	size_t start = count >= 0 && (size_t) count < matched ? matched - count : 0;
+	for (size_t i = 0; i < matched; i++) {
+		if (i >= start) print(&entries[i]);
+		free(entries[i].command);
+		free(entries[i].cwd);
+	}
+	free(entries);
+	munmap(header, info.st_size);
+	return 0;
+}
@@ -0,0 +1,108 @@
+// Standard: gnu99
+
+/*
+ * Runs a command line in a T-Shell server ('tsh --server SOCKET')
+ * instead of starting a shell: the server already has the configuration
+ * and aliases loaded. The command runs with this process's Standard
+ * Input, Output and Error, working directory and environment, and its
+ * exit status becomes this process's. Built by 'make client'.
+ *
+ * Usage: tsh-client SOCKET COMMAND...
+ *   The words of COMMAND are joined by spaces into one command line, as
+ *   'sh -c' would take it. Exits with 255 if the server can not be reached.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "server.h"
+
+#define UNREACHABLE	255	// Exit status when there is no reply.
+
+extern char** environ;
+
+static void fail(const char* what) {
+	fprintf(stderr, "tsh-client: %s: %s\n", what, strerror(errno));
+	exit(UNREACHABLE);
+}
+
+/*
+ * Writes all of a buffer to the server.
+ */
+static void transmit(int connection, const char* buffer, size_t length) {
+	while (length > 0) {
+		ssize_t count = write(connection, buffer, length);
+		if (count == -1 && errno == EINTR) continue;
+		if (count <= 0) fail("write");
+		buffer += count;
+		length -= count;
+	}
+}
+
+int main(int argc, char* argv[]) {
+	if (argc < 3) {
+		fputs("Usage: tsh-client SOCKET COMMAND...\n", stderr);
+		return 2;
+	}
+	struct sockaddr_un address = {.sun_family = AF_UNIX};
+	if (strlen(argv[1]) >= sizeof(address.sun_path)) {
+		fprintf(stderr, "tsh-client: %s: Path too long for a socket.\n", argv[1]);
+		return UNREACHABLE;
+	}
+	strcpy(address.sun_path, argv[1]);
+	int connection = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (connection == -1 || connect(connection, (struct sockaddr*) &address, sizeof(address))) fail(argv[1]);
+
+	size_t commandLength = argc - 3; // The spaces
+	for (int i = 2; i < argc; i++) commandLength += strlen(argv[i]);
+	size_t environmentLength = 0;
+	for (char** variable = environ; *variable != NULL; variable++) environmentLength += strlen(*variable)+1;
+	if (commandLength + environmentLength > SERVER_MAX_REQUEST) {
+		fputs("tsh-client: The command and environment are too large.\n", stderr);
+		return UNREACHABLE;
+	}
+	int fds[SERVER_FDS] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO, open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC)};
+	if (fds[SERVER_CWD] == -1) fail("Working directory");
+
+	server_request request = {SERVER_MAGIC, commandLength, environmentLength};
+	struct iovec io = {&request, sizeof(request)};
+	union {
+		char buffer[CMSG_SPACE(sizeof(fds))];
+		struct cmsghdr align;
+	} control;
+	memset(&control, 0, sizeof(control));
+	struct msghdr message = {.msg_iov = &io, .msg_iovlen = 1, .msg_control = control.buffer, .msg_controllen = sizeof(control.buffer)};
+	struct cmsghdr* rights = CMSG_FIRSTHDR(&message);
+	rights->cmsg_level = SOL_SOCKET;
+	rights->cmsg_type = SCM_RIGHTS;
+	rights->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(rights), fds, sizeof(fds));
+	if (sendmsg(connection, &message, 0) != sizeof(request)) fail("sendmsg");
+	for (int i = 2; i < argc; i++) {
+		transmit(connection, argv[i], strlen(argv[i]));
+		if (i < argc - 1) transmit(connection, " ", 1);
+	}
+	for (char** variable = environ; *variable != NULL; variable++) transmit(connection, *variable, strlen(*variable)+1);
+
+	server_reply reply;
+	size_t received = 0;
+	while (received < sizeof(reply)) {
+		ssize_t count = read(connection, (char*) &reply + received, sizeof(reply) - received);
+		if (count == -1 && errno == EINTR) continue;
+		if (count <= 0) break;
+		received += count;
+	}
+	if (received != sizeof(reply) || reply.magic != SERVER_MAGIC) {
+		fputs("tsh-client: The server ended the request without a status.\n", stderr);
+		return UNREACHABLE;
+	}
+	return reply.status & 0xff;
+}
@@ -0,0 +1,391 @@
+// Standard: gnu99
+
+/*
+ * Measures the latency a person at the keyboard sees: from starting
+ * T-Shell to its first prompt, and from pressing Enter to the next
+ * prompt. The shell runs under a pseudo-terminal with a temporary $HOME
+ * holding generated '.tsh-rc', '.tsh-alias' and '.tsh-history' files of
+ * the given sizes. Built by 'make latency'.
+ *
+ * Usage: tsh-latency [-n RUNS] [-w WARMUP] [-a ALIASES] [-H HISTORY] [-r RCLINES]
+ *                    [-e] [-x COMMAND] [-c CSV] [-k] [SHELL]
+ *   -n RUNS     measured runs of each case (default 50)
+ *   -w WARMUP   unmeasured runs first (default 5)
+ *   -a ALIASES  aliases in '.tsh-alias' (default 100)
+ *   -H HISTORY  lines in '.tsh-history' (default 1000)
+ *   -r RCLINES  extra comment lines in '.tsh-rc' (default 0)
+ *   -e          use the built-in line editor (EDITOR=BUILTIN)
+ *   -x COMMAND  also time COMMAND, as the case 'custom'
+ *   -c CSV      write every sample to CSV
+ *   -k          keep the temporary $HOME
+ *   SHELL       the shell to run (default ./tsh)
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <ftw.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PROMPT    	"tsh-latency$ "	// Unlikely to appear in any output.
+#define TIMEOUT_MS	10000       	// Longest wait for a prompt.
+#define WINDOW    	256         	// Bytes of output kept while searching it.
+
+typedef struct options {
+	long runs;
+	long warmup;
+	long aliases;
+	long history;
+	long rcLines;
+	bool editor;
+	const char* custom;
+	const char* csv;
+	bool keep;
+	const char* shell;
+} options;
+
+typedef struct session {
+	pid_t pid;
+	int master;          	// The shell's terminal.
+	char window[WINDOW]; 	// The latest output, for finding text in it.
+	size_t used;
+} session;
+
+typedef struct benchmark {
+	const char* name;
+	const char* command; 	// NULL for start-up.
+	uint64_t* samples;   	// Nanoseconds.
+} benchmark;
+
+typedef struct summary {
+	double mean, stddev, min, p50, p90, p99, max;	// Nanoseconds.
+} summary;
+
+static char home[] = "/tmp/tsh-latency-XXXXXX";
+
+static void usage(void) {
+	fputs("Usage: tsh-latency [-n RUNS] [-w WARMUP] [-a ALIASES] [-H HISTORY] [-r RCLINES] [-e] [-x COMMAND] [-c CSV] [-k] [SHELL]\n", stderr);
+	exit(2);
+}
+
+static uint64_t now(void) {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec * 1000000000ULL + time.tv_nsec;
+}
+
+static long parse_count(const char* text) {
+	char* end;
+	long count = strtol(text, &end, 10);
+	if (count < 0 || *end != '\0' || end == text) usage();
+	return count;
+}
+
+/*
+ * Writes one of the generated files into the temporary $HOME.
+ */
+static FILE* create(const char* name) {
+	char path[sizeof(home) + 32];
+	snprintf(path, sizeof(path), "%s/%s", home, name);
+	FILE* file = fopen(path, "w");
+	if (file == NULL) {
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+	return file;
+}
+
+/*
+ * Fills the temporary $HOME: the configuration, the aliases (one of
+ * them, 'lat', is timed), the History, and a directory to run in.
+ */
+static void generate(options* o) {
+	if (mkdtemp(home) == NULL) {
+		perror("tsh-latency: mkdtemp");
+		exit(EXIT_FAILURE);
+	}
+	FILE* rc = create(".tsh-rc");
+	fprintf(rc, "PROMPT=%s\nCOLORS=OFF\n%s", PROMPT, o->editor ? "EDITOR=BUILTIN\n" : "");
+	for (long i = 0; i < o->rcLines; i++) fprintf(rc, "# Generated line %ld\n", i);
+	fclose(rc);
+	FILE* aliases = create(".tsh-alias");
+	if (o->aliases > 0) fputs("lat = 'true'\n", aliases);
+	for (long i = 1; i < o->aliases; i++) fprintf(aliases, "lat%ld = 'echo %ld'\n", i, i);
+	fclose(aliases);
+	FILE* history = create(".tsh-history");
+	for (long i = 0; i < o->history; i++) fprintf(history, "echo history line %ld\n", i);
+	fclose(history);
+	char work[sizeof(home) + 8];
+	snprintf(work, sizeof(work), "%s/work", home);
+	mkdir(work, 0700);
+}
+
+static int remove_entry(const char* path, const struct stat* info, int type, struct FTW* ftw) {
+	(void) info;
+	(void) type;
+	(void) ftw;
+	return remove(path);
+}
+
+/*
+ * Starts the shell on a new pseudo-terminal.
+ * Returns:
+ *   false, after printing why, if the shell could not be run.
+ */
+static bool start(session* s, options* o) {
+	*s = (session) {-1, posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC), "", 0};
+	int failure[2]; // The child's errno if it fails before exec; closed by a successful exec
+	if (s->master == -1 || grantpt(s->master) || unlockpt(s->master) || pipe2(failure, O_CLOEXEC)) {
+		perror("tsh-latency: pseudo-terminal");
+		return false;
+	}
+	struct winsize size = {24, 80, 0, 0};
+	ioctl(s->master, TIOCSWINSZ, &size);
+	s->pid = fork();
+	if (s->pid == 0) {
+		close(failure[0]);
+		setsid();
+		int slave = open(ptsname(s->master), O_RDWR);
+		char work[sizeof(home) + 8];
+		snprintf(work, sizeof(work), "%s/work", home);
+		if (slave != -1 && !chdir(work)) {
+			ioctl(slave, TIOCSCTTY, 0);
+			dup2(slave, STDIN_FILENO);
+			dup2(slave, STDOUT_FILENO);
+			dup2(slave, STDERR_FILENO);
+			if (slave > STDERR_FILENO) close(slave);
+			setenv("HOME", home, 1);
+			setenv("TERM", "xterm", 1);
+			if (getenv("USER") == NULL) setenv("USER", "latency", 1);
+			if (getenv("HOSTNAME") == NULL) setenv("HOSTNAME", "localhost", 1);
+			execl(o->shell, o->shell, (char*) NULL);
+		}
+		int error = errno;
+		if (write(failure[1], &error, sizeof(error))) {} // Nothing more to do if this fails too
+		_exit(127);
+	}
+	close(failure[1]);
+	int error = 0;
+	ssize_t received = s->pid > 0 ? read(failure[0], &error, sizeof(error)) : -1;
+	close(failure[0]);
+	if (s->pid == -1) perror("tsh-latency: fork");
+	else if (received > 0) {
+		fprintf(stderr, "tsh-latency: %s: %s\n", o->shell, strerror(error));
+		waitpid(s->pid, NULL, 0);
+		s->pid = -1;
+	}
+	return s->pid > 0;
+}
+
+/*
+ * Reads the shell's output until some text appears in it.
+ * Returns:
+ *   false if it does not within TIMEOUT_MS, or the shell is gone (its
+ *   end of the terminal closes, so reading fails at once).
+ */
+static bool wait_for(session* s, const char* text) {
+	size_t length = strlen(text);
+	uint64_t deadline = now() + TIMEOUT_MS * 1000000ULL;
+	while (true) {
+		if (memmem(s->window, s->used, text, length) != NULL) {
+			s->used = 0; // Only output after this counts next time
+			return true;
+		}
+		uint64_t time = now();
+		if (time >= deadline) return false;
+		struct pollfd ready = {s->master, POLLIN, 0};
+		int count = poll(&ready, 1, (deadline - time) / 1000000 + 1);
+		if (count == -1 && errno == EINTR) continue;
+		if (count <= 0) return false;
+		if (s->used > WINDOW / 2) { // Keeps enough of the old output for a match across reads
+			memmove(s->window, s->window + s->used - WINDOW / 2, WINDOW / 2);
+			s->used = WINDOW / 2;
+		}
+		ssize_t received = read(s->master, s->window + s->used, WINDOW - s->used);
+		if (received <= 0) return false; // EIO once the shell exits
+		s->used += received;
+	}
+}
+
+static void stop(session* s) {
+	if (s->pid > 0) {
+		if (write(s->master, "exit\r", 5) != 5 || !wait_for(s, "\n")) kill(s->pid, SIGKILL);
+		struct timespec pause = {0, 1000000};
+		for (int i = 0; i < 1000 && waitpid(s->pid, NULL, WNOHANG) == 0; i++) nanosleep(&pause, NULL);
+		kill(s->pid, SIGKILL);
+		waitpid(s->pid, NULL, 0);
+	}
+	if (s->master != -1) close(s->master);
+}
+
+/*
+ * Times one start-up, from fork() to the first prompt.
+ */
+static bool time_startup(options* o, uint64_t* sample) {
+	session s;
+	uint64_t started = now();
+	bool running = start(&s, o);
+	bool shown = running && wait_for(&s, PROMPT);
+	*sample = now() - started;
+	stop(&s);
+	if (running && !shown) fprintf(stderr, "tsh-latency: %s exited or did not show its prompt within %d ms.\n", o->shell, TIMEOUT_MS);
+	return shown;
+}
+
+/*
+ * Times one command, from Enter to the next prompt. The command is
+ * typed first and its echo awaited, so only running it is measured.
+ */
+static bool time_command(session* s, const char* command, uint64_t* sample) {
+	size_t length = strlen(command);
+	if (write(s->master, command, length) != (ssize_t) length) return false;
+	const char* tail = length > 8 ? command + length - 8 : command; // The echo may be redrawn in pieces
+	if (!wait_for(s, tail)) return false;
+	uint64_t started = now();
+	if (write(s->master, "\r", 1) != 1 || !wait_for(s, PROMPT)) return false;
+	*sample = now() - started;
+	return true;
+}
+
+static int by_value(const void* a, const void* b) {
+	uint64_t x = *(const uint64_t*) a, y = *(const uint64_t*) b;
+	return (x > y) - (x < y);
+}
+
+static summary summarize(uint64_t* samples, long count) {
+	uint64_t* sorted = malloc(count * sizeof(uint64_t));
+	memcpy(sorted, samples, count * sizeof(uint64_t));
+	qsort(sorted, count, sizeof(uint64_t), by_value);
+	summary s = {0};
+	for (long i = 0; i < count; i++) s.mean += sorted[i];
+	s.mean /= count;
+	for (long i = 0; i < count; i++) s.stddev += (sorted[i] - s.mean) * (sorted[i] - s.mean);
+	s.stddev = count > 1 ? sqrt(s.stddev / (count-1)) : 0;
+	s.min = sorted[0];
+	s.max = sorted[count-1];
+	s.p50 = sorted[(50 * count + 99) / 100 - 1]; // Nearest rank
+	s.p90 = sorted[(90 * count + 99) / 100 - 1];
+	s.p99 = sorted[(99 * count + 99) / 100 - 1];
+	free(sorted);
+	return s;
+}
+
+static const char* format(double ns, char* out, size_t size) {
+	if (ns >= 1e9) snprintf(out, size, "%.3fs", ns / 1e9);
+	else if (ns >= 1e6) snprintf(out, size, "%.2fms", ns / 1e6);
+	else snprintf(out, size, "%.1fus", ns / 1e3);
+	return out;
+}
+
+static void report(benchmark* benchmarks, int count, options* o) {
+	printf("tsh-latency: %s, %ld runs, %ld aliases, %ld History lines, %ld extra rc lines, %s\n",
+	       o->shell, o->runs, o->aliases, o->history, o->rcLines, o->editor ? "built-in editor" : "readline");
+	printf("%-10s %10s %10s %10s %10s %10s %10s %10s\n", "", "mean", "stddev", "min", "p50", "p90", "p99", "max");
+	for (int i = 0; i < count; i++) {
+		summary s = summarize(benchmarks[i].samples, o->runs);
+		double values[] = {s.mean, s.stddev, s.min, s.p50, s.p90, s.p99, s.max};
+		printf("%-10s", benchmarks[i].name);
+		for (size_t j = 0; j < sizeof(values) / sizeof(values[0]); j++) {
+			char text[32];
+			printf(" %10s", format(values[j], text, sizeof(text)));
+		}
+		putchar('\n');
+	}
+}
+
+static void write_csv(benchmark* benchmarks, int count, options* o) {
+	FILE* csv = fopen(o->csv, "w");
+	if (csv == NULL) {
+		perror(o->csv);
+		return;
+	}
+	fputs("case,run,nanoseconds\n", csv);
+	for (int i = 0; i < count; i++)
+		for (long run = 0; run < o->runs; run++)
+			fprintf(csv, "%s,%ld,%llu\n", benchmarks[i].name, run+1, (unsigned long long) benchmarks[i].samples[run]);
+	fclose(csv);
+}
+
+int main(int argc, char* argv[]) {
+	options o = {50, 5, 100, 1000, 0, false, NULL, NULL, false, "./tsh"};
+	int option;
+	while ((option = getopt(argc, argv, "n:w:a:H:r:ex:c:k")) != -1) {
+		switch (option) {
+			case 'n': o.runs = parse_count(optarg); break;
+			case 'w': o.warmup = parse_count(optarg); break;
+			case 'a': o.aliases = parse_count(optarg); break;
+			case 'H': o.history = parse_count(optarg); break;
+			case 'r': o.rcLines = parse_count(optarg); break;
+			case 'e': o.editor = true; break;
+			case 'x': o.custom = optarg; break;
+			case 'c': o.csv = optarg; break;
+			case 'k': o.keep = true; break;
+			default: usage();
+		}
+	}
+	if (optind < argc - 1 || o.runs == 0) usage();
+	if (optind == argc - 1) o.shell = argv[optind];
+	char shell[PATH_MAX]; // The shell runs in the temporary $HOME, so a relative path would miss
+	if (access(o.shell, X_OK) || realpath(o.shell, shell) == NULL) {
+		perror(o.shell);
+		return EXIT_FAILURE;
+	}
+	o.shell = shell;
+	signal(SIGPIPE, SIG_IGN);
+	generate(&o);
+
+	benchmark benchmarks[] = {
+		{"startup", NULL, NULL},
+		{"builtin", "cd .", NULL},
+		{"external", "true", NULL},
+		{"alias", "lat", NULL},
+		{"pipeline", "echo latency | cat", NULL},
+		{"custom", o.custom, NULL},
+	};
+	int count = sizeof(benchmarks) / sizeof(benchmarks[0]) - (o.custom == NULL);
+	if (o.aliases == 0) benchmarks[3] = benchmarks[--count]; // Nothing to expand
+	for (int i = 0; i < count; i++) benchmarks[i].samples = calloc(o.runs, sizeof(uint64_t));
+
+	bool failed = false;
+	uint64_t sample;
+	for (long run = -o.warmup; run < o.runs && !failed; run++) {
+		failed = !time_startup(&o, &sample);
+		if (run >= 0) benchmarks[0].samples[run] = sample;
+	}
+	session s = {-1, -1, "", 0};
+	if (!failed && !start(&s, &o)) failed = true;
+	else if (!failed && !wait_for(&s, PROMPT)) {
+		fprintf(stderr, "tsh-latency: %s exited or did not show its prompt within %d ms.\n", o.shell, TIMEOUT_MS);
+		failed = true;
+	}
+	for (long run = -o.warmup; run < o.runs && !failed; run++) // Interleaved, so drift hits every case alike
+		for (int i = 1; i < count && !failed; i++) {
+			failed = !time_command(&s, benchmarks[i].command, &sample);
+			if (failed) fprintf(stderr, "tsh-latency: No prompt after '%s'.\n", benchmarks[i].command);
+			else if (run >= 0) benchmarks[i].samples[run] = sample;
+		}
+	if (s.pid > 0) stop(&s);
+	if (!failed) {
+		report(benchmarks, count, &o);
+		if (o.csv != NULL) write_csv(benchmarks, count, &o);
+	}
+	for (int i = 0; i < count; i++) free(benchmarks[i].samples);
+	if (o.keep) fprintf(stderr, "tsh-latency: Kept %s\n", home);
+	else nftw(home, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}